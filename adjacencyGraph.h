@@ -0,0 +1,92 @@
+/**
+ * Author: Adam Mooers
+ *
+ * A compact, undirected graph over a small number of nodes stored as one
+ * bitset row per node. Used for the connectivity of the k-means centers.
+ * When the number of nodes is fixed at compile time, the rows live in a
+ * fixed-size array and each row of up to 64 nodes is a single word.
+ */
+
+#ifndef ADJACENCYGRAPH_H
+#define ADJACENCYGRAPH_H
+
+#include <stdint.h>
+#include <algorithm>
+#include "trackerConfig.h"
+
+/**
+ * @tparam  N   the number of nodes. 0 sets it at runtime with resize().
+ */
+template<int N = 0>
+class adjacency_graph
+{
+    public:
+        /**
+         * Sets the number of nodes and removes all edges.
+         *
+         * @param   n_nodes     the number of nodes. Ignored unless N is 0.
+         */
+        void resize(int n_nodes)
+        {
+            n = N > 0 ? N : n_nodes;
+            words_per_row = (n+63)/64;
+            config_storage<uint64_t, N*words_fixed>::size(bits, n*words_per_row, 0);
+        }
+
+        /**
+         * Removes all edges.
+         */
+        void clear(void)
+        {
+            std::fill(bits.begin(), bits.end(), 0);
+        }
+
+        /**
+         * Adds the undirected edge a-b.
+         */
+        void connect(int a, int b)
+        {
+            bits[a*words() + b/64] |= (uint64_t)1 << (b%64);
+            bits[b*words() + a/64] |= (uint64_t)1 << (a%64);
+        }
+
+        /**
+         * @return  whether or not a and b are neighbors
+         */
+        bool connected(int a, int b) const
+        {
+            return (bits[a*words() + b/64] >> (b%64)) & 1;
+        }
+
+        /**
+         * @return  the number of nodes
+         */
+        int size(void) const
+        {
+            return N > 0 ? N : n;
+        }
+
+        adjacency_graph(void) : n(0), words_per_row(0)
+        {
+            resize(N);
+        }
+
+    private:
+        static const int words_fixed = (N+63)/64;   // 64-bit words per bitset row when N is fixed
+
+        int n;                          // Number of nodes
+        int words_per_row;              // 64-bit words per bitset row
+        typename config_storage<uint64_t, N*words_fixed>::type bits;    // Row-major bitset rows
+
+        /**
+         * @return  the 64-bit words per row, a constant when N is fixed
+         */
+        int words(void) const
+        {
+            return N > 0 ? words_fixed : words_per_row;
+        }
+};
+
+template<int N> const int adjacency_graph<N>::words_fixed;
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in allocCheck.h.
+ */
+
+#include "allocCheck.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+
+static std::atomic<uint64_t> violations(0);
+static std::atomic<const char*> first_thread(nullptr);     // Where the first violation happened
+static std::atomic<size_t> first_size(0);
+static int abort_on_violation = -1;                         // Read from the environment on first use
+
+// Plain TLS, since the allocation functions cannot run constructors
+static __thread const char* checked_thread = nullptr;
+
+void alloc_check_thread(const char* name)
+{
+    if (abort_on_violation < 0)
+    {
+        const char* env = getenv("ALLOC_CHECK_ABORT");
+        abort_on_violation = (env && env[0] == '1') ? 1 : 0;
+    }
+
+    checked_thread = name;
+}
+
+const char* alloc_check_current(void)
+{
+    return checked_thread;
+}
+
+uint64_t alloc_check_violations(void)
+{
+    return violations.load(std::memory_order_relaxed);
+}
+
+bool alloc_check_report(FILE* out)
+{
+    uint64_t n = alloc_check_violations();
+
+#ifdef ALLOC_CHECK
+    if (n == 0)
+    {
+        fprintf(out, "alloc check: no allocations after warm-up\n");
+    }
+    else
+    {
+        fprintf(out, "alloc check: %llu allocations after warm-up, the first of %zu bytes on the %s thread\n",
+                (unsigned long long)n, first_size.load(), first_thread.load());
+    }
+#else
+    (void)out;
+#endif
+
+    return n == 0;
+}
+
+#ifdef ALLOC_CHECK
+
+// The glibc implementations the replacements below forward to
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t n, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+}
+
+/**
+ * Records an allocation if the calling thread is checked.
+ */
+static inline void note_allocation(size_t size)
+{
+    const char* name = checked_thread;
+
+    if (name == nullptr)
+    {
+        return;
+    }
+
+    if (violations.fetch_add(1, std::memory_order_relaxed) == 0)
+    {
+        first_size = size;
+        first_thread = name;
+    }
+
+    if (abort_on_violation == 1)
+    {
+        checked_thread = nullptr;
+        abort();
+    }
+}
+
+extern "C" void* malloc(size_t size)
+{
+    note_allocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size)
+{
+    note_allocation(n*size);
+    return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    note_allocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size)
+{
+    note_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size)
+{
+    note_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    // The alignment must be a power of two multiple of sizeof(void*)
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment-1)) != 0)
+    {
+        return EINVAL;
+    }
+
+    note_allocation(size);
+    void* mem = __libc_memalign(alignment, size);
+
+    if (mem == nullptr && size != 0)
+    {
+        return ENOMEM;
+    }
+
+    *ptr = mem;
+    return 0;
+}
+
+#endif
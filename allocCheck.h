@@ -0,0 +1,65 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Catches heap allocations on the hot path. Every per-frame buffer is sized
+ * when the pipeline starts, so once a stage has warmed up, it should never
+ * call the allocator again. A thread declares this with ALLOC_CHECK_THREAD,
+ * and from then on every malloc, calloc, realloc or aligned allocation it
+ * makes (including operator new and OpenCV's allocations) is counted as a
+ * violation. Worker pools pass the setting on to the threads that run tasks
+ * for a checked thread.
+ *
+ * The check is compiled in with -DALLOC_CHECK (make ALLOC_CHECK=1), which
+ * replaces the allocation functions of glibc. Without it the macros expand
+ * to nothing. Set ALLOC_CHECK_ABORT=1 in the environment to abort on the
+ * first violation, so a debugger or core dump shows where it came from.
+ *
+ *   ALLOC_CHECK_THREAD("track");       // after the warm-up frames
+ *   ...
+ *   bool clean = alloc_check_report(stdout);
+ */
+
+#ifndef ALLOCCHECK_H
+#define ALLOCCHECK_H
+
+#include <cstdio>
+#include <stdint.h>
+
+/**
+ * Starts or stops counting the allocations of the calling thread.
+ *
+ * @param   name    the name to report violations under, or nullptr to stop checking the thread
+ */
+void alloc_check_thread(const char* name);
+
+/**
+ * @return  the name the calling thread is checked under, or nullptr if it is not checked
+ */
+const char* alloc_check_current(void);
+
+/**
+ * @return  the number of allocations made by checked threads
+ */
+uint64_t alloc_check_violations(void);
+
+/**
+ * Prints the number of violations and the first one.
+ *
+ * @param   out     where to print
+ * @return  true if there were no violations
+ */
+bool alloc_check_report(FILE* out);
+
+#ifdef ALLOC_CHECK
+
+#define ALLOC_CHECK_THREAD(name) alloc_check_thread(name)
+#define ALLOC_CHECK_CURRENT() alloc_check_current()
+
+#else
+
+#define ALLOC_CHECK_THREAD(name) do { (void)(name); } while (0)
+#define ALLOC_CHECK_CURRENT() ((const char*)nullptr)
+
+#endif
+
+#endif
@@ -0,0 +1,378 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in armFitter.h.
+ */
+
+#define FIT_DAMPING 0.05f           // Pull of the last pose on each joint, relative to the points per joint
+#define FIT_SEARCH_INTERVAL 10      // Frames between searches for a missing arm while the other is fitted
+
+#include "armFitter.h"
+#include "framePipeline.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/**
+ * @return  the distance between two points
+ */
+static inline float distance3(const float* a, const float* b)
+{
+    float d[3] = {a[0]-b[0], a[1]-b[1], a[2]-b[2]};
+    return sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+}
+
+void arm_fitter::lock(const float* hand, const float* elbow, const float* shoulder)
+{
+    memcpy(arm_fitter::hand, hand, sizeof(arm_fitter::hand));
+    memcpy(arm_fitter::elbow, elbow, sizeof(arm_fitter::elbow));
+    memcpy(arm_fitter::shoulder, shoulder, sizeof(arm_fitter::shoulder));
+
+    forearm_length = distance3(hand, elbow);
+    upper_arm_length = distance3(elbow, shoulder);
+    is_locked = forearm_length > 0 && upper_arm_length > 0;
+}
+
+bool arm_fitter::fit(const cv::Mat& cloud)
+{
+    if (!is_locked)
+    {
+        return false;
+    }
+
+    int n = gather(cloud);
+    double sq_residual = 0;
+    inliers = 0;
+
+    for (int i = 0; i < iterations && n > 0; i++)
+    {
+        inliers = step(n, sq_residual);
+    }
+
+    residual = inliers > 0 ? (float)sqrt(sq_residual/inliers) : 0;
+
+    if (inliers < min_points || residual > max_residual)
+    {
+        is_locked = false;
+    }
+
+    return is_locked;
+}
+
+int arm_fitter::gather(const cv::Mat& cloud)
+{
+    float lo[3], hi[3];
+    float reach = radius+gate;
+
+    for (int j = 0; j < 3; j++)
+    {
+        lo[j] = std::min(hand[j], std::min(elbow[j], shoulder[j])) - reach;
+        hi[j] = std::max(hand[j], std::max(elbow[j], shoulder[j])) + reach;
+    }
+
+    if (near.size() < 3*(size_t)cloud.rows)
+    {
+        near.resize(3*cloud.rows);
+    }
+
+    float* out = near.data();
+
+    for (int i = 0; i < cloud.rows; i++)
+    {
+        const float* p = cloud.ptr<float>(i);
+
+        if (p[0] >= lo[0] && p[0] <= hi[0] && p[1] >= lo[1] && p[1] <= hi[1] && p[2] >= lo[2] && p[2] <= hi[2])
+        {
+            out[0] = p[0];
+            out[1] = p[1];
+            out[2] = p[2];
+            out += 3;
+        }
+    }
+
+    return (int)(out-near.data())/3;
+}
+
+int arm_fitter::step(int n, double& sq_residual)
+{
+    float* joints[3] = {hand, elbow, shoulder};
+
+    // Normal equations of the joint positions. The weights of a point on the joints
+    // are the same for x, y and z, so one 3x3 system serves all three.
+    double m[3][3] = {{0}};
+    double rhs[3][3] = {{0}};
+    int count = 0;
+    sq_residual = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        const float* p = &near[3*i];
+        int best_seg = -1;
+        float best_t = 0;
+        float best_sq = INFINITY;
+        bool beyond_shoulder = false;
+
+        for (int s = 0; s < 2; s++)
+        {
+            const float* a = joints[s];
+            const float* b = joints[s+1];
+            float ab[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]};
+            float ab_sq = ab[0]*ab[0] + ab[1]*ab[1] + ab[2]*ab[2];
+
+            if (ab_sq <= 0)
+            {
+                continue;
+            }
+
+            float t = ((p[0]-a[0])*ab[0] + (p[1]-a[1])*ab[1] + (p[2]-a[2])*ab[2])/ab_sq;
+            float tc = std::min(std::max(t, 0.0f), 1.0f);
+            float d[3] = {p[0]-a[0]-tc*ab[0], p[1]-a[1]-tc*ab[1], p[2]-a[2]-tc*ab[2]};
+            float d_sq = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+
+            if (d_sq < best_sq)
+            {
+                best_seg = s;
+                best_t = tc;
+                best_sq = d_sq;
+                beyond_shoulder = s == 1 && t > 1;
+            }
+        }
+
+        float dist = sqrtf(best_sq);
+
+        // Past the shoulder is the torso, and points far off the surface belong to something else
+        if (best_seg < 0 || beyond_shoulder || fabsf(dist-radius) > gate || dist <= 0)
+        {
+            continue;
+        }
+
+        // The axis point that would put p on the surface
+        const float* a = joints[best_seg];
+        const float* b = joints[best_seg+1];
+        float target[3];
+        float shrink = radius/dist;
+
+        for (int j = 0; j < 3; j++)
+        {
+            float c = a[j] + best_t*(b[j]-a[j]);
+            target[j] = p[j] - (p[j]-c)*shrink;
+        }
+
+        float w[3] = {0, 0, 0};
+        w[best_seg] = 1-best_t;
+        w[best_seg+1] = best_t;
+
+        for (int r = 0; r < 3; r++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                m[r][c] += w[r]*w[c];
+            }
+
+            for (int j = 0; j < 3; j++)
+            {
+                rhs[r][j] += w[r]*target[j];
+            }
+        }
+
+        sq_residual += (dist-radius)*(dist-radius);
+        count++;
+    }
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    // Keep joints the points say little about near the last pose
+    double damping = FIT_DAMPING*count/3;
+
+    for (int r = 0; r < 3; r++)
+    {
+        m[r][r] += damping;
+
+        for (int j = 0; j < 3; j++)
+        {
+            rhs[r][j] += damping*joints[r][j];
+        }
+    }
+
+    // Invert the symmetric 3x3 system by cofactors
+    double inv[3][3];
+    inv[0][0] = m[1][1]*m[2][2] - m[1][2]*m[2][1];
+    inv[0][1] = m[0][2]*m[2][1] - m[0][1]*m[2][2];
+    inv[0][2] = m[0][1]*m[1][2] - m[0][2]*m[1][1];
+    inv[1][1] = m[0][0]*m[2][2] - m[0][2]*m[2][0];
+    inv[1][2] = m[0][2]*m[1][0] - m[0][0]*m[1][2];
+    inv[2][2] = m[0][0]*m[1][1] - m[0][1]*m[1][0];
+    inv[1][0] = inv[0][1];
+    inv[2][0] = inv[0][2];
+    inv[2][1] = inv[1][2];
+
+    double det = m[0][0]*inv[0][0] + m[0][1]*inv[1][0] + m[0][2]*inv[2][0];
+
+    if (fabs(det) < 1e-12)
+    {
+        return count;
+    }
+
+    for (int r = 0; r < 3; r++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            joints[r][j] = (float)((inv[r][0]*rhs[0][j] + inv[r][1]*rhs[1][j] + inv[r][2]*rhs[2][j])/det);
+        }
+    }
+
+    // The bones keep their lengths along their new directions
+    keep_length(elbow, hand, forearm_length);
+    keep_length(elbow, shoulder, upper_arm_length);
+
+    return count;
+}
+
+void arm_fitter::keep_length(const float* from, float* to, float length)
+{
+    float len = distance3(from, to);
+
+    if (len <= 0)
+    {
+        return;
+    }
+
+    for (int j = 0; j < 3; j++)
+    {
+        to[j] = from[j] + (to[j]-from[j])*length/len;
+    }
+}
+
+void arm_fitter::reserve(int max_points)
+{
+    near.reserve(3*max_points);
+}
+
+arm_fitter::arm_fitter(int iterations, float radius, float gate, float max_residual, int min_points)
+    : iterations(iterations), radius(radius), gate(gate), max_residual(max_residual), min_points(min_points)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        hand[i] = 0;
+        elbow[i] = 0;
+        shoulder[i] = 0;
+    }
+}
+
+template<class Config>
+bool fitted_arms<Config>::track(basic_tracker<Config>& trk, const std::vector<depth_frame>& views, basic_arm<Config>& left,
+                                basic_arm<Config>& right, const pipeline_config& config, bool& left_tracked, bool& right_tracked)
+{
+    left_tracked = false;
+    right_tracked = false;
+
+    if (enabled())
+    {
+        TRACE_SCOPE("fit_arms");
+        left_tracked = fit_arm(fitters[0], left, trk.source_cloud);
+        right_tracked = fit_arm(fitters[1], right, trk.source_cloud);
+    }
+
+    // Search the clusters for arms that are not locked, but only now and then for
+    // one arm while the other one is fitted
+    bool search = !left_tracked && !right_tracked;
+
+    if (left_tracked != right_tracked && --search_countdown <= 0)
+    {
+        search = true;
+    }
+
+    if (!search)
+    {
+        return false;
+    }
+
+    search_countdown = FIT_SEARCH_INTERVAL;
+    bool clustered;
+
+    if (config.superpixel_iterations > 0)
+    {
+        // The superpixels come connected. A surface ends where the segmentation splits it.
+        TRACE_SCOPE("superpixels");
+        clustered = trk.cluster_superpixels(views, config.superpixel_iterations, config.superpixel_compactness,
+                                            config.filter_max_dist);
+    }
+    else
+    {
+        {
+            TRACE_SCOPE("cluster");
+            clustered = trk.cluster(config.kmeans_attempts, config.kmeans_iterations, config.kmeans_epsilon);
+        }
+
+        if (clustered)
+        {
+            TRACE_SCOPE("connect_means");
+            trk.connect_means(config.connect_threshold);
+        }
+    }
+
+    if (!clustered)
+    {
+        return false;
+    }
+
+    // The predictor filters the raw joints itself, without the lag of smoothing
+    TRACE_SCOPE("update_joints");
+    float smoothing = config.predictor ? 1.0f : config.joint_smoothing;
+    basic_arm<Config>* arms[2] = {&left, &right};
+    bool* tracked[2] = {&left_tracked, &right_tracked};
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (*tracked[i])
+        {
+            continue;   // Fitted already
+        }
+
+        *tracked[i] = arms[i]->update_joints(smoothing);
+
+        if (*tracked[i] && enabled())
+        {
+            fitters[i].lock(arms[i]->hand_loc, arms[i]->elbow_loc, arms[i]->shoulder_loc);
+        }
+    }
+
+    return true;
+}
+
+template<class Config>
+bool fitted_arms<Config>::fit_arm(arm_fitter& fitter, basic_arm<Config>& a, const cv::Mat& cloud)
+{
+    if (!fitter.fit(cloud))
+    {
+        return false;
+    }
+
+    memcpy(a.hand_loc, fitter.hand, sizeof(a.hand_loc));
+    memcpy(a.elbow_loc, fitter.elbow, sizeof(a.elbow_loc));
+    memcpy(a.shoulder_loc, fitter.shoulder, sizeof(a.shoulder_loc));
+
+    return true;
+}
+
+template<class Config>
+void fitted_arms<Config>::reserve(int max_points)
+{
+    fitters[0].reserve(max_points);
+    fitters[1].reserve(max_points);
+}
+
+template<class Config>
+fitted_arms<Config>::fitted_arms(int iterations, float radius, float gate, float max_residual, int min_points)
+    : iterations(iterations),
+      fitters{arm_fitter(iterations, radius, gate, max_residual, min_points),
+              arm_fitter(iterations, radius, gate, max_residual, min_points)}
+{
+}
+
+template class fitted_arms<compiled_tracker_config>;
+template class fitted_arms<runtime_tracker_config>;
@@ -0,0 +1,180 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Follows a locked arm by fitting a model straight to the points around it,
+ * instead of clustering the whole cloud every frame. The arm is modelled
+ * as two capsules of a fixed radius, forearm (hand to elbow) and upper arm
+ * (elbow to shoulder), joined at the elbow. Starting from the pose of the
+ * previous frame, a few iterations of point-to-model ICP pull the joints
+ * towards the points within a gate of the surface: each point is matched
+ * to the closest point on the axis of its capsule, and the joints are
+ * solved in closed form so the axis passes one radius from the points. Both
+ * bones keep the lengths they had when the arm was locked: the fingers and
+ * the torso leave the ends of the arm poorly defined, and a bone that can
+ * stretch slides along its own axis.
+ *
+ * Only the points in the box around the arm are fitted, so the cost of a
+ * frame scales with the points near the arm rather than with the cloud.
+ * k-means and the arm search (see tracker.h) still find the arms at first
+ * and whenever a fit loses its arm.
+ */
+
+#ifndef ARMFITTER_H
+#define ARMFITTER_H
+
+#include "opencv2/core/core.hpp"
+#include "tracker.h"
+#include <vector>
+
+struct pipeline_config;
+
+class arm_fitter
+{
+    public:
+        float hand[3];              // The fitted joints
+        float elbow[3];
+        float shoulder[3];
+        int inliers = 0;            // Points matched to the model in the last fit
+        float residual = 0;         // RMS distance of those points to the surface (meters)
+
+        /**
+         * Starts following an arm from the given pose.
+         */
+        void lock(const float* hand, const float* elbow, const float* shoulder);
+
+        /**
+         * Stops following the arm.
+         */
+        void unlock(void)
+        {
+            is_locked = false;
+        }
+
+        /**
+         * @return  whether or not an arm is being followed
+         */
+        bool locked(void) const
+        {
+            return is_locked;
+        }
+
+        /**
+         * Fits the model to the cloud, starting from the last pose. Unlocks the arm if too
+         * few points are left near the model or they fit it too loosely.
+         *
+         * @param   cloud   the point cloud of the user (n x 3)
+         * @return  whether or not the arm is still locked
+         */
+        bool fit(const cv::Mat& cloud);
+
+        /**
+         * Sizes the scratch for the largest cloud that will be fitted, so fitting does
+         * not allocate once it is running.
+         */
+        void reserve(int max_points);
+
+        /**
+         * @param   iterations      ICP iterations per frame
+         * @param   radius          the radius of the capsules (meters)
+         * @param   gate            the farthest a point may be from the surface to be fitted (meters)
+         * @param   max_residual    the RMS distance to the surface over which the arm is lost (meters)
+         * @param   min_points      the fewest points the model must match to keep the arm
+         */
+        arm_fitter(int iterations, float radius, float gate, float max_residual, int min_points);
+
+    private:
+        int iterations;
+        float radius;
+        float gate;
+        float max_residual;
+        int min_points;
+        bool is_locked = false;
+        float forearm_length = 0;    // The bone lengths when the arm was locked
+        float upper_arm_length = 0;
+        std::vector<float> near;    // The points in the box around the arm, x, y and z interleaved
+
+        /**
+         * Copies the points of the cloud in the box around the model into near.
+         *
+         * @return  the number of points copied
+         */
+        int gather(const cv::Mat& cloud);
+
+        /**
+         * Runs one ICP iteration on the first n points of near and moves the joints.
+         *
+         * @param   n           the number of points
+         * @param   sq_residual the sum of the squared distances to the surface (output)
+         * @return  the number of points matched to the model
+         */
+        int step(int n, double& sq_residual);
+
+        /**
+         * Moves a joint along its bone so the bone has the given length.
+         */
+        static void keep_length(const float* from, float* to, float length);
+};
+
+/**
+ * Tracks both arms of each frame: locked arms are fitted, and clustering (k-means
+ * or superpixels, see pipeline_config) with the arm search runs only while an arm
+ * is not locked. An arm found by the search is locked from its joints. While one
+ * arm is fitted, the other is only looked for every few frames, so a missing arm
+ * does not bring back the cost of k-means.
+ *
+ * @tparam  Config  the tracker configuration (see trackerConfig.h)
+ */
+template<class Config>
+class fitted_arms
+{
+    public:
+        /**
+         * Tracks the arms on the cloud the tracker was last given. The joints of fitted
+         * arms are written to the arms as they are, without smoothing.
+         *
+         * @param   trk             the tracker, with the cloud of the frame
+         * @param   views           the segmented frames the cloud was built from, clustered
+         *                          instead of the cloud if config selects superpixels
+         * @param   left            the left arm
+         * @param   right           the right arm
+         * @param   config          the clustering, mesh and smoothing parameters
+         * @param   left_tracked    whether or not the left arm was tracked (output)
+         * @param   right_tracked   whether or not the right arm was tracked (output)
+         * @return  whether or not the frame was clustered
+         */
+        bool track(basic_tracker<Config>& trk, const std::vector<depth_frame>& views, basic_arm<Config>& left,
+                   basic_arm<Config>& right, const pipeline_config& config, bool& left_tracked, bool& right_tracked);
+
+        /**
+         * @return  whether or not the arms are fitted once found
+         */
+        bool enabled(void) const
+        {
+            return iterations > 0;
+        }
+
+        /**
+         * Sizes the fitters for the largest cloud that will be tracked.
+         */
+        void reserve(int max_points);
+
+        /**
+         * @param   iterations      ICP iterations per frame. 0 runs k-means on every frame.
+         * @param   radius, gate, max_residual, min_points  see arm_fitter
+         */
+        fitted_arms(int iterations, float radius, float gate, float max_residual, int min_points);
+
+    private:
+        int iterations;
+        arm_fitter fitters[2];      // Left, then right
+        int search_countdown = 0;   // Frames until a missing arm is looked for while the other is fitted
+
+        /**
+         * Fits a locked arm and copies the fitted joints into it.
+         *
+         * @return  whether or not the arm is still locked
+         */
+        bool fit_arm(arm_fitter& fitter, basic_arm<Config>& a, const cv::Mat& cloud);
+};
+
+#endif
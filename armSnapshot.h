@@ -0,0 +1,33 @@
+/**
+ * Author: Adam Mooers
+ *
+ * The joints of one arm as they leave the tracker. Kept apart from the
+ * pipeline so the publisher and predictor can use it without pulling in
+ * OpenCV and the camera headers.
+ */
+
+#ifndef ARMSNAPSHOT_H
+#define ARMSNAPSHOT_H
+
+/**
+ * The joint positions of one arm at the end of a frame. The rates are only
+ * estimated with a joint predictor (see jointPredictor.h) and zero otherwise.
+ */
+struct arm_snapshot
+{
+    bool tracked = false;       // Whether or not the arm was tracked in this frame
+    float hand[3];
+    float elbow[3];
+    float shoulder[3];
+    float bend_angle = 0;       // Degrees
+    float hand_vel[3] = {0, 0, 0};      // m/s
+    float elbow_vel[3] = {0, 0, 0};
+    float shoulder_vel[3] = {0, 0, 0};
+    float hand_acc[3] = {0, 0, 0};      // m/s^2
+    float elbow_acc[3] = {0, 0, 0};
+    float shoulder_acc[3] = {0, 0, 0};
+    float bend_rate = 0;                // Degrees/s
+    float bend_acc = 0;                 // Degrees/s^2
+};
+
+#endif
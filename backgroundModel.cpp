@@ -0,0 +1,202 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in backgroundModel.h.
+ */
+
+#define BACKGROUND_UPDATE_STRIPES 8     // Rows are updated once every this many frames after learning
+#define BACKGROUND_UPDATE_RATE 0.02f    // Weight of a new sample once the model has learned
+#define BACKGROUND_UNKNOWN 65535        // The limit of pixels without a background, so every depth is foreground
+
+#include "backgroundModel.h"
+#include "cloudKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+int background_model::subtract(cv::Mat& image, const cv::Rect& window, float depth_scale)
+{
+    if (!enabled())
+    {
+        return -1;
+    }
+
+    // The model stays at the largest size it was reserved for, and smaller images are mapped onto it
+    if (image.rows > rows || image.cols > cols)
+    {
+        reserve(image.rows, image.cols);
+    }
+
+    map_image(image.rows, image.cols);
+    gap = min_gap/depth_scale;
+
+    // Keep the rows to learn from before they are masked and segmented
+    for (int i = window.y; i < window.y+window.height; i++)
+    {
+        if (learns_row(i))
+        {
+            memcpy(&samples[i*image_cols+window.x], image.ptr<uint16_t>(i)+window.x, window.width*sizeof(uint16_t));
+        }
+    }
+
+    if (frames < learn_frames)
+    {
+        return -1;
+    }
+
+    int n_foreground = 0;
+
+    for (int i = window.y; i < window.y+window.height; i++)
+    {
+        n_foreground += mask_foreground_row(image.ptr<uint16_t>(i)+window.x, row_limits(i, window.x, window.width),
+                                            window.width);
+    }
+
+    return n_foreground;
+}
+
+void background_model::learn(const cv::Mat& image, const cv::Rect& window)
+{
+    if (!enabled())
+    {
+        return;
+    }
+
+    for (int i = window.y; i < window.y+window.height; i++)
+    {
+        if (learns_row(i))
+        {
+            learn_row(&samples[i*image_cols+window.x], image.ptr<uint16_t>(i)+window.x, i, window.x, window.width);
+        }
+    }
+
+    frames++;
+}
+
+bool background_model::learns_row(int i) const
+{
+    // Every row at first, then one stripe of rows per frame
+    return frames < learn_frames || i % BACKGROUND_UPDATE_STRIPES == frames % BACKGROUND_UPDATE_STRIPES;
+}
+
+void background_model::learn_row(const uint16_t* before, const uint16_t* after, int i, int x, int n)
+{
+    int ind = model_row[i]*cols;
+    float* m = &mean[ind];
+    float* v = &var[ind];
+    uint16_t* c = &count[ind];
+    uint16_t* l = &limit[ind];
+    const int* col = &model_col[x];
+    const uint16_t max_count = (uint16_t)(1/BACKGROUND_UPDATE_RATE);
+
+    for (int j = 0; j < n; j++)
+    {
+        float d = before[j];
+        int k = col[j];
+
+        if (d == 0 || after[j] != 0)
+        {
+            continue;   // No reading, or part of the user
+        }
+
+        if (c[k] == 0 || d > m[k]+gap)
+        {
+            // A farther surface: whatever was seen before stood in front of the background
+            m[k] = d;
+            v[k] = 0;
+            c[k] = 1;
+        }
+        else if (d >= m[k]-gap)
+        {
+            // Exact running moments at first, then an exponential window
+            c[k] = std::min((uint16_t)(c[k]+1), max_count);
+            float a = std::max(1.0f/c[k], BACKGROUND_UPDATE_RATE);
+            float delta = d-m[k];
+            m[k] += a*delta;
+            v[k] = (1-a)*(v[k] + a*delta*delta);
+        }
+        else
+        {
+            continue;   // Something removed in front of the background
+        }
+
+        float margin = std::max(gap, n_sigma*sqrtf(v[k]));
+        l[k] = (uint16_t)std::max(m[k]-margin, 0.0f);
+    }
+}
+
+const uint16_t* background_model::row_limits(int i, int x, int n)
+{
+    const uint16_t* src = &limit[model_row[i]*cols];
+
+    if (image_cols == cols)
+    {
+        return src+x;
+    }
+
+    for (int j = 0; j < n; j++)
+    {
+        limit_row[j] = src[model_col[x+j]];
+    }
+
+    return limit_row.data();
+}
+
+void background_model::map_image(int rows, int cols)
+{
+    if (rows == image_rows && cols == image_cols)
+    {
+        return;
+    }
+
+    image_rows = rows;
+    image_cols = cols;
+
+    // The model pixel nearest to the center of each image pixel. Within the capacity set by reserve().
+    model_row.resize(rows);
+    model_col.resize(cols);
+
+    for (int i = 0; i < rows; i++)
+    {
+        model_row[i] = std::min((int)((i+0.5f)*background_model::rows/rows), background_model::rows-1);
+    }
+
+    for (int j = 0; j < cols; j++)
+    {
+        model_col[j] = std::min((int)((j+0.5f)*background_model::cols/cols), background_model::cols-1);
+    }
+}
+
+void background_model::configure(int learn_frames, float min_gap, float n_sigma)
+{
+    background_model::learn_frames = learn_frames;
+    background_model::min_gap = min_gap;
+    background_model::n_sigma = n_sigma;
+
+    frames = 0;
+    std::fill(count.begin(), count.end(), 0);
+    std::fill(limit.begin(), limit.end(), BACKGROUND_UNKNOWN);
+}
+
+void background_model::reserve(int rows, int cols)
+{
+    if (!enabled() || (rows == background_model::rows && cols == background_model::cols))
+    {
+        return;
+    }
+
+    background_model::rows = rows;
+    background_model::cols = cols;
+
+    mean.assign(rows*cols, 0);
+    var.assign(rows*cols, 0);
+    count.assign(rows*cols, 0);
+    limit.assign(rows*cols, BACKGROUND_UNKNOWN);
+    samples.assign(rows*cols, 0);
+    limit_row.assign(cols, 0);
+    model_row.reserve(rows);
+    model_col.reserve(cols);
+    image_rows = 0;
+    image_cols = 0;
+    frames = 0;
+}
@@ -0,0 +1,150 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Learns the static scene behind the user, per pixel, so the background can
+ * be removed with a single compare per pixel instead of segmenting the whole
+ * image. The camera is mounted on the chair, so the scene behind the user
+ * barely changes.
+ *
+ * The model learns from what segmentation removes: a pixel that had a depth
+ * before segmentation and none after it saw the background. The user stays
+ * in view the whole time, so learning from every pixel would teach the model
+ * that the user is background wherever they sit still. Each pixel keeps a
+ * running mean and variance of the farthest background surface it has seen.
+ * A sample well beyond the mean restarts the pixel on the new surface and
+ * samples near the mean are averaged in. Pixels nearer than the mean by more
+ * than a few standard deviations (and at least a minimum gap) are
+ * foreground, as are the pixels where no background has been seen yet.
+ *
+ * Every row is learned during the first frames. Only the window passed in
+ * is learned from, so depth_cam captures whole frames until the model has
+ * learned, even once the tracker has narrowed them to the user. Afterwards
+ * the model keeps adapting slowly, one stripe of rows per frame, so the
+ * cost stays small.
+ *
+ * The model is kept at the size of the largest images, so it survives a
+ * change of scale factor. Each pixel of a smaller image is mapped to the
+ * model pixel nearest to its center. Model pixels that were only ever seen
+ * at a smaller scale have no background yet and are learned by the stripes
+ * once the larger scale is back.
+ *
+ *   int n = model.subtract(image, window, depth_scale);  // -1 while learning
+ *   ... segment what is left ...
+ *   model.learn(image, window);
+ */
+
+#ifndef BACKGROUNDMODEL_H
+#define BACKGROUNDMODEL_H
+
+#include "opencv2/core/core.hpp"
+#include <stdint.h>
+#include <vector>
+
+class background_model
+{
+    public:
+        /**
+         * Zeroes every pixel of the window that belongs to the learned background.
+         * While the model is still learning, or if it is disabled, the image is left
+         * as it is. The rows learn() will learn from are kept aside first.
+         *
+         * @param   image           the CV_16UC1 depth image, masked in place
+         * @param   window          the part of the image to work on
+         * @param   depth_scale     meters per depth unit
+         * @return  the number of foreground pixels left in the window, or -1 if the
+         *          image was not masked
+         */
+        int subtract(cv::Mat& image, const cv::Rect& window, float depth_scale);
+
+        /**
+         * Learns from the pixels that had a depth when subtract() was called and have
+         * none now, i.e. the pixels segmentation removed.
+         *
+         * @param   image   the image passed to subtract, after segmentation
+         * @param   window  the window passed to subtract
+         */
+        void learn(const cv::Mat& image, const cv::Rect& window);
+
+        /**
+         * Sets up the model and forgets anything it learned.
+         *
+         * @param   learn_frames    the frames every pixel is learned from before masking
+         *                          starts. 0 disables the model.
+         * @param   min_gap         the smallest distance in front of the background that
+         *                          counts as foreground (meters)
+         * @param   n_sigma         the distance in front of the background that counts as
+         *                          foreground, in standard deviations of the pixel
+         */
+        void configure(int learn_frames, float min_gap, float n_sigma);
+
+        /**
+         * Sizes the model for images of up to the given size, so it does not allocate
+         * once frames arrive. Forgets what it learned if the size changes.
+         */
+        void reserve(int rows, int cols);
+
+        /**
+         * @return  whether or not the model is used (see configure)
+         */
+        bool enabled(void) const
+        {
+            return learn_frames > 0;
+        }
+
+        /**
+         * @return  whether or not the model is used and still learning every row
+         */
+        bool learning(void) const
+        {
+            return frames < learn_frames;
+        }
+
+    private:
+        int learn_frames = 0;
+        float min_gap = 0;
+        float n_sigma = 0;
+        int frames = 0;                 // Frames learned from since the model was reset
+        float gap = 0;                  // The minimum gap of the current frame (depth units)
+        int rows = 0;                   // The size of the model, the largest image size
+        int cols = 0;
+        int image_rows = 0;             // The image size model_row and model_col are built for
+        int image_cols = 0;
+
+        std::vector<float> mean;        // The depth of the background surface (depth units)
+        std::vector<float> var;         // Its variance
+        std::vector<uint16_t> count;    // Samples averaged into the mean, up to the adaptation window
+        std::vector<uint16_t> limit;    // The first depth that counts as background. 65535 if unknown.
+        std::vector<uint16_t> samples;  // The rows to learn from, as they were before segmentation
+        std::vector<int> model_row;     // The model row of each image row
+        std::vector<int> model_col;     // The model column of each image column
+        std::vector<uint16_t> limit_row;    // The limits of one image row, gathered from the model
+
+        /**
+         * @return  whether or not row i is learned from in the current frame
+         */
+        bool learns_row(int i) const;
+
+        /**
+         * Adds one row of background samples to the model and refreshes the limits of
+         * its pixels.
+         *
+         * @param   before  the depths before segmentation
+         * @param   after   the depths after segmentation. Only pixels removed by it are learned.
+         * @param   i       the image row
+         * @param   x       the image column of the first pixel
+         * @param   n       the number of pixels
+         */
+        void learn_row(const uint16_t* before, const uint16_t* after, int i, int x, int n);
+
+        /**
+         * @return  the limits of n pixels of image row i, starting at column x
+         */
+        const uint16_t* row_limits(int i, int x, int n);
+
+        /**
+         * Maps the pixels of images of the given size onto the model.
+         */
+        void map_image(int rows, int cols);
+};
+
+#endif
@@ -0,0 +1,577 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Microbenchmarks each stage of the tracker in isolation. The image stages
+ * are swept over scale factors, the tracking stages over k and the point
+ * cloud size, and the multi-camera stages over the number of cameras. Frames come from the synthetic source by default, so
+ * no camera is needed, or from a recording made with pose --record.
+ *
+ * Each benchmark case is printed as one JSON object per line:
+ *
+ *   {"stage":"to_depth_frame","source":"synthetic","scale":0.16,"k":null,
+ *    "points":2210,"iterations":200,"ns_per_frame":41234,"points_per_s":5.36e+07,
+ *    "p50_ns":40122,"p90_ns":45010,"p99_ns":61001,"max_ns":80112}
+ */
+
+#define BENCH_ITERATIONS 200
+#define BENCH_WARMUP 10
+#define BENCH_FRAME_POOL 16                 // Distinct frames cycled through per case
+#define BENCH_TRACKING_SCALE 0.5f           // Scale of the frames the tracking clouds are sampled from
+#define BENCH_SCALES {0.1f, 0.16f, 0.2f, 0.3f, 0.5f}
+#define BENCH_KS {16, 24, 30, 40}
+#define BENCH_CLOUD_SIZES {500, 1000, 2000, 4000, 8000}
+#define BENCH_RIG_CAMERAS {1, 2, 3}
+#define BENCH_RIG_SCALE 0.16f
+#define RIG_SYNC_TOLERANCE_MS 20.0
+#define BENCH_SUPERPIXEL_ITERATIONS 4      // The superpixels are benchmarked even though they are off by default
+#define BENCH_LEFT_ARM_START_POS {0.25f, -0.1f, 0.75f}  // Near the synthetic hands, in camera coordinates
+#define BENCH_RIGHT_ARM_START_POS {-0.25f, -0.1f, 0.75f}
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include "cameraRig.h"
+#include "depthCamManager.h"
+#include "depthRecording.h"
+#include "syntheticSource.h"
+#include "voxelGrid.h"
+#include "tracker.h"
+#include "trackerConfig.h"
+#include "trackingParams.h"
+
+const char* replay_path = nullptr;  // Benchmark on this recording instead of synthetic frames
+int iterations = BENCH_ITERATIONS;
+tracking_params params;             // The default settings, apart from the overrides set in main
+
+/**
+ * Describes what a benchmark case measured. Fields that do not apply are negative.
+ */
+struct bench_case
+{
+    const char* stage;
+    float scale;
+    int k;
+    int cameras;
+    double points;          // Points processed per frame
+    const char* config;     // The tracker configuration (see trackerConfig.h), or nullptr
+};
+
+/**
+ * Parses the user input. Handles errors such as incorrect argument count, etc.
+ */
+void parse_input(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--replay") == 0 && i+1 < argc)
+        {
+            replay_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--iterations") == 0 && i+1 < argc)
+        {
+            iterations = std::max(1, atoi(argv[++i]));
+        }
+        else
+        {
+            printf("Correct Usage: %s [--replay file] [--iterations n]\n", argv[0]);
+            exit(0);
+        }
+    }
+}
+
+/**
+ * Creates a new source of frames for a benchmark.
+ *
+ * @return  the source or nullptr if the recording could not be opened
+ */
+depth_source* make_source(void)
+{
+    if (replay_path)
+    {
+        // Replay as fast as possible and start over at the end
+        recording_source* recording = new recording_source(false, true);
+
+        if (!recording->open(replay_path))
+        {
+            delete recording;
+            return nullptr;
+        }
+
+        return recording;
+    }
+
+    return new synthetic_source();
+}
+
+/**
+ * Prints the results of a benchmark case as a JSON line.
+ *
+ * @param   c       the case that was measured
+ * @param   ns      the duration of every iteration (nanoseconds). Sorted in place.
+ */
+void report(const bench_case& c, std::vector<double>& ns)
+{
+    std::sort(ns.begin(), ns.end());
+
+    double mean = 0;
+
+    for (size_t i = 0; i < ns.size(); i++)
+    {
+        mean += ns[i];
+    }
+
+    mean /= ns.size();
+
+    auto percentile = [&ns](double p)
+    {
+        return ns[std::min(ns.size()-1, (size_t)(p*ns.size()))];
+    };
+
+    char scale[32], k[32], config[32];
+    snprintf(scale, sizeof(scale), c.scale > 0 ? "%g" : "null", c.scale);
+    snprintf(k, sizeof(k), c.k > 0 ? "%d" : "null", c.k);
+    snprintf(config, sizeof(config), c.config ? "\"%s\"" : "null", c.config);
+
+    printf("{\"stage\":\"%s\",\"source\":\"%s\",\"scale\":%s,\"k\":%s,\"config\":%s,\"cameras\":%d,\"points\":%.0f,\"iterations\":%d,"
+           "\"ns_per_frame\":%.0f,\"points_per_s\":%.4g,\"p50_ns\":%.0f,\"p90_ns\":%.0f,\"p99_ns\":%.0f,\"max_ns\":%.0f}\n",
+           c.stage, replay_path ? "recording" : "synthetic", scale, k, config, c.cameras, c.points, (int)ns.size(),
+           mean, c.points/(mean*1e-9), percentile(0.5), percentile(0.9), percentile(0.99), ns.back());
+    fflush(stdout);
+}
+
+/**
+ * Times a stage. setup runs untimed before every iteration to put the stage
+ * input back into place, then body is timed.
+ *
+ * @param   c       the case being measured. points may be updated by setup.
+ * @param   setup   prepares the input of iteration i
+ * @param   body    the stage to time
+ */
+template<class S, class B>
+void measure(bench_case& c, S setup, B body)
+{
+    std::vector<double> ns;
+    ns.reserve(iterations);
+
+    double total_points = 0;
+
+    for (int i = -BENCH_WARMUP; i < iterations; i++)
+    {
+        double points = setup(i < 0 ? 0 : i);
+
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+
+        if (i >= 0)
+        {
+            ns.push_back(std::chrono::duration<double, std::nano>(end-start).count());
+            total_points += points;
+        }
+    }
+
+    c.points = total_points/iterations;
+    report(c, ns);
+}
+
+/**
+ * Captures distinct frames from a fresh source at the given scale.
+ *
+ * @return  false if no frames could be captured
+ */
+bool capture_pool(depth_cam& cam, std::vector<depth_frame>& pool)
+{
+    depth_source* source = make_source();
+
+    if (!source || !cam.depth_cam_init(source))
+    {
+        return false;
+    }
+
+    cam.start_stream();
+    pool.resize(BENCH_FRAME_POOL);
+
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        if (!cam.capture_next_frame(pool[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Benchmarks the stages that work on depth images for one scale factor.
+ */
+bool bench_image_stages(float scale)
+{
+    depth_cam cam(scale);
+    std::vector<depth_frame> pool;
+
+    if (!capture_pool(cam, pool))
+    {
+        return false;
+    }
+
+    // Prepare segmented frames once for the stages downstream of the filter
+    std::vector<depth_frame> filtered(pool.size());
+
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        filtered[i] = pool[i];
+        filtered[i].depth = pool[i].depth.clone();
+        cam.filter_background(filtered[i], params.prefilter_depth_max_dist, params.prefilter_manhattan_dist);
+    }
+
+    depth_frame work = pool[0];
+    work.depth = pool[0].depth.clone();
+    pointCloud cloud;
+    voxel_grid voxels(params.voxel_leaf_size > 0 ? params.voxel_leaf_size : 1);
+    bench_case c = {"", scale, -1, 1, 0, nullptr};
+
+    c.stage = "filter_background";
+    measure(c, [&](int i) {
+        pool[i % pool.size()].depth.copyTo(work.depth);
+        return (double)work.depth.rows*work.depth.cols;
+    }, [&]() {
+        cam.filter_background(work, params.prefilter_depth_max_dist, params.prefilter_manhattan_dist);
+    });
+
+    // Learn the background from the pool, so only the foreground is left to segment
+    cam.learn_background((int)pool.size(), params.background_min_gap, params.background_sigma);
+
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        pool[i].depth.copyTo(work.depth);
+        cam.filter_background(work, params.prefilter_depth_max_dist, params.prefilter_manhattan_dist);
+    }
+
+    c.stage = "filter_background_learned";
+    measure(c, [&](int i) {
+        pool[i % pool.size()].depth.copyTo(work.depth);
+        return (double)work.depth.rows*work.depth.cols;
+    }, [&]() {
+        cam.filter_background(work, params.prefilter_depth_max_dist, params.prefilter_manhattan_dist);
+    });
+
+    cam.learn_background(0, 0, 0);
+
+    c.stage = "to_depth_frame";
+    measure(c, [&](int i) {
+        work = filtered[i % filtered.size()];
+        return (double)work.depth.rows*work.depth.cols;
+    }, [&]() {
+        cam.to_depth_frame(work, cloud, false);
+    });
+
+    auto build_cloud = [&](int i) {
+        cam.to_depth_frame(filtered[i % filtered.size()], cloud, false);
+        return (double)cloud.cloud_array.rows;
+    };
+
+    c.stage = "voxel_downsample";
+    measure(c, build_cloud, [&]() {
+        cloud.voxel_downsample(voxels);
+    });
+
+    c.stage = "transform_cloud";
+    measure(c, build_cloud, [&]() {
+        cloud.transform_cloud();
+    });
+
+    c.stage = "get_transform_from_cloud";
+    measure(c, build_cloud, [&]() {
+        cloud.get_transform_from_cloud();
+    });
+
+    return true;
+}
+
+/**
+ * Benchmarks the tracking stages on the given clouds with one tracker configuration.
+ *
+ * @param   k           the number of clusters
+ * @param   clouds      the clouds to cycle through
+ * @param   config_name the name of the configuration in the results
+ */
+template<class Config>
+void bench_tracker(int k, std::vector<pointCloud>& clouds, const char* config_name)
+{
+    basic_tracker<Config> trk(k);
+    basic_arm<Config> left_arm(trk, cv::Mat(1, 3, CV_32FC1, params.left_arm_start_pos),
+                               params.hand_max_dist_to_start, params.shoulder_dxdz_threshold);
+    basic_arm<Config> right_arm(trk, cv::Mat(1, 3, CV_32FC1, params.right_arm_start_pos),
+                                params.hand_max_dist_to_start, params.shoulder_dxdz_threshold);
+
+    bench_case c = {"", BENCH_TRACKING_SCALE, k, 1, 0, config_name};
+
+    auto load_cloud = [&](int i) {
+        trk.update_point_cloud(clouds[i % clouds.size()]);
+        return (double)trk.source_cloud.rows;
+    };
+
+    auto load_clusters = [&](int i) {
+        double points = load_cloud(i);
+        trk.cluster(params.kmeans_attempts, params.kmeans_iterations, params.kmeans_epsilon);
+        return points;
+    };
+
+    c.stage = "cluster";
+    measure(c, load_cloud, [&]() {
+        trk.cluster(params.kmeans_attempts, params.kmeans_iterations, params.kmeans_epsilon);
+    });
+
+    c.stage = "connect_means";
+    measure(c, load_clusters, [&]() {
+        trk.connect_means(params.kmeans_connect_threshold);
+    });
+
+    c.stage = "update_joints";
+    measure(c, [&](int i) {
+        double points = load_clusters(i);
+        trk.connect_means(params.kmeans_connect_threshold);
+        return points;
+    }, [&]() {
+        left_arm.update_joints(params.joint_smoothing);
+        right_arm.update_joints(params.joint_smoothing);
+    });
+}
+
+/**
+ * Compares the superpixels on the segmented frames against k-means and the mesh
+ * on the full clouds deprojected from them, the two ways of clustering a frame.
+ *
+ * @param   k       the number of clusters
+ * @param   frames  the segmented frames
+ * @param   clouds  the clouds of the frames
+ */
+void bench_clustering_engines(int k, std::vector<depth_frame>& frames, std::vector<pointCloud>& clouds)
+{
+    basic_tracker<runtime_tracker_config> trk(k);
+    bench_case c = {"", BENCH_TRACKING_SCALE, k, 1, 0, "runtime"};
+    std::vector<depth_frame> views(1);
+
+    c.stage = "superpixels";
+    measure(c, [&](int i) {
+        views[0] = frames[i % frames.size()];
+        return (double)clouds[i % clouds.size()].cloud_array.rows;
+    }, [&]() {
+        trk.cluster_superpixels(views, params.superpixel_iterations, params.superpixel_compactness,
+                                params.prefilter_depth_max_dist);
+    });
+
+    c.stage = "kmeans_connect_means";
+    measure(c, [&](int i) {
+        trk.update_point_cloud(clouds[i % clouds.size()]);
+        return (double)trk.source_cloud.rows;
+    }, [&]() {
+        trk.cluster(params.kmeans_attempts, params.kmeans_iterations, params.kmeans_epsilon);
+        trk.connect_means(params.kmeans_connect_threshold);
+    });
+}
+
+/**
+ * Benchmarks the tracking stages for every k and cloud size, with the runtime
+ * configuration and, for its k, the compiled one.
+ */
+bool bench_tracking_stages(void)
+{
+    depth_cam cam(BENCH_TRACKING_SCALE);
+    std::vector<depth_frame> pool;
+
+    if (!capture_pool(cam, pool))
+    {
+        return false;
+    }
+
+    // The full clouds of the user that the benchmark clouds are sampled from
+    std::vector<pointCloud> full(pool.size());
+
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        cam.filter_background(pool[i], params.prefilter_depth_max_dist, params.prefilter_manhattan_dist);
+        cam.to_depth_frame(pool[i], full[i], false);
+    }
+
+    const int ks[] = BENCH_KS;
+    const int sizes[] = BENCH_CLOUD_SIZES;
+
+    for (int k : ks)
+    {
+        for (int size : sizes)
+        {
+            // Evenly sample each cloud down to the requested size
+            std::vector<pointCloud> clouds(full.size());
+
+            for (size_t i = 0; i < full.size(); i++)
+            {
+                int n_full = full[i].cloud_array.rows;
+                int n = std::min(size, n_full);
+                float* dst = clouds[i].point_buffer(n);
+
+                for (int p = 0; p < n; p++)
+                {
+                    memcpy(dst+3*p, full[i].cloud_array.ptr<float>((int)((long long)p*n_full/n)), 3*sizeof(float));
+                }
+
+                clouds[i].set_size(n);
+            }
+
+            bench_tracker<runtime_tracker_config>(k, clouds, "runtime");
+
+            // Compare against the tracker unrolled for its k
+            if (k == compiled_tracker_config::k)
+            {
+                bench_tracker<compiled_tracker_config>(k, clouds, "compiled");
+            }
+        }
+
+        bench_clustering_engines(k, pool, full);
+    }
+
+    return true;
+}
+
+/**
+ * Benchmarks capturing, segmenting and merging the clouds of several cameras. Every
+ * camera gets its own source, so the views differ only by the noise of the source.
+ */
+bool bench_rig_stages(int n_cameras)
+{
+    camera_rig rig(BENCH_RIG_SCALE, RIG_SYNC_TOLERANCE_MS);
+
+    for (int i = 0; i < n_cameras; i++)
+    {
+        depth_source* source = make_source();
+
+        if (!source)
+        {
+            return false;
+        }
+
+        rig.add_camera(source);
+    }
+
+    rig.start_stream();
+
+    std::vector<std::vector<depth_frame> > pool(BENCH_FRAME_POOL);
+    bench_case c = {"", BENCH_RIG_SCALE, -1, n_cameras, 0, nullptr};
+
+    c.stage = "rig_capture";
+    measure(c, [&](int) {
+        return 0.0;
+    }, [&]() {
+        rig.capture(pool[0]);
+    });
+
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        if (!rig.capture(pool[i]))
+        {
+            return false;
+        }
+    }
+
+    // Prepare segmented views once for the merge
+    std::vector<std::vector<depth_frame> > filtered(pool.size());
+
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        filtered[i] = pool[i];
+
+        for (int j = 0; j < n_cameras; j++)
+        {
+            filtered[i][j].depth = pool[i][j].depth.clone();
+        }
+
+        rig.filter_background(filtered[i], params.prefilter_depth_max_dist, params.prefilter_manhattan_dist);
+    }
+
+    std::vector<depth_frame> work = pool[0];
+    pointCloud cloud;
+
+    for (int j = 0; j < n_cameras; j++)
+    {
+        work[j].depth = pool[0][j].depth.clone();
+    }
+
+    c.stage = "rig_filter_background";
+    measure(c, [&](int i) {
+        double pixels = 0;
+
+        for (int j = 0; j < n_cameras; j++)
+        {
+            pool[i % pool.size()][j].depth.copyTo(work[j].depth);
+            pixels += work[j].depth.rows*work[j].depth.cols;
+        }
+
+        return pixels;
+    }, [&]() {
+        rig.filter_background(work, params.prefilter_depth_max_dist, params.prefilter_manhattan_dist);
+    });
+
+    std::vector<depth_frame>* views = &filtered[0];
+
+    c.stage = "rig_to_cloud";
+    measure(c, [&](int i) {
+        double pixels = 0;
+        views = &filtered[i % filtered.size()];
+
+        for (int j = 0; j < n_cameras; j++)
+        {
+            pixels += (*views)[j].depth.rows*(*views)[j].depth.cols;
+        }
+
+        return pixels;
+    }, [&]() {
+        rig.to_cloud(*views, cloud);
+    });
+
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    parse_input(argc, argv);
+
+    float left_start[3] = BENCH_LEFT_ARM_START_POS;
+    float right_start[3] = BENCH_RIGHT_ARM_START_POS;
+    memcpy(params.left_arm_start_pos, left_start, sizeof(left_start));
+    memcpy(params.right_arm_start_pos, right_start, sizeof(right_start));
+    params.superpixel_iterations = BENCH_SUPERPIXEL_ITERATIONS;
+
+    const float scales[] = BENCH_SCALES;
+
+    for (float scale : scales)
+    {
+        if (!bench_image_stages(scale))
+        {
+            fprintf(stderr, "Unable to capture frames at scale %g\n", scale);
+            return 1;
+        }
+    }
+
+    if (!bench_tracking_stages())
+    {
+        fprintf(stderr, "Unable to capture frames for the tracking stages\n");
+        return 1;
+    }
+
+    const int rig_cameras[] = BENCH_RIG_CAMERAS;
+
+    for (int n_cameras : rig_cameras)
+    {
+        if (!bench_rig_stages(n_cameras))
+        {
+            fprintf(stderr, "Unable to capture frames from %d cameras\n", n_cameras);
+            return 1;
+        }
+    }
+
+    return 0;
+}
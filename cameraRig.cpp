@@ -0,0 +1,345 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in cameraRig.h.
+ */
+
+#define RIG_MAX_RESYNC 2                // Times the lagging views of one capture are read again
+#define RIG_CLOCK_OFFSET_LEAK_MS 0.002  // Lets the clock offset follow drift that makes it grow (per frame)
+
+#include "cameraRig.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+int camera_rig::add_camera(depth_source* source)
+{
+    depth_cam* cam = new depth_cam(scale_factor);
+    cam->depth_cam_init(source);
+    cams.push_back(cam);
+
+    clock_offset_ms.push_back(0);
+    has_offset.push_back(false);
+    pending.push_back(false);
+    captured.push_back(false);
+    host_time_ms.push_back(0);
+    point_offsets.push_back(0);
+    point_counts.push_back(0);
+
+    return (int)cams.size()-1;
+}
+
+int camera_rig::add_realsense_cameras(int max_cameras) try
+{
+    if (ctx == nullptr)
+    {
+        ctx = new rs::context();
+    }
+
+    // Are any realsense devices connected?
+    if (ctx->get_device_count() == 0)
+    {
+        throw std::runtime_error("No realsense devices are connected to the system at this time.");
+    }
+
+    int n_cameras = std::min(ctx->get_device_count(), max_cameras);
+
+    for (int i = 0; i < n_cameras; i++)
+    {
+        rs::device* dev = ctx->get_device(i);
+
+        // Configure the input stream
+        dev->enable_stream(rs::stream::depth, rs::preset::best_quality);
+        add_camera(new realsense_source(dev));
+    }
+
+    return n_cameras;
+}
+catch(const rs::error & e)
+{
+    // Method calls against librealsense objects may throw exceptions of type rs::error
+    printf("rs::error was thrown when calling %s(%s):\n", e.get_failed_function().c_str(), e.get_failed_args().c_str());
+    printf("    %s\n", e.what());
+
+    return 0;
+}
+catch(const std::runtime_error & e)
+{
+    printf("%s\n", e.what());
+
+    return 0;
+}
+
+void camera_rig::start_stream(void)
+{
+    int n_cameras = std::max(1, (int)cams.size());
+
+    if (capture_workers == nullptr)
+    {
+        capture_workers = new worker_pool(n_cameras);
+        build_workers = new worker_pool(n_cameras);
+    }
+
+    for (depth_cam* cam : cams)
+    {
+        cam->start_stream();
+    }
+}
+
+bool camera_rig::capture(std::vector<depth_frame>& views)
+{
+    if (cams.empty())
+    {
+        return false;
+    }
+
+    views.resize(cams.size());
+    std::fill(pending.begin(), pending.end(), true);
+
+    for (int round = 0; ; round++)
+    {
+        if (!read_pending(views))
+        {
+            return false;
+        }
+
+        double oldest = host_time_ms[0];
+        double newest = host_time_ms[0];
+
+        for (size_t i = 1; i < cams.size(); i++)
+        {
+            oldest = std::min(oldest, host_time_ms[i]);
+            newest = std::max(newest, host_time_ms[i]);
+        }
+
+        last_spread_ms = newest-oldest;
+
+        if (last_spread_ms <= sync_tolerance_ms || round == RIG_MAX_RESYNC)
+        {
+            return true;
+        }
+
+        // The lagging cameras most likely have a newer frame waiting
+        for (size_t i = 0; i < cams.size(); i++)
+        {
+            pending[i] = host_time_ms[i] < newest-sync_tolerance_ms;
+        }
+    }
+}
+
+bool camera_rig::read_pending(std::vector<depth_frame>& views)
+{
+    auto read_view = [&](int i) {
+        if (pending[i])
+        {
+            TRACE_SCOPE("capture_view");
+            captured[i] = cams[i]->capture_next_frame(views[i]);
+        }
+    };
+    capture_workers->run((int)cams.size(), read_view);
+
+    for (size_t i = 0; i < cams.size(); i++)
+    {
+        if (!pending[i])
+        {
+            continue;
+        }
+
+        if (!captured[i])
+        {
+            return false;
+        }
+
+        // The smallest difference is the one with the least transport delay
+        double offset = views[i].arrival_ns*1e-6 - views[i].timestamp;
+
+        if (!has_offset[i] || offset < clock_offset_ms[i]+RIG_CLOCK_OFFSET_LEAK_MS)
+        {
+            clock_offset_ms[i] = offset;
+            has_offset[i] = true;
+        }
+        else
+        {
+            clock_offset_ms[i] += RIG_CLOCK_OFFSET_LEAK_MS;
+        }
+
+        host_time_ms[i] = views[i].timestamp + clock_offset_ms[i];
+        pending[i] = false;
+    }
+
+    return true;
+}
+
+void camera_rig::filter_background(std::vector<depth_frame>& views, float maxDist, int manhattan)
+{
+    auto filter_view = [&](int i) {
+        cams[i]->filter_background(views[i], maxDist, manhattan);
+    };
+    build_workers->run((int)views.size(), filter_view);
+}
+
+void camera_rig::to_cloud(const std::vector<depth_frame>& views, pointCloud& out)
+{
+    if (views.empty())
+    {
+        out.set_size(0);
+        return;
+    }
+
+    // Give every view room for one point per pixel so they can be deprojected in parallel
+    int capacity = 0;
+
+    for (size_t i = 0; i < views.size(); i++)
+    {
+        point_offsets[i] = capacity;
+        capacity += views[i].depth.rows*views[i].depth.cols;
+    }
+
+    float* points = out.point_buffer(capacity);
+
+    auto deproject_view = [&](int i) {
+        point_counts[i] = cams[i]->deproject(views[i], points+3*point_offsets[i], true);
+    };
+    build_workers->run((int)views.size(), deproject_view);
+
+    // Close the gaps between the views
+    int n_points = point_counts[0];
+
+    for (size_t i = 1; i < views.size(); i++)
+    {
+        memmove(points+3*n_points, points+3*point_offsets[i], 3*sizeof(float)*point_counts[i]);
+        n_points += point_counts[i];
+    }
+
+    out.set_size(n_points);
+}
+
+void camera_rig::learn_background(int learn_frames, float min_gap, float n_sigma)
+{
+    for (depth_cam* cam : cams)
+    {
+        cam->learn_background(learn_frames, min_gap, n_sigma);
+    }
+}
+
+void camera_rig::update_roi(const float* points, int n_points, float margin)
+{
+    for (depth_cam* cam : cams)
+    {
+        cam->update_roi(points, n_points, margin);
+    }
+}
+
+void camera_rig::clear_roi(void)
+{
+    for (depth_cam* cam : cams)
+    {
+        cam->clear_roi();
+    }
+}
+
+void camera_rig::set_scale_factor(float scale_factor)
+{
+    camera_rig::scale_factor = scale_factor;
+
+    for (depth_cam* cam : cams)
+    {
+        cam->set_scale_factor(scale_factor);
+    }
+}
+
+void camera_rig::keep_full_depth(bool keep)
+{
+    for (depth_cam* cam : cams)
+    {
+        cam->keep_full_depth(keep);
+    }
+}
+
+void camera_rig::reserve(void)
+{
+    for (depth_cam* cam : cams)
+    {
+        cam->reserve();
+    }
+}
+
+int camera_rig::max_points(void)
+{
+    int total = 0;
+
+    for (depth_cam* cam : cams)
+    {
+        int n = cam->max_points();
+
+        if (n == 0)
+        {
+            return 0;
+        }
+
+        total += n;
+    }
+
+    return total;
+}
+
+bool camera_rig::scaled_frame_size(int& rows, int& cols)
+{
+    rows = 0;
+    cols = 0;
+
+    for (depth_cam* cam : cams)
+    {
+        int cam_rows, cam_cols;
+
+        if (!cam->scaled_frame_size(cam_rows, cam_cols))
+        {
+            return false;
+        }
+
+        rows += cam_rows;
+        cols += cam_cols;
+    }
+
+    return true;
+}
+
+int camera_rig::size(void) const
+{
+    return (int)cams.size();
+}
+
+depth_cam& camera_rig::camera(int i)
+{
+    return *cams[i];
+}
+
+double camera_rig::sync_spread_ms(void) const
+{
+    return last_spread_ms;
+}
+
+camera_rig::camera_rig(float scale_factor, double sync_tolerance_ms)
+{
+    camera_rig::scale_factor = scale_factor;
+    camera_rig::sync_tolerance_ms = sync_tolerance_ms;
+}
+
+camera_rig::~camera_rig(void)
+{
+    delete capture_workers;
+    delete build_workers;
+
+    // The realsense sources refer to devices owned by the context
+    for (depth_cam* cam : cams)
+    {
+        delete cam;
+    }
+
+    if (ctx != nullptr)
+    {
+        delete ctx;
+    }
+}
@@ -0,0 +1,177 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Combines several depth cameras into a single view of the user. Every
+ * camera keeps its own source, calibration and ray table (see depth_cam).
+ * The rig captures from all of them in parallel, lines their frames up in
+ * time and merges their calibrated clouds into one cloud for the tracker.
+ *
+ * Sensor timestamps come from each device's own clock, so they cannot be
+ * compared directly. The rig maps each camera's timestamps onto the host
+ * clock with an offset that tracks the smallest observed difference between
+ * arrival time and sensor time, which filters out the transport jitter.
+ * A camera whose frame lags the newest one by more than the tolerance is
+ * read again, so the merged frames never mix old and new views.
+ */
+
+#ifndef CAMERARIG_H
+#define CAMERARIG_H
+
+#include <librealsense/rs.hpp>
+#include <vector>
+#include "depthCamManager.h"
+#include "depthSource.h"
+#include "pointCloud.h"
+#include "workerPool.h"
+
+class camera_rig
+{
+    public:
+        /**
+         * Adds a camera that streams from the given source. The rig takes ownership
+         * of the source. Cameras must be added before the stream is started.
+         *
+         * @param   source      the source to pull frames from
+         * @return  the index of the camera
+         */
+        int add_camera(depth_source* source);
+
+        /**
+         * Adds up to max_cameras connected realsense devices, in the order the
+         * librealsense context lists them.
+         *
+         * @param   max_cameras the maximum number of devices to use
+         * @return  the number of cameras that were added
+         */
+        int add_realsense_cameras(int max_cameras);
+
+        /**
+         * Activates the streams of all cameras.
+         */
+        void start_stream(void);
+
+        /**
+         * Captures one frame from every camera in parallel. Cameras whose frame is
+         * older than the newest one by more than the tolerance are read again, up to
+         * a few times, so the frames line up in time.
+         *
+         * @param   views   the frames to fill, one per camera. Resized if needed.
+         * @return  false if any camera has no more frames
+         */
+        bool capture(std::vector<depth_frame>& views);
+
+        /**
+         * Removes the background from every view in parallel. See depth_cam::filter_background.
+         *
+         * @param   views   the frames of a capture() call, filtered in place
+         */
+        void filter_background(std::vector<depth_frame>& views, float maxDist, int manhattan);
+
+        /**
+         * Deprojects every view with the calibration of its camera, in parallel, and merges
+         * the points into the given cloud. The cloud storage is reused between frames.
+         *
+         * @param   views   the frames of a capture() call
+         * @param   out     the cloud to overwrite
+         */
+        void to_cloud(const std::vector<depth_frame>& views, pointCloud& out);
+
+        /**
+         * Learns the background of every camera. See depth_cam::learn_background.
+         */
+        void learn_background(int learn_frames, float min_gap, float n_sigma);
+
+        /**
+         * Restricts the frames of every camera to a window around the given points.
+         * See depth_cam::update_roi.
+         */
+        void update_roi(const float* points, int n_points, float margin);
+
+        /**
+         * Processes the whole frames of every camera again. See depth_cam::clear_roi.
+         */
+        void clear_roi(void);
+
+        /**
+         * Scales the frames of every camera by the given factor from the next capture on.
+         * See depth_cam::set_scale_factor.
+         */
+        void set_scale_factor(float scale_factor);
+
+        /**
+         * Keeps the unscaled depth images of every camera. See depth_cam::keep_full_depth.
+         */
+        void keep_full_depth(bool keep);
+
+        /**
+         * Sizes the per-frame buffers of every camera for its frames. See depth_cam::reserve.
+         */
+        void reserve(void);
+
+        /**
+         * @return  the largest number of points a merged cloud can hold, or 0 if any
+         *          camera cannot tell its frame size in advance
+         */
+        int max_points(void);
+
+        /**
+         * Adds up the scaled frame sizes of every camera. See depth_cam::scaled_frame_size.
+         *
+         * @param   rows    set to the rows of all of the scaled frames together
+         * @param   cols    set to the columns of all of the scaled frames together
+         * @return  false if any camera cannot tell its frame size in advance
+         */
+        bool scaled_frame_size(int& rows, int& cols);
+
+        /**
+         * @return  the number of cameras
+         */
+        int size(void) const;
+
+        /**
+         * @param   i   the index of the camera
+         * @return  the camera. Its cloud holds the calibration of the camera.
+         */
+        depth_cam& camera(int i);
+
+        /**
+         * @return  the time between the oldest and the newest view of the last capture (milliseconds)
+         */
+        double sync_spread_ms(void) const;
+
+        /**
+         * @param   scale_factor        the scale factor of every camera
+         * @param   sync_tolerance_ms   the largest time between views of one capture that is accepted
+         *                              without reading the older views again
+         */
+        camera_rig(float scale_factor, double sync_tolerance_ms);
+
+        ~camera_rig(void);
+
+    private:
+        float scale_factor;
+        double sync_tolerance_ms;
+        double last_spread_ms = 0;
+        rs::context* ctx = nullptr;             // Shared by all realsense cameras
+        std::vector<depth_cam*> cams;
+
+        worker_pool* capture_workers = nullptr; // One thread per camera, since reading a frame blocks
+        worker_pool* build_workers = nullptr;   // Separate, so building a cloud never waits on a capture
+
+        std::vector<double> clock_offset_ms;    // Host time minus sensor time, per camera
+        std::vector<char> has_offset;
+        std::vector<char> pending;              // Cameras to read in the current round
+        std::vector<char> captured;             // Whether the last read of each camera succeeded
+        std::vector<double> host_time_ms;       // The host time of each view of the current capture
+        std::vector<int> point_offsets;         // Where the points of each view start in the merged cloud
+        std::vector<int> point_counts;
+
+        /**
+         * Reads the pending cameras in parallel and maps their timestamps onto the host clock.
+         *
+         * @return  false if any of them has no more frames
+         */
+        bool read_pending(std::vector<depth_frame>& views);
+};
+
+#endif
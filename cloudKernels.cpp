@@ -0,0 +1,225 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in cloudKernels.h.
+ */
+
+#include "cloudKernels.h"
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+// Builds {a[i0], a[i1], b[i2], b[i3]}
+#define SHUFFLE4(a, b, i0, i1, i2, i3) _mm_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0))
+#endif
+
+int deproject_row(const uint16_t* depth, const float* ray_x, const float* ray_y, const float* ray_z,
+                  int n, float scale, const float offset[3], float* out)
+{
+    int n_out = 0;
+    int j = 0;
+
+#ifdef __SSE2__
+    const __m128 scale_v = _mm_set1_ps(scale);
+    const __m128 off_x = _mm_set1_ps(offset[0]);
+    const __m128 off_y = _mm_set1_ps(offset[1]);
+    const __m128 off_z = _mm_set1_ps(offset[2]);
+    const __m128i zero_v = _mm_setzero_si128();
+
+    // Four pixels at a time. Background pixels are zero after filtering, so
+    // all-zero groups are skipped without touching the ray table.
+    for (; j+4 <= n; j += 4)
+    {
+        __m128i d16 = _mm_loadl_epi64((const __m128i*)(depth+j));
+        __m128i d32 = _mm_unpacklo_epi16(d16, zero_v);
+        int empty = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(d32, zero_v)));
+
+        if (empty == 0xF)
+        {
+            continue;
+        }
+
+        __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(d32), scale_v);
+        __m128 x = _mm_add_ps(_mm_mul_ps(d, _mm_loadu_ps(ray_x+j)), off_x);
+        __m128 y = _mm_add_ps(_mm_mul_ps(d, _mm_loadu_ps(ray_y+j)), off_y);
+        __m128 z = _mm_add_ps(_mm_mul_ps(d, _mm_loadu_ps(ray_z+j)), off_z);
+
+        float xs[4], ys[4], zs[4];
+        _mm_storeu_ps(xs, x);
+        _mm_storeu_ps(ys, y);
+        _mm_storeu_ps(zs, z);
+
+        for (int k = 0; k < 4; k++)
+        {
+            if (!(empty & (1 << k)))
+            {
+                float* p = out+3*n_out++;
+                p[0] = xs[k];
+                p[1] = ys[k];
+                p[2] = zs[k];
+            }
+        }
+    }
+#endif
+
+    for (; j < n; j++)
+    {
+        if (depth[j] != 0)
+        {
+            float d = depth[j]*scale;
+            float* p = out+3*n_out++;
+            p[0] = d*ray_x[j] + offset[0];
+            p[1] = d*ray_y[j] + offset[1];
+            p[2] = d*ray_z[j] + offset[2];
+        }
+    }
+
+    return n_out;
+}
+
+int mask_foreground_row(uint16_t* depth, const uint16_t* limit, int n)
+{
+    int n_kept = 0;
+    int j = 0;
+
+#ifdef __SSE2__
+    // SSE2 only compares signed words, so flip the sign bits to compare unsigned
+    const __m128i sign_v = _mm_set1_epi16((short)0x8000);
+    const __m128i zero_v = _mm_setzero_si128();
+
+    for (; j+8 <= n; j += 8)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i*)(depth+j));
+        __m128i l = _mm_loadu_si128((const __m128i*)(limit+j));
+        __m128i keep = _mm_cmplt_epi16(_mm_xor_si128(d, sign_v), _mm_xor_si128(l, sign_v));
+        d = _mm_and_si128(d, keep);
+        _mm_storeu_si128((__m128i*)(depth+j), d);
+
+        // Two mask bits per zero pixel
+        n_kept += 8 - __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi16(d, zero_v)))/2;
+    }
+#endif
+
+    for (; j < n; j++)
+    {
+        depth[j] = (depth[j] < limit[j]) ? depth[j] : 0;
+        n_kept += depth[j] != 0;
+    }
+
+    return n_kept;
+}
+
+void transform_points(float* points, int n, const float rotation[9], const float translation[3])
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128 r00 = _mm_set1_ps(rotation[0]), r01 = _mm_set1_ps(rotation[1]), r02 = _mm_set1_ps(rotation[2]);
+    const __m128 r10 = _mm_set1_ps(rotation[3]), r11 = _mm_set1_ps(rotation[4]), r12 = _mm_set1_ps(rotation[5]);
+    const __m128 r20 = _mm_set1_ps(rotation[6]), r21 = _mm_set1_ps(rotation[7]), r22 = _mm_set1_ps(rotation[8]);
+    const __m128 t0 = _mm_set1_ps(translation[0]);
+    const __m128 t1 = _mm_set1_ps(translation[1]);
+    const __m128 t2 = _mm_set1_ps(translation[2]);
+
+    // Four points (12 floats) at a time
+    for (; i+4 <= n; i += 4)
+    {
+        float* p = points+3*i;
+
+        // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+        __m128 a = _mm_loadu_ps(p);
+        __m128 b = _mm_loadu_ps(p+4);
+        __m128 c = _mm_loadu_ps(p+8);
+
+        // Deinterleave into one register per coordinate
+        __m128 x = SHUFFLE4(a, SHUFFLE4(b, c, 2, 2, 1, 1), 0, 3, 0, 2);
+        __m128 y = SHUFFLE4(SHUFFLE4(a, b, 1, 1, 0, 0), SHUFFLE4(b, c, 3, 3, 2, 2), 0, 2, 0, 2);
+        __m128 z = SHUFFLE4(SHUFFLE4(a, b, 2, 2, 1, 1), SHUFFLE4(c, c, 0, 0, 3, 3), 0, 2, 0, 2);
+
+        __m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, r00), _mm_mul_ps(y, r10)), _mm_add_ps(_mm_mul_ps(z, r20), t0));
+        __m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, r01), _mm_mul_ps(y, r11)), _mm_add_ps(_mm_mul_ps(z, r21), t1));
+        __m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, r02), _mm_mul_ps(y, r12)), _mm_add_ps(_mm_mul_ps(z, r22), t2));
+
+        // Interleave again
+        _mm_storeu_ps(p,   SHUFFLE4(SHUFFLE4(tx, ty, 0, 0, 0, 0), SHUFFLE4(tz, tx, 0, 0, 1, 1), 0, 2, 0, 2));
+        _mm_storeu_ps(p+4, SHUFFLE4(SHUFFLE4(ty, tz, 1, 1, 1, 1), SHUFFLE4(tx, ty, 2, 2, 2, 2), 0, 2, 0, 2));
+        _mm_storeu_ps(p+8, SHUFFLE4(SHUFFLE4(tz, tx, 2, 2, 3, 3), SHUFFLE4(ty, tz, 3, 3, 3, 3), 0, 2, 0, 2));
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        float* p = points+3*i;
+        float x = p[0], y = p[1], z = p[2];
+
+        p[0] = x*rotation[0] + y*rotation[3] + z*rotation[6] + translation[0];
+        p[1] = x*rotation[1] + y*rotation[4] + z*rotation[7] + translation[1];
+        p[2] = x*rotation[2] + y*rotation[5] + z*rotation[8] + translation[2];
+    }
+}
+
+void point_center_distances(const float* points, int n, const float* cx, const float* cy, const float* cz,
+                            int k_padded, float* out)
+{
+    for (int i = 0; i < n; i++)
+    {
+        const float* p = points+3*i;
+        float* d = out+i*k_padded;
+        int c = 0;
+
+#ifdef __SSE2__
+        const __m128 px = _mm_set1_ps(p[0]);
+        const __m128 py = _mm_set1_ps(p[1]);
+        const __m128 pz = _mm_set1_ps(p[2]);
+
+        for (; c < k_padded; c += 4)
+        {
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(cx+c), px);
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(cy+c), py);
+            __m128 dz = _mm_sub_ps(_mm_loadu_ps(cz+c), pz);
+            __m128 d_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            _mm_storeu_ps(d+c, _mm_sqrt_ps(d_sq));
+        }
+#endif
+
+        for (; c < k_padded; c++)
+        {
+            float dx = cx[c]-p[0], dy = cy[c]-p[1], dz = cz[c]-p[2];
+            d[c] = sqrtf(dx*dx + dy*dy + dz*dz);
+        }
+    }
+}
+
+void accumulate_moments(const float* points, int n, const double origin[3], const double* plane,
+                        double max_residual, double sums[10])
+{
+    double s[10] = {0};
+
+    for (int i = 0; i < n; i++)
+    {
+        const float* p = points+3*i;
+        double x = p[0]-origin[0], y = p[1]-origin[1], z = p[2]-origin[2];
+
+        if (plane && fabs(z - (plane[0] + plane[1]*x + plane[2]*y)) > max_residual)
+        {
+            continue;
+        }
+
+        s[0] += 1;
+        s[1] += x;
+        s[2] += y;
+        s[3] += z;
+        s[4] += x*x;
+        s[5] += x*y;
+        s[6] += x*z;
+        s[7] += y*y;
+        s[8] += y*z;
+        s[9] += z*z;
+    }
+
+    for (int i = 0; i < 10; i++)
+    {
+        sums[i] += s[i];
+    }
+}
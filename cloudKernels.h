@@ -0,0 +1,88 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Tight loops that convert and transform point data without going through
+ * cv::Mat. Points are stored as interleaved x,y,z floats, matching the
+ * layout of pointCloud::cloud_array. SSE is used when it is available and
+ * a scalar fallback is provided otherwise.
+ */
+
+#ifndef CLOUDKERNELS_H
+#define CLOUDKERNELS_H
+
+#include <stdint.h>
+
+/**
+ * Deprojects a row of depth pixels along precomputed rays. Each non-zero
+ * depth d produces the point d*scale*(ray_x, ray_y, ray_z) + offset. Zero
+ * depths are skipped, so the output is compacted. A rigid transform can be
+ * folded into the rays and offset so transformed points come out directly.
+ *
+ * @param   depth   the raw depth values
+ * @param   ray_x   the x component of the ray through each pixel at unit depth
+ * @param   ray_y   the y component of the ray through each pixel at unit depth
+ * @param   ray_z   the z component of the ray through each pixel at unit depth
+ * @param   n       the number of pixels in the row
+ * @param   scale   meters per depth unit
+ * @param   offset  the translation added to every point (x,y,z)
+ * @param   out     the output points. Must have room for n points.
+ * @return  the number of points written
+ */
+int deproject_row(const uint16_t* depth, const float* ray_x, const float* ray_y, const float* ray_z,
+                  int n, float scale, const float offset[3], float* out);
+
+/**
+ * Keeps the depth pixels that are nearer than a per-pixel limit and zeroes
+ * the rest: depth[j] = depth[j] < limit[j] ? depth[j] : 0. This is the
+ * foreground mask of a background model (see backgroundModel.h).
+ *
+ * @param   depth   the depth values, masked in place
+ * @param   limit   the first depth of each pixel that counts as background
+ * @param   n       the number of pixels in the row
+ * @return  the number of non-zero pixels kept
+ */
+int mask_foreground_row(uint16_t* depth, const uint16_t* limit, int n);
+
+/**
+ * Applies a rigid transform to interleaved points in place:
+ * point = point*rotation + translation, with points as row vectors.
+ *
+ * @param   points      the points to transform (x,y,z interleaved)
+ * @param   n           the number of points
+ * @param   rotation    the 3x3 rotation, row-major
+ * @param   translation the translation (x,y,z)
+ */
+void transform_points(float* points, int n, const float rotation[9], const float translation[3]);
+
+/**
+ * Computes the euclidean distance from each point to each center. Centers are
+ * given as structure-of-arrays, padded to a multiple of four.
+ *
+ * @param   points      the points (x,y,z interleaved)
+ * @param   n           the number of points
+ * @param   cx          the x coordinates of the centers
+ * @param   cy          the y coordinates of the centers
+ * @param   cz          the z coordinates of the centers
+ * @param   k_padded    the number of centers including padding. Must be a multiple of four.
+ * @param   out         the distances, n rows of k_padded values
+ */
+void point_center_distances(const float* points, int n, const float* cx, const float* cy, const float* cz,
+                            int k_padded, float* out);
+
+/**
+ * Adds the points to running first and second moments, in one pass. Points are
+ * taken relative to origin so the sums keep their precision far from the camera.
+ * If a plane z = c + a*x + b*y (relative to origin) is given, points further than
+ * max_residual from it along z are left out.
+ *
+ * @param   points          the points (x,y,z interleaved)
+ * @param   n               the number of points
+ * @param   origin          the point the moments are taken about
+ * @param   plane           the plane as {c, a, b}, or nullptr to keep every point
+ * @param   max_residual    the largest plane residual of a point that is kept
+ * @param   sums            the moments to add to: {n, x, y, z, xx, xy, xz, yy, yz, zz}
+ */
+void accumulate_moments(const float* points, int n, const double origin[3], const double* plane,
+                        double max_residual, double sums[10]);
+
+#endif
@@ -0,0 +1,223 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in componentLabeler.h.
+ */
+
+#include "componentLabeler.h"
+#include "trackerConfig.h"
+#include <algorithm>
+#include <cstdlib>
+
+int component_labeler::keep_largest(cv::Mat& image, int max_depth_step, int manhattan)
+{
+    // The compiled radius gets its own instantiation so the neighborhood loops unroll
+    if (manhattan == compiled_tracker_config::manhattan)
+    {
+        return keep_largest_radius<compiled_tracker_config::manhattan>(image, max_depth_step, manhattan);
+    }
+
+    return keep_largest_radius<0>(image, max_depth_step, manhattan);
+}
+
+template<int MANHATTAN>
+int component_labeler::keep_largest_radius(cv::Mat& image, int max_depth_step, int manhattan)
+{
+    manhattan = MANHATTAN > 0 ? MANHATTAN : manhattan;
+
+    int n_pixels = image.rows*image.cols;
+
+    if (n_pixels == 0)
+    {
+        return 0;
+    }
+
+    reserve(n_pixels);
+
+    // Split the image into bands of rows that can be labelled independently
+    int n_bands = workers ? workers->size() : 1;
+    n_bands = std::max(1, std::min(n_bands, image.rows/std::max(min_band_rows, manhattan)));
+    int band_rows = (image.rows+n_bands-1)/n_bands;
+
+    auto label_band = [&](int band)
+    {
+        int row_start = band*band_rows;
+        int row_end = std::min(row_start+band_rows, image.rows);
+        label_rows<MANHATTAN>(image, row_start, row_end, row_start, max_depth_step, manhattan, true);
+    };
+
+    if (workers)
+    {
+        workers->run(n_bands, label_band);
+    }
+    else
+    {
+        label_band(0);
+    }
+
+    // Join groups across the seams. Only the first rows of each band can reach into the band above
+    for (int band = 1; band < n_bands; band++)
+    {
+        int row_start = band*band_rows;
+        int row_end = std::min(row_start+manhattan, image.rows);
+        label_rows<MANHATTAN>(image, row_start, row_end, 0, max_depth_step, manhattan, false);
+    }
+
+    // Flatten the forest and measure each group in a single forward pass. Roots always
+    // have the lowest index in their group, so a parent is already flattened when its
+    // children are visited.
+    int32_t* par = parent.data();
+    int32_t* ar = area.data();
+    int32_t largest = -1;
+    int largest_area = 0;
+
+    for (int32_t i = 0; i < n_pixels; i++)
+    {
+        int32_t root = par[i];
+
+        if (root < 0)
+        {
+            continue;
+        }
+
+        if (root == i)
+        {
+            ar[i] = 0;
+        }
+        else
+        {
+            root = par[root];
+            par[i] = root;
+        }
+
+        ar[root]++;
+
+        // Ties go to the group found first in scan order
+        if (ar[root] > largest_area || (ar[root] == largest_area && root < largest))
+        {
+            largest_area = ar[root];
+            largest = root;
+        }
+    }
+
+    // Remove everything outside the largest group
+    for (int i = 0; i < image.rows; ++i)
+    {
+        uint16_t* p = image.ptr<uint16_t>(i);
+        const int32_t* p_par = par + i*image.cols;
+
+        for (int j = 0; j < image.cols; ++j)
+        {
+            p[j] = (p_par[j] == largest) ? p[j] : 0;
+        }
+    }
+
+    return largest_area;
+}
+
+void component_labeler::reserve(int max_pixels)
+{
+    if ((int)parent.size() < max_pixels)
+    {
+        parent.resize(max_pixels);
+        area.resize(max_pixels);
+    }
+}
+
+int32_t component_labeler::find_root(int32_t ind)
+{
+    int32_t* par = parent.data();
+
+    while (par[ind] != ind)
+    {
+        par[ind] = par[par[ind]];
+        ind = par[ind];
+    }
+
+    return ind;
+}
+
+int32_t component_labeler::join_roots(int32_t a, int32_t b)
+{
+    if (a < b)
+    {
+        parent[b] = a;
+        return a;
+    }
+    else
+    {
+        parent[a] = b;
+        return b;
+    }
+}
+
+template<int MANHATTAN>
+void component_labeler::label_rows(const cv::Mat& image, int row_start, int row_end, int row_min,
+                                   int max_depth_step, int manhattan, bool init)
+{
+    // A constant when the radius is compiled in
+    manhattan = MANHATTAN > 0 ? MANHATTAN : manhattan;
+
+    int32_t* par = parent.data();
+
+    for (int y = row_start; y < row_end; y++)
+    {
+        const uint16_t* p = image.ptr<uint16_t>(y);
+        int32_t row_base = y*image.cols;
+
+        for (int x = 0; x < image.cols; x++)
+        {
+            int32_t ind = row_base+x;
+            int depth = p[x];
+
+            if (init)
+            {
+                par[ind] = (depth != 0) ? ind : -1;
+            }
+
+            if (depth == 0)
+            {
+                continue;
+            }
+
+            // Track the root of the current pixel so each neighbor costs a single lookup
+            int32_t root = init ? ind : find_root(ind);
+
+            // Pixels to the left on the same row. Seams only look at the rows above.
+            if (init)
+            {
+                for (int x_n = std::max(x-manhattan, 0); x_n < x; x_n++)
+                {
+                    if (p[x_n] != 0 && std::abs(depth-p[x_n]) <= max_depth_step)
+                    {
+                        root = join_roots(root, find_root(row_base+x_n));
+                    }
+                }
+            }
+
+            // Rows above, narrowing with the manhattan distance. When merging a seam,
+            // start above the band so groups inside it are not revisited.
+            int dy_start = init ? 1 : y-row_start+1;
+
+            for (int dy = dy_start; dy <= manhattan && y-dy >= row_min; dy++)
+            {
+                const uint16_t* p_n = image.ptr<uint16_t>(y-dy);
+                int32_t row_base_n = (y-dy)*image.cols;
+                int reach = manhattan-dy;
+
+                for (int x_n = std::max(x-reach, 0); x_n <= std::min(x+reach, image.cols-1); x_n++)
+                {
+                    if (p_n[x_n] != 0 && std::abs(depth-p_n[x_n]) <= max_depth_step)
+                    {
+                        root = join_roots(root, find_root(row_base_n+x_n));
+                    }
+                }
+            }
+        }
+    }
+}
+
+component_labeler::component_labeler(worker_pool* workers)
+{
+    component_labeler::workers = workers;
+}
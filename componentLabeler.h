@@ -0,0 +1,84 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Segments depth images into groups of connected pixels. Two non-zero pixels
+ * are connected when they lie within a manhattan neighborhood of each other
+ * and their depths differ by at most a threshold. Labelling uses a union-find
+ * forest over the pixel indices, so the whole image is processed in a single
+ * linear sweep. The image can be split into horizontal bands that are
+ * labelled in parallel and merged along their seams afterwards.
+ */
+
+#ifndef COMPONENTLABELER_H
+#define COMPONENTLABELER_H
+
+#include "opencv2/core/core.hpp"
+#include "workerPool.h"
+#include <vector>
+
+class component_labeler
+{
+    public:
+        /**
+         * Keeps the largest group of connected pixels in the image. All other
+         * pixels are zeroed.
+         *
+         * @param   image           the CV_16UC1 depth image to filter in place
+         * @param   max_depth_step  the maximum depth difference between connected pixels (depth units)
+         * @param   manhattan       the neighborhood to explore is within this manhattan distance of the pixel
+         * @return  the area of the largest group in pixels
+         */
+        int keep_largest(cv::Mat& image, int max_depth_step, int manhattan);
+
+        /**
+         * Sizes the internal buffers for images of up to the given number of pixels.
+         * Buffers also grow on demand, so this is only needed to avoid allocating
+         * during the first frames.
+         *
+         * @param   max_pixels  the largest image area that will be labelled
+         */
+        void reserve(int max_pixels);
+
+        /**
+         * @param   workers     the pool to split the labelling across. nullptr labels on the calling thread.
+         */
+        component_labeler(worker_pool* workers = nullptr);
+
+    private:
+        worker_pool* workers;
+        std::vector<int32_t> parent;    // Union-find forest over pixel indices. -1 marks empty pixels
+        std::vector<int32_t> area;      // Area of each group, indexed by its root pixel
+
+        const int min_band_rows = 16;   // Bands are never thinner than this to keep seams cheap
+
+        /**
+         * Follows the parent links up to the root of the group, halving the path on the way.
+         */
+        int32_t find_root(int32_t ind);
+
+        /**
+         * Merges the groups with the two given roots. The root with the lower index is kept,
+         * so every parent index is at most the index of its child.
+         *
+         * @return  the root of the merged group
+         */
+        int32_t join_roots(int32_t a, int32_t b);
+
+        /**
+         * keep_largest for a neighborhood radius fixed at compile time.
+         *
+         * @tparam  MANHATTAN   the radius. 0 takes the manhattan argument instead.
+         */
+        template<int MANHATTAN>
+        int keep_largest_radius(cv::Mat& image, int max_depth_step, int manhattan);
+
+        /**
+         * Labels the rows [row_start, row_end) against their already-visited neighbors
+         * (up-left half of the manhattan diamond), ignoring any neighbor above row_min.
+         */
+        template<int MANHATTAN>
+        void label_rows(const cv::Mat& image, int row_start, int row_end, int row_min,
+                        int max_depth_step, int manhattan, bool init);
+};
+
+#endif
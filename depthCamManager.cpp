@@ -5,9 +5,11 @@
  */
 
 #include "depthCamManager.h"
-#include <opencv2/imgproc/imgproc.hpp>
+#include "cloudKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
-#include <list>
 
 bool depth_cam::depth_cam_init() try
 {
@@ -22,12 +24,12 @@ bool depth_cam::depth_cam_init() try
         throw std::runtime_error( "No realsense devices are connected to the system at this time." );
     }
 
-    dev = ctx->get_device(0);
+    rs::device * dev = ctx->get_device(0);
 
     // Configure the input stream
     dev->enable_stream(rs::stream::depth, rs::preset::best_quality);
 
-    return true;
+    return depth_cam_init(new realsense_source(dev));
 }
 catch(const rs::error & e)
 {
@@ -35,196 +37,535 @@ catch(const rs::error & e)
     printf("rs::error was thrown when calling %s(%s):\n", e.get_failed_function().c_str(), e.get_failed_args().c_str());
     printf("    %s\n", e.what());
 
-    dev = nullptr;
     return false;
 }
 
+bool depth_cam::depth_cam_init( depth_source * source )
+{
+    if (depth_cam::source != nullptr)
+    {
+        delete depth_cam::source;
+    }
+
+    depth_cam::source = source;
+
+    return source != nullptr;
+}
+
 void depth_cam::start_stream( void )
 {
-    if (dev) {
-        dev->start();
+    if (source) {
+        source->start();
     }
 }
 
-void depth_cam::capture_next_frame( void )
+bool depth_cam::capture_next_frame( void )
+{
+    // Old depth frame is no longer valid
+    cloud.clear();
+
+    return capture_next_frame(cur_frame);
+}
+
+bool depth_cam::capture_next_frame( depth_frame& frame )
 {
-    // Use polling to capture the next frame
-    dev->wait_for_frames();
+    if (!source || !source->next_frame(raw_frame))
+    {
+        return false;
+    }
+
+    // Latencies are measured from here, since sensor timestamps use the device clock
+    frame.arrival_ns = trace_now_ns();
 
     // Update depth frame meta info
-    depth_intrin = dev->get_stream_intrinsics(rs::stream::depth);
+    frame.intrin = raw_frame.intrin;
+    frame.depth_scale = raw_frame.depth_scale;
+    frame.scale_factor = scale_factor;
+    frame.timestamp = raw_frame.timestamp;
+    frame.frame_number = raw_frame.frame_number;
+
+    // The window is fixed per frame, whenever the tracker moves it
+    uint64_t window = roi_window.load(std::memory_order_relaxed);
+    frame.roi = cv::Rect();
+
+    // The background has to see whole frames until it has learned
+    if (window != 0 && !background_learning.load(std::memory_order_relaxed))
+    {
+        // Grow the window out to whole scaled pixels
+        int x = (int)(window & 0xffff);
+        int y = (int)(window >> 16 & 0xffff);
+        int x0 = (int)floorf(x*scale_factor);
+        int y0 = (int)floorf(y*scale_factor);
+        int x1 = (int)ceilf((x + (int)(window >> 32 & 0xffff))*scale_factor);
+        int y1 = (int)ceilf((y + (int)(window >> 48))*scale_factor);
+        frame.roi = cv::Rect(x0, y0, x1-x0, y1-y0);
+    }
 
-    // Retrieve a reference to the raw depth frame
-    srcImg = (const uint16_t *)dev->get_frame_data(rs::stream::depth);
+    // Scale into the frame's own buffer so the source can reuse its memory
+    resize_depth(raw_frame.data, frame.intrin.width, frame.intrin.height, frame.depth, frame.roi);
 
-    // Convert to an OpenCV style matrix for consistency
-    cv::Mat sourceInMatForm(depth_intrin.height, depth_intrin.width, CV_16UC1, (void *)srcImg);
+    if (keep_full)
+    {
+        // Only the window is copied, which is all that is processed
+        frame.full_depth.create(frame.intrin.height, frame.intrin.width, CV_16UC1);
+        cv::Rect window = full_window(frame);
 
-    // Make a copy of the depth frame for editing
-    sourceInMatForm.copyTo(cur_src);
+        for (int i = window.y; i < window.y+window.height; i++)
+        {
+            memcpy(frame.full_depth.ptr<uint16_t>(i)+window.x, raw_frame.data + i*frame.intrin.width + window.x,
+                   window.width*sizeof(uint16_t));
+        }
+    }
 
-    cv::resize(sourceInMatForm, cur_src, cv::Size(0, 0), scale_factor, scale_factor);
+    return true;
+}
 
-    // Old depth frame is no longer valid
-    cloud.clear();
+void depth_cam::set_scale_factor(float scale_factor)
+{
+    depth_cam::scale_factor = scale_factor;
+    max_scale_factor = std::max(max_scale_factor, scale_factor);
 }
 
-void depth_cam::to_depth_frame(void)
+bool depth_cam::scaled_frame_size(int& rows, int& cols)
 {
-    float scale = dev->get_depth_scale();
+    rs::intrinsics intrin;
 
-    uint16_t* p;
-    
-    for( int i = 0; i < cur_src.rows; ++i)
+    if (!source || !source->get_intrinsics(intrin))
     {
-        p = cur_src.ptr<uint16_t>(i);
-        for ( int j = 0; j < cur_src.cols; ++j)
-        {
-            if (p[j] != 0)  // For each non-zero cell
-            {
-                // Deproject depth pixel into 3D space and add it to the point cloud
-                rs::float2 depth_pixel = {(float)j/scale_factor, (float)i/scale_factor};
-                float depth_in_meters = p[j] * scale;
-                rs::float3 depth_point = depth_intrin.deproject(depth_pixel, depth_in_meters);
+        return false;
+    }
 
-                // Convert to opencv vector format first
+    // The same rounding cv::resize applies to a scale factor
+    rows = (int)lround(intrin.height*max_scale_factor);
+    cols = (int)lround(intrin.width*max_scale_factor);
 
-                float point_arr[] = {depth_point.x, depth_point.y, depth_point.z};
+    return true;
+}
 
-                cv::Mat depth_point_cv(1, 3, CV_32FC1, &point_arr);
+bool depth_cam::full_frame_size(int& rows, int& cols)
+{
+    rs::intrinsics intrin;
 
-                cloud.add_point(depth_point_cv);
-            }
-        }
+    if (!source || !source->get_intrinsics(intrin))
+    {
+        return false;
     }
+
+    rows = intrin.height;
+    cols = intrin.width;
+
+    return true;
 }
 
-void depth_cam::filter_background(float maxDist, int manhattan)
+void depth_cam::reserve(void)
 {
-    // Info about the largest index
-    int largest_ind = -1;
-    int largest_ind_area = 0;
+    int rows, cols;
+
+    if (!scaled_frame_size(rows, cols))
+    {
+        return;
+    }
+
+    rs::intrinsics intrin;
+    source->get_intrinsics(intrin);
+    update_resize_table(intrin.width, intrin.height, max_scale_factor);
 
-    int current_ind = 0;
+    // Points are projected with the inverse of p*R + t, which is (p-t)*inv(R)
+    float rotation[9], translation[3];
+    cloud.get_calibration(rotation, translation);
 
-    uint16_t* p;
+    float det = rotation[0]*(rotation[4]*rotation[8] - rotation[5]*rotation[7])
+              - rotation[1]*(rotation[3]*rotation[8] - rotation[5]*rotation[6])
+              + rotation[2]*(rotation[3]*rotation[7] - rotation[4]*rotation[6]);
 
-    // Create a new mask for the image
-    cv::Mat subject_mask;
-    cur_src.copyTo(subject_mask);
+    if (det != 0)
+    {
+        float inv_det = 1/det;
+        roi_rotation[0] = (rotation[4]*rotation[8] - rotation[5]*rotation[7])*inv_det;
+        roi_rotation[1] = (rotation[2]*rotation[7] - rotation[1]*rotation[8])*inv_det;
+        roi_rotation[2] = (rotation[1]*rotation[5] - rotation[2]*rotation[4])*inv_det;
+        roi_rotation[3] = (rotation[5]*rotation[6] - rotation[3]*rotation[8])*inv_det;
+        roi_rotation[4] = (rotation[0]*rotation[8] - rotation[2]*rotation[6])*inv_det;
+        roi_rotation[5] = (rotation[2]*rotation[3] - rotation[0]*rotation[5])*inv_det;
+        roi_rotation[6] = (rotation[3]*rotation[7] - rotation[4]*rotation[6])*inv_det;
+        roi_rotation[7] = (rotation[1]*rotation[6] - rotation[0]*rotation[7])*inv_det;
+        roi_rotation[8] = (rotation[0]*rotation[4] - rotation[1]*rotation[3])*inv_det;
+        memcpy(roi_translation, translation, sizeof(translation));
+
+        roi_intrin = intrin;
+        roi_ready = true;
+    }
 
-    cv::Mat clustered = cv::Mat::zeros(cur_src.rows, cur_src.cols, CV_32SC1);
+    labeler.reserve(rows*cols);
+    background.reserve(rows, cols);
+    ray_x.reserve(rows*cols);
+    ray_y.reserve(rows*cols);
+    ray_z.reserve(rows*cols);
+}
 
-    for( int i = 0; i < subject_mask.rows; ++i)
+void depth_cam::update_roi(const float* points, int n_points, float margin)
+{
+    if (!roi_ready)
     {
-        p = subject_mask.ptr<uint16_t>(i);
-        for ( int j = 0; j < subject_mask.cols; ++j)
+        return;
+    }
+
+    float margin_px = margin*std::max(roi_intrin.fx, roi_intrin.fy);
+    float x_min = (float)roi_intrin.width, y_min = (float)roi_intrin.height;
+    float x_max = -1, y_max = -1;
+
+    for (int i = 0; i < n_points; i++)
+    {
+        float pixel[2], depth;
+
+        if (!project(points+3*i, pixel, depth))
         {
-            if (p[j] != 0)  // For each non-zero pixel
-            {
-                int current_ind_area = img_BFS(j, i, current_ind, subject_mask, clustered, maxDist, manhattan);
-
-                // Is the new cluster bigger
-                if (current_ind_area > largest_ind_area)
-                {
-                    largest_ind_area = current_ind_area;
-                    largest_ind = current_ind;
-                }
-                current_ind++;
-            }
+            continue;   // Behind this camera
         }
+
+        float reach = margin_px/depth;
+
+        x_min = std::min(x_min, pixel[0] - reach);
+        x_max = std::max(x_max, pixel[0] + reach);
+        y_min = std::min(y_min, pixel[1] - reach);
+        y_max = std::max(y_max, pixel[1] + reach);
+    }
+
+    // Clamp before rounding, since points close to the image plane project far out
+    int x0 = (int)floorf(std::max(x_min, 0.0f));
+    int y0 = (int)floorf(std::max(y_min, 0.0f));
+    int x1 = std::min(roi_intrin.width, (int)ceilf(std::min(x_max, (float)roi_intrin.width))+1);
+    int y1 = std::min(roi_intrin.height, (int)ceilf(std::min(y_max, (float)roi_intrin.height))+1);
+
+    if (x1 <= x0 || y1 <= y0)
+    {
+        clear_roi();    // Nothing to look at from this camera
+        return;
+    }
+
+    uint64_t window = (uint64_t)x0 | (uint64_t)y0 << 16 | (uint64_t)(x1-x0) << 32 | (uint64_t)(y1-y0) << 48;
+    roi_window.store(window, std::memory_order_relaxed);
+}
+
+bool depth_cam::project(const float* point, float* pixel, float& depth) const
+{
+    if (!roi_ready)
+    {
+        return false;
+    }
+
+    float x = point[0]-roi_translation[0];
+    float y = point[1]-roi_translation[1];
+    float z = point[2]-roi_translation[2];
+
+    // Back into the camera frame (row vector convention, p*R)
+    rs::float3 cam_point = {x*roi_rotation[0] + y*roi_rotation[3] + z*roi_rotation[6],
+                            x*roi_rotation[1] + y*roi_rotation[4] + z*roi_rotation[7],
+                            x*roi_rotation[2] + y*roi_rotation[5] + z*roi_rotation[8]};
+
+    if (cam_point.z <= 0)
+    {
+        return false;
     }
 
-    // Remove background in the original depth source
-    mask_by_cluster_id(clustered, largest_ind, cur_src);
+    rs::float2 projected = roi_intrin.project(cam_point);
+    pixel[0] = projected.x;
+    pixel[1] = projected.y;
+    depth = cam_point.z;
+
+    return true;
+}
+
+void depth_cam::clear_roi(void)
+{
+    roi_window.store(0, std::memory_order_relaxed);
+}
+
+int depth_cam::max_points(void)
+{
+    int rows, cols;
+
+    return scaled_frame_size(rows, cols) ? rows*cols : 0;
 }
 
-int depth_cam::img_BFS( int x, int y, int cluster_id, cv::Mat& input_img, cv::Mat& cluster_img, float maxDist, int manhattan)
+void depth_cam::resize_depth(const uint16_t* src, int src_width, int src_height, cv::Mat& dst, cv::Rect& roi)
 {
-    float scale = dev->get_depth_scale();
-    int cluster_area  = 1;
+    int dst_width = (int)lround(src_width*scale_factor);
+    int dst_height = (int)lround(src_height*scale_factor);
+
+    update_resize_table(src_width, src_height, scale_factor);
+
+    // A frame sized for a larger scale factor keeps its buffer and shrinks to a view of it
+    cv::Size whole;
+    cv::Point offset;
+
+    if (!dst.empty())
+    {
+        dst.locateROI(whole, offset);
+    }
+
+    if (dst.type() == CV_16UC1 && whole.width >= dst_width && whole.height >= dst_height)
+    {
+        dst.adjustROI(offset.y, dst_height-offset.y-dst.rows, offset.x, dst_width-offset.x-dst.cols);
+    }
+    else
+    {
+        dst.create(dst_height, dst_width, CV_16UC1);
+    }
+
+    // No window, or one that does not fit the frame, means the whole frame
+    cv::Rect full(0, 0, dst_width, dst_height);
+    cv::Rect window = roi & full;
+    roi = (window.area() > 0) ? window : full;
 
-    std::list<cv::Vec3i> neighbors;
+    int col_start = roi.x;
+    int col_end = roi.x+roi.width;
 
-    uint16_t centerDepth = input_img.ptr<uint16_t>(y)[x];
+    float* row_a = resize_rows.data();
+    float* row_b = row_a+dst_width;
+    int row_a_src = -1;
+    int row_b_src = -1;
 
-    while (true) 
+    for (int i = roi.y; i < roi.y+roi.height; i++)
     {
-        cluster_area++;
+        int y0 = resize_y[i];
+        int y1 = std::min(y0+1, src_height-1);
+
+        // Neighbouring output rows mostly share source rows, so keep the last two
+        if (y0 == row_b_src)
+        {
+            std::swap(row_a, row_b);
+            std::swap(row_a_src, row_b_src);
+        }
+
+        if (y0 != row_a_src)
+        {
+            resize_row(src+(size_t)y0*src_width, col_start, col_end, row_a);
+            row_a_src = y0;
+        }
+
+        if (y1 != row_b_src)
+        {
+            resize_row(src+(size_t)y1*src_width, col_start, col_end, row_b);
+            row_b_src = y1;
+        }
 
-        // Iterate through all squares within the manhattan distance of the origin
-        for (   int y_ind = std::max(-manhattan + y, 0); 
-                y_ind <= std::min(manhattan + y, input_img.rows-1); 
-                y_ind++ )
+        float wy = resize_wy[i];
+        uint16_t* out = dst.ptr<uint16_t>(i);
+
+        for (int j = col_start; j < col_end; j++)
         {
-            uint16_t* in_p = input_img.ptr<uint16_t>(y_ind);    // Pointer to the current row
-            int32_t* clust_p = cluster_img.ptr<int32_t>(y_ind);
-
-            // Calculate the horizontal manhattan distance
-            int dxLim = std::abs(y_ind-y)-manhattan;
-
-            // For each manhattan column
-            for (   int x_ind = std::max(dxLim + x, 0); 
-                    x_ind <= std::min(-dxLim + x, input_img.cols-1); 
-                    x_ind++)
-            {
-
-                // Skip any out-of-range pixels
-                if (in_p[x_ind] == 0 || std::abs(centerDepth-in_p[x_ind])*scale > maxDist )
-                {
-                    continue;
-                }
-
-                
-                // Add the current pixel to the list
-                neighbors.push_back({x_ind, y_ind, in_p[x_ind]});
-
-                // Add current item to the visited list
-                in_p[x_ind] = 0;
-
-                // Set group of current pixel
-                clust_p[x_ind] = cluster_id;
-            }
+            int v = (int)lrintf(row_a[j]*(1-wy) + row_b[j]*wy);
+            out[j] = (uint16_t)std::min(std::max(v, 0), 65535);
         }
+    }
+}
+
+void depth_cam::resize_row(const uint16_t* src, int col_start, int col_end, float* out)
+{
+    const int* x0 = resize_x.data();
+    const float* wx = resize_wx.data();
+
+    for (int j = col_start; j < col_end; j++)
+    {
+        // The last column has weight 0 on its right neighbour, which is clamped to itself
+        int x = x0[j];
+        out[j] = src[x]*(1-wx[j]) + src[x+(wx[j] > 0)]*wx[j];
+    }
+}
+
+void depth_cam::update_resize_table(int src_width, int src_height, float scale)
+{
+    if (resize_src_width == src_width && resize_src_height == src_height && resize_scale_factor == scale)
+    {
+        return;
+    }
+
+    int dst_width = (int)lround(src_width*scale);
+    int dst_height = (int)lround(src_height*scale);
+
+    resize_x.resize(dst_width);
+    resize_wx.resize(dst_width);
+    resize_y.resize(dst_height);
+    resize_wy.resize(dst_height);
+    resize_rows.resize(2*dst_width);
+
+    fill_resize_axis(src_width, dst_width, scale, resize_x.data(), resize_wx.data());
+    fill_resize_axis(src_height, dst_height, scale, resize_y.data(), resize_wy.data());
+
+    resize_src_width = src_width;
+    resize_src_height = src_height;
+    resize_scale_factor = scale;
+}
+
+void depth_cam::fill_resize_axis(int src_size, int dst_size, float scale, int* ind, float* weight)
+{
+    // Pixel centres line up the way they do for cv::resize with INTER_LINEAR
+    float inv_scale = 1.0f/scale;
+
+    for (int d = 0; d < dst_size; d++)
+    {
+        float f = (d+0.5f)*inv_scale - 0.5f;
+        int s = (int)floorf(f);
+        f -= s;
 
-        // Get the next item to evaluate, while more items exist
-        if (!neighbors.empty())
+        if (s < 0)
         {
-            x = neighbors.front()[0];
-            y = neighbors.front()[1];
-            centerDepth = neighbors.front()[2];
-            neighbors.pop_front();
+            s = 0;
+            f = 0;
         }
-        else
+
+        if (s >= src_size-1)
         {
-            break;
+            s = src_size-1;
+            f = 0;
         }
 
+        ind[d] = s;
+        weight[d] = f;
+    }
+}
+
+void depth_cam::to_depth_frame(bool calibrated)
+{
+    to_depth_frame(cur_frame, cloud, calibrated);
+}
+
+void depth_cam::to_depth_frame(const depth_frame& frame, pointCloud& out, bool calibrated)
+{
+    // Every pixel can produce at most one point
+    float* out_points = out.point_buffer(frame.depth.rows*frame.depth.cols);
+
+    out.set_size(deproject(frame, out_points, calibrated));
+}
+
+int depth_cam::deproject(const depth_frame& frame, float* out_points, bool calibrated)
+{
+    update_ray_table(frame, calibrated);
+
+    int n_points = 0;
+    cv::Rect roi = frame_window(frame);
+
+    for( int i = roi.y; i < roi.y+roi.height; ++i)
+    {
+        int row_start = i*frame.depth.cols+roi.x;
+
+        n_points += deproject_row(frame.depth.ptr<uint16_t>(i)+roi.x, &ray_x[row_start], &ray_y[row_start], &ray_z[row_start],
+                                  roi.width, frame.depth_scale, ray_translation, out_points+3*n_points);
     }
 
-    return cluster_area;
+    return n_points;
 }
 
-int depth_cam::mask_by_cluster_id(cv::Mat& cluster_img, int32_t cluster_id, cv::Mat& output_img)
+void depth_cam::update_ray_table(const depth_frame& frame, bool calibrated)
 {
-    int32_t* p_cl;
-    uint16_t* p_out;
+    size_t n_pixels = (size_t)frame.depth.rows*frame.depth.cols;
+
+    float rotation[9] = {1, 0, 0,
+                         0, 1, 0,
+                         0, 0, 1};
+    float translation[3] = {0, 0, 0};
+
+    if (calibrated)
+    {
+        cloud.get_calibration(rotation, translation);
+    }
+
+    // The translation is applied per point, so it never invalidates the rays
+    memcpy(ray_translation, translation, sizeof(translation));
+
+    if (ray_x.size() == n_pixels && ray_scale_factor == frame.scale_factor &&
+        memcmp(&ray_intrin, &frame.intrin, sizeof(rs::intrinsics)) == 0 &&
+        memcmp(ray_rotation, rotation, sizeof(rotation)) == 0)
+    {
+        return;
+    }
+
+    ray_x.resize(n_pixels);
+    ray_y.resize(n_pixels);
+    ray_z.resize(n_pixels);
 
-    for( int i = 0; i < cluster_img.rows; ++i)
+    for( int i = 0; i < frame.depth.rows; ++i)
     {
-        p_cl = cluster_img.ptr<int32_t>(i);
-        p_out = output_img.ptr<uint16_t>(i);
-        for ( int j = 0; j < cluster_img.cols; ++j)
+        for ( int j = 0; j < frame.depth.cols; ++j)
         {
-            // Zero all values except those in the target cluster
-            p_out[j] = (p_cl[j] == cluster_id) ? p_out[j] : 0;
+            // Deproject at unit depth. Deprojection is linear in depth, so scaling the
+            // ray by the depth later gives the same point.
+            rs::float2 depth_pixel = {(float)j/frame.scale_factor, (float)i/frame.scale_factor};
+            rs::float3 ray = frame.intrin.deproject(depth_pixel, 1.0f);
+
+            // Rotate the ray (row vector convention, ray*R)
+            int ind = i*frame.depth.cols+j;
+            ray_x[ind] = ray.x*rotation[0] + ray.y*rotation[3] + ray.z*rotation[6];
+            ray_y[ind] = ray.x*rotation[1] + ray.y*rotation[4] + ray.z*rotation[7];
+            ray_z[ind] = ray.x*rotation[2] + ray.y*rotation[5] + ray.z*rotation[8];
         }
     }
+
+    ray_intrin = frame.intrin;
+    ray_scale_factor = frame.scale_factor;
+    memcpy(ray_rotation, rotation, sizeof(rotation));
+}
+
+void depth_cam::filter_background(float maxDist, int manhattan)
+{
+    filter_background(cur_frame, maxDist, manhattan);
+}
+
+void depth_cam::filter_background(depth_frame& frame, float maxDist, int manhattan)
+{
+    // Compare depths in sensor units to avoid a multiply per neighbor
+    int max_depth_step = (int)(maxDist/frame.depth_scale);
+
+    cv::Rect roi = frame_window(frame);
+
+    // With a learned background only the foreground is left to segment
+    if (background.subtract(frame.depth, roi, frame.depth_scale) != 0)
+    {
+        // Keep only the largest group of connected pixels inside the window
+        cv::Mat window = frame.depth(roi);
+        labeler.keep_largest(window, max_depth_step, manhattan);
+    }
+
+    // Whatever was removed is background
+    background.learn(frame.depth, roi);
+    background_learning.store(background.learning(), std::memory_order_relaxed);
+}
+
+void depth_cam::learn_background(int learn_frames, float min_gap, float n_sigma)
+{
+    background.configure(learn_frames, min_gap, n_sigma);
+    background_learning.store(background.learning(), std::memory_order_relaxed);
+}
+
+cv::Rect depth_cam::frame_window(const depth_frame& frame)
+{
+    cv::Rect full(0, 0, frame.depth.cols, frame.depth.rows);
+    cv::Rect roi = frame.roi & full;
+
+    return (roi.area() > 0) ? roi : full;
+}
+
+void depth_cam::keep_full_depth(bool keep)
+{
+    keep_full = keep;
 }
 
-depth_cam::depth_cam( float scale_factor )
+cv::Rect depth_cam::full_window(const depth_frame& frame)
+{
+    cv::Rect roi = frame_window(frame);
+    int x0 = (int)floorf(roi.x/frame.scale_factor);
+    int y0 = (int)floorf(roi.y/frame.scale_factor);
+    int x1 = (int)ceilf((roi.x+roi.width)/frame.scale_factor);
+    int y1 = (int)ceilf((roi.y+roi.height)/frame.scale_factor);
+
+    return cv::Rect(x0, y0, x1-x0, y1-y0) & cv::Rect(0, 0, frame.intrin.width, frame.intrin.height);
+}
+
+depth_cam::depth_cam( float scale_factor ) : labeler(&workers), roi_window(0), background_learning(false)
 {
     depth_cam::scale_factor = scale_factor;
+    max_scale_factor = scale_factor;
 
     // Only display warnings (avoid verbosity)
     rs::log_to_console(rs::log_severity::warn);
@@ -232,6 +573,11 @@ depth_cam::depth_cam( float scale_factor )
 
 depth_cam::~depth_cam( void )
 {
+    if (source != nullptr)
+    {
+        delete source;
+    }
+
     if (ctx != nullptr)
     {
         delete ctx;
@@ -3,8 +3,9 @@
  *
  * Manages the depth cameras in a library-independent manner. This allows
  * the codebase to take advantages of new depth sensors from different vendors
- * without requiring a complete rewrite. The library is designed so that it can
- * be used with multiple cameras at the same time.
+ * without requiring a complete rewrite. Each depth_cam manages one camera with
+ * its own calibration. Several of them are combined by camera_rig (see
+ * cameraRig.h).
  */
 
 #ifndef DEPTHCAMMANAGER_H
@@ -13,6 +14,34 @@
 #include <librealsense/rs.hpp>
 #include "opencv2/core/core.hpp"
 #include "pointCloud.h"
+#include "depthSource.h"
+#include "componentLabeler.h"
+#include "backgroundModel.h"
+#include "workerPool.h"
+#include "trace.h"
+#include <atomic>
+#include <vector>
+
+/**
+ * A depth frame after it has been scaled for processing, together with the
+ * meta info needed to deproject it. Frames are independent of the camera, so
+ * several of them can be in flight in different stages at the same time.
+ */
+struct depth_frame
+{
+    cv::Mat depth;                          // The scaled depth image in its current state. May be a view
+                                            // into a buffer sized for a larger scale (see set_scale_factor).
+    rs::intrinsics intrin;                  // Intrinsics of the unscaled depth stream
+    float depth_scale = 0;                  // Meters per depth unit
+    float scale_factor = 1;                 // The scale factor that was applied to the image
+    double timestamp = 0;                   // Sensor timestamp (milliseconds)
+    unsigned long long frame_number = 0;    // Sensor frame counter
+    int64_t arrival_ns = 0;                 // Host time the frame was received (trace_now_ns)
+    cv::Rect roi;                           // The window of the scaled image that is processed (see
+                                            // depth_cam::update_roi). Only pixels inside it are valid.
+    cv::Mat full_depth;                     // The unscaled depth image, if the camera keeps it (see
+                                            // depth_cam::keep_full_depth). Only valid inside full_window().
+};
 
 /**
  * Manages a depth camera over its lifetime. Also provides support for conversion
@@ -22,12 +51,19 @@ class depth_cam
 {
     public:
         /**
-         * Intializes the camera to the default device. Currently, multiple
-         * devices are not supported, but support can be added easily by modifying
-         * this function.
+         * Intializes the camera to the first connected device. Use camera_rig to
+         * stream from several devices, since only one librealsense context may exist.
          */
         bool depth_cam_init( void );
 
+        /**
+         * Intializes the camera from an arbitrary frame source such as a recording.
+         * The camera takes ownership of the source.
+         *
+         * @param   source      the source to pull frames from
+         */
+        bool depth_cam_init( depth_source * source );
+
         /**
          * Activates the depth camera stream. 
          */
@@ -38,27 +74,175 @@ class depth_cam
          * as it is called in. If no error occurs, the manager will have an internal
          * reference to the latest depth frame from the camera. Note that the stream
          * must be started before this function is called.
+         *
+         * @return  false if the source has no more frames (e.g. the end of a recording)
          */
-        void capture_next_frame( void );
+        bool capture_next_frame( void );
+
+        /**
+         * Same as capture_next_frame(), but the scaled frame is written to the given frame
+         * instead of cur_frame.
+         *
+         * @param   frame   the frame to fill
+         */
+        bool capture_next_frame( depth_frame& frame );
 
         /**
          * Converts the given depth frame into a point cloud from the camera frame of reference.
+         * Points are deprojected along a cached table of per-pixel rays and written straight
+         * into the cloud storage.
+         *
+         * @param   calibrated  if true, the calibration transform of the cloud is applied during
+         *                      deprojection, which is equivalent to calling cloud.transform_cloud()
+         */
+        void to_depth_frame(bool calibrated = false);
+
+        /**
+         * Same as to_depth_frame(bool), but converts the given frame into the given cloud.
+         * The calibration transform is always taken from the camera's cloud member. This
+         * can run on a different thread than capture_next_frame.
+         *
+         * @param   frame       the frame to convert
+         * @param   out         the cloud to overwrite
+         * @param   calibrated  whether or not to apply the calibration transform
+         */
+        void to_depth_frame(const depth_frame& frame, pointCloud& out, bool calibrated);
+
+        /**
+         * Same as to_depth_frame(const depth_frame&, pointCloud&, bool), but writes the points
+         * to the given storage, which must hold one point per pixel of the frame.
+         *
+         * @param   frame       the frame to convert
+         * @param   out_points  the storage for the points (x,y,z interleaved)
+         * @param   calibrated  whether or not to apply the calibration transform
+         * @return  the number of points written
          */
-        void to_depth_frame(void);
+        int deproject(const depth_frame& frame, float* out_points, bool calibrated);
 
         /**
          * Removes the background from the captured frame by segmenting the image into groups of close
          * pixels (based on distance). The largest group is kept. All other groups are erased. The result
-         * overwrites the pipeline_src buffer.
+         * overwrites the pipeline_src buffer. Once a background model has been learned (see
+         * learn_background), the learned background is removed first, so only the foreground is segmented.
          *
          * @param   maxDist     the maximum distance between which two points can be in the same group (meters, depth)
          * @param   manhattan   the neighborhood to explore is within this manhattan distance of the point
          */
         void filter_background(float maxDist, int manhattan);
 
-        cv::Mat cur_src;            // The image in the current state of the pipeline
-        pointCloud cloud;           // The point cloud for the current frame
-        rs::device * dev = nullptr; // Currently the library only supports a single depth cam
+        /**
+         * Same as filter_background(float, int), but filters the given frame. This can run on
+         * a different thread than capture_next_frame.
+         *
+         * @param   frame       the frame to filter in place
+         */
+        void filter_background(depth_frame& frame, float maxDist, int manhattan);
+
+        /**
+         * Learns the static scene behind the user from the next frames filtered with
+         * filter_background, and removes it from the frames after that. See background_model.
+         * Call before reserve().
+         *
+         * @param   learn_frames    the frames to learn from before removing the background. 0 disables it.
+         * @param   min_gap         the smallest distance in front of the background that is kept (meters)
+         * @param   n_sigma         the distance in front of the background that is kept, in standard deviations
+         */
+        void learn_background(int learn_frames, float min_gap, float n_sigma);
+
+        /**
+         * Restricts the frames captured from now on to a window around the given points, so
+         * scaling, filtering and deprojecting skip the rest of the image. The points are
+         * projected into the unscaled image with the calibration of the camera, and each one
+         * grows the window by the margin at its depth. The window is scaled with each frame,
+         * so it stays valid if the scale factor changes. Falls back to whole frames if none of
+         * the points is in front of the camera or reserve() was not called. While the background
+         * model is still learning (see learn_background), frames are captured whole regardless.
+         * This can run on a different thread than capture_next_frame.
+         *
+         * @param   points      the calibrated points to keep in view (x,y,z interleaved)
+         * @param   n_points    the number of points
+         * @param   margin      how far the user can move before the next frame (meters)
+         */
+        void update_roi(const float* points, int n_points, float margin);
+
+        /**
+         * Projects a calibrated point into the unscaled image of the camera. This can run on
+         * a different thread than capture_next_frame.
+         *
+         * @param   point   the calibrated point
+         * @param   pixel   the pixel (x, y) in the unscaled image (output)
+         * @param   depth   the depth of the point from the camera (meters, output)
+         * @return  false if the point is behind the camera or reserve() was not called
+         */
+        bool project(const float* point, float* pixel, float& depth) const;
+
+        /**
+         * Processes the whole of the frames captured from now on. This can run on a different
+         * thread than capture_next_frame.
+         */
+        void clear_roi(void);
+
+        /**
+         * Scales the frames captured from now on by the given factor. Buffers sized by
+         * reserve() and max_points() are for the largest factor set so far, so a camera
+         * can switch between factors without allocating once it is reserved for the
+         * largest. A learned background is kept at the size of the largest factor and
+         * mapped onto frames of a smaller one, so it is not relearned.
+         *
+         * @param   scale_factor    the new scale factor
+         */
+        void set_scale_factor(float scale_factor);
+
+        /**
+         * Computes the size of the scaled frames from the intrinsics of the source,
+         * before any frame is captured. Frames are sized for the largest scale factor
+         * set so far (see set_scale_factor).
+         *
+         * @param   rows    set to the height of the scaled frames
+         * @param   cols    set to the width of the scaled frames
+         * @return  false if the source cannot tell its frame size in advance
+         */
+        bool scaled_frame_size(int& rows, int& cols);
+
+        /**
+         * Same as scaled_frame_size, but for the unscaled frames (see keep_full_depth).
+         */
+        bool full_frame_size(int& rows, int& cols);
+
+        /**
+         * Sizes the per-frame buffers of the camera (resize tables, ray table, labeler
+         * and background model) for the frames of the source, so capturing, filtering and
+         * deprojecting do not allocate. Also enables update_roi, which projects
+         * with the calibration of the cloud at this point.
+         */
+        void reserve(void);
+
+        /**
+         * @return  the largest number of points a frame can deproject to (one per pixel
+         *          of the scaled frame at the largest scale factor), or 0 if it is not
+         *          known in advance
+         */
+        int max_points(void);
+
+        /**
+         * @return  the window of the frame that is processed, the whole frame if it has none
+         */
+        static cv::Rect frame_window(const depth_frame& frame);
+
+        /**
+         * Keeps the unscaled depth image of the window in the frames captured from now on
+         * (see depth_frame::full_depth), so joints can be refined at full resolution.
+         */
+        void keep_full_depth(bool keep);
+
+        /**
+         * @return  the window of the frame that is processed, scaled up to the unscaled image
+         */
+        static cv::Rect full_window(const depth_frame& frame);
+
+        depth_frame cur_frame;      // The frame in the current state of the pipeline
+        pointCloud cloud;           // The point cloud for the current frame. Also holds the calibration.
+        raw_depth_frame raw_frame;  // The unprocessed frame from the source, valid until the next capture
 
         /**
          * @param scale_factor Sets the scale factor of the depth camera.
@@ -69,37 +253,80 @@ class depth_cam
 
     private:
         float scale_factor;                 // The scale factor to apply to the depth image before processing
+        float max_scale_factor;             // The largest scale factor set so far, which buffers are sized for
         rs::context * ctx = nullptr;        // Manages all of the realsense devices
-        rs::intrinsics depth_intrin;        // Depth intrinics of the frame, updates with each new frame
-        const uint16_t * srcImg;            // A reference to the source image  
+        depth_source * source = nullptr;    // Where frames come from (live device, recording, ...)
+        worker_pool workers;                // Threads shared by the per-frame image operations
+        component_labeler labeler;          // Connected-component engine for background removal
+        background_model background;        // The learned scene behind the user
+
+        std::vector<float> ray_x;           // The ray through each pixel of the scaled frame at unit depth
+        std::vector<float> ray_y;
+        std::vector<float> ray_z;
+        std::vector<int> resize_x;          // The left source column of each scaled column
+        std::vector<float> resize_wx;       // The weight of the right source column
+        std::vector<int> resize_y;          // The top source row of each scaled row
+        std::vector<float> resize_wy;       // The weight of the bottom source row
+        std::vector<float> resize_rows;     // Two source rows, resized horizontally
+        int resize_src_width = 0;           // The source size the resize tables were built for
+        int resize_src_height = 0;
+        float resize_scale_factor = 0;      // The scale factor the resize tables were built for
+
+        std::atomic<uint64_t> roi_window;   // The window of the next frame in unscaled pixels, packed as x, y,
+                                            // width, height (16 bits each). 0 processes the whole frame.
+        std::atomic<bool> background_learning;  // Whether or not the background still learns from whole frames
+        bool keep_full = false;             // Whether or not frames keep their unscaled depth image
+        bool roi_ready = false;             // Whether reserve() set up the projection below
+        rs::intrinsics roi_intrin;          // The intrinsics of the source
+        float roi_rotation[9];              // The inverse of the calibration transform
+        float roi_translation[3];
+
+        rs::intrinsics ray_intrin;          // The intrinsics the ray table was built for
+        float ray_scale_factor = 0;         // The scale factor the ray table was built for
+        float ray_rotation[9];              // The rotation folded into the rays (identity if uncalibrated)
+        float ray_translation[3];           // The translation applied after deprojection
 
         /**
-         * Runs BFS on the given image starting from a given pixel and expanding outwards.
-         * All pixels in the same group are marked with the index in the output image and
-         * zeroed in the input image. Maxdist and manhattan are treated the same way as
-         * in filter_background.
-         *
-         * @param   x           the x-coordinate of the start pixel (zero-based)
-         * @param   y           the y-coordinate of the start pixel (zero-based)
-         * @param   cluster_id  the id of the cluster
-         * @param   input_img   the source image to partition
-         * @param   cluster_img the output image containing clusters
-         * @param   maxDist     the maximum distance between which two points can be in the same group (meters, depth)
-         * @param   manhattan   the neighborhood to explore is within this manhattan distance of the point
+         * Rebuilds the ray table if the intrinsics, the scale factor or the transform changed
+         * since it was last built. Lens distortion and rotation are folded into the rays, so
+         * deprojecting a pixel only takes one multiply-add per coordinate.
          *
-         * @return  the area of the cluster including the initial pixel in number of pixels
+         * @param   frame       the frame that is about to be deprojected
+         * @param   calibrated  whether or not the calibration transform of the cloud is folded in
          */
-        int img_BFS(int x, int y, int cluster_id, cv::Mat& input_img, cv::Mat& cluster_img, float maxDist, int manhattan);   
+        void update_ray_table(const depth_frame& frame, bool calibrated);
 
         /**
-         * Zeroes all elements of the image matrix except for those with the given value. Those
-         * within the given value are replaced by the selected alternative.
+         * Scales a raw depth image by the scale factor into dst with bilinear
+         * interpolation. Matches cv::resize with INTER_LINEAR up to rounding,
+         * but works from cached tables and never allocates once dst has its size.
          *
-         * @param   input_img   the image to overwrite
-         * @param   target      the value to target
-         * @param   output      the image to filter
+         * @param   src         the raw depth image
+         * @param   src_width   its width
+         * @param   src_height  its height
+         * @param   dst         the scaled image. Reallocated only if it is smaller than the
+         *                      scaled frame, otherwise shrunk to a view of its buffer.
+         * @param   roi         the window of dst to fill, or an empty window for all of it.
+         *                      Set to the window that was filled.
+         */
+        void resize_depth(const uint16_t* src, int src_width, int src_height, cv::Mat& dst, cv::Rect& roi);
+
+        /**
+         * Interpolates one source row horizontally into out, for the scaled columns
+         * [col_start, col_end).
+         */
+        void resize_row(const uint16_t* src, int col_start, int col_end, float* out);
+
+        /**
+         * Rebuilds the resize tables if the source size or the scale factor changed.
+         */
+        void update_resize_table(int src_width, int src_height, float scale);
+
+        /**
+         * Maps every destination pixel along one axis to its first source pixel and
+         * the weight of the next one.
          */
-        int mask_by_cluster_id(cv::Mat& cluster_img, int32_t cluster_id, cv::Mat& output_img);
+        static void fill_resize_axis(int src_size, int dst_size, float scale, int* ind, float* weight);
 };
 
  #endif
\ No newline at end of file
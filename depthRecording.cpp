@@ -0,0 +1,280 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in depthRecording.h.
+ */
+
+#include "depthRecording.h"
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool depth_recorder::open(const char* filename)
+{
+    close();
+
+    file = fopen(filename, "wb");
+
+    if (file == nullptr)
+    {
+        printf("Unable to create recording %s\n", filename);
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+
+    return true;
+}
+
+bool depth_recorder::write_frame(const raw_depth_frame& frame)
+{
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    size_t depth_bytes = (size_t)frame.intrin.width*frame.intrin.height*sizeof(uint16_t);
+
+    // The stream header is only known once the first frame arrives
+    if (header.header_size == 0)
+    {
+        memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+        header.version = RECORDING_VERSION;
+        header.header_size = sizeof(recording_header);
+        header.frame_stride = (sizeof(recording_frame_header) + depth_bytes + 7) & ~(uint64_t)7;
+        header.width = frame.intrin.width;
+        header.height = frame.intrin.height;
+        header.ppx = frame.intrin.ppx;
+        header.ppy = frame.intrin.ppy;
+        header.fx = frame.intrin.fx;
+        header.fy = frame.intrin.fy;
+        header.model = (int32_t)frame.intrin.model;
+        memcpy(header.coeffs, frame.intrin.coeffs, sizeof(header.coeffs));
+        header.depth_scale = frame.depth_scale;
+
+        fwrite(&header, sizeof(header), 1, file);
+    }
+
+    // The format does not support resolution changes mid-stream
+    if (frame.intrin.width != header.width || frame.intrin.height != header.height)
+    {
+        return false;
+    }
+
+    recording_frame_header frame_header = {frame.timestamp, frame.frame_number};
+    const uint64_t padding = 0;
+    size_t padding_bytes = header.frame_stride - sizeof(frame_header) - depth_bytes;
+
+    fwrite(&frame_header, sizeof(frame_header), 1, file);
+    fwrite(frame.data, 1, depth_bytes, file);
+    fwrite(&padding, 1, padding_bytes, file);
+
+    header.frame_count++;
+
+    return !ferror(file);
+}
+
+void depth_recorder::close(void)
+{
+    if (file == nullptr)
+    {
+        return;
+    }
+
+    // Rewrite the header now that the frame count is known
+    if (header.header_size != 0)
+    {
+        fseek(file, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, file);
+    }
+
+    fclose(file);
+    file = nullptr;
+}
+
+depth_recorder::depth_recorder(void)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+depth_recorder::~depth_recorder(void)
+{
+    close();
+}
+
+bool recording_source::open(const char* filename)
+{
+    unmap();
+
+    int fd = ::open(filename, O_RDONLY);
+
+    if (fd < 0)
+    {
+        printf("Unable to open recording %s\n", filename);
+        return false;
+    }
+
+    struct stat file_info;
+    fstat(fd, &file_info);
+    mapping_size = file_info.st_size;
+
+    if (mapping_size < sizeof(recording_header))
+    {
+        printf("Recording %s is too short to be valid\n", filename);
+        ::close(fd);
+        return false;
+    }
+
+    void* addr = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);    // The mapping keeps the file alive
+
+    if (addr == MAP_FAILED)
+    {
+        printf("Unable to map recording %s\n", filename);
+        return false;
+    }
+
+    // Frames are read front to back
+    madvise(addr, mapping_size, MADV_SEQUENTIAL);
+
+    mapping = (const unsigned char*)addr;
+    header = (const recording_header*)mapping;
+    long long frames = count_frames(*header, mapping_size);
+
+    if (frames < 0)
+    {
+        printf("Recording %s is corrupt or has an unsupported version\n", filename);
+        unmap();
+        return false;
+    }
+
+    n_frames = (unsigned long long)frames;
+
+    intrin.width = header->width;
+    intrin.height = header->height;
+    intrin.ppx = header->ppx;
+    intrin.ppy = header->ppy;
+    intrin.fx = header->fx;
+    intrin.fy = header->fy;
+    intrin.model = (rs::distortion)header->model;
+    memcpy(intrin.coeffs, header->coeffs, sizeof(intrin.coeffs));
+
+    return true;
+}
+
+bool recording_source::start(void)
+{
+    next_index = 0;
+    return header != nullptr;
+}
+
+bool recording_source::get_intrinsics(rs::intrinsics& intrin)
+{
+    intrin = recording_source::intrin;
+    return header != nullptr;
+}
+
+bool recording_source::next_frame(raw_depth_frame& frame)
+{
+    if (header == nullptr)
+    {
+        return false;
+    }
+
+    if (next_index >= n_frames)
+    {
+        if (!loop || n_frames == 0)
+        {
+            return false;
+        }
+
+        next_index = 0;
+    }
+
+    const unsigned char* frame_start = mapping + header->header_size + next_index*header->frame_stride;
+    const recording_frame_header* frame_header = (const recording_frame_header*)frame_start;
+
+    // Pace delivery against the first frame of the pass
+    if (next_index == 0)
+    {
+        replay_start = std::chrono::steady_clock::now();
+        first_timestamp = frame_header->timestamp;
+    }
+    else if (realtime)
+    {
+        std::chrono::duration<double, std::milli> offset(frame_header->timestamp - first_timestamp);
+        std::this_thread::sleep_until(replay_start +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(offset));
+    }
+
+    frame.data = (const uint16_t*)(frame_start + sizeof(recording_frame_header));
+    frame.intrin = intrin;
+    frame.depth_scale = header->depth_scale;
+    frame.timestamp = frame_header->timestamp;
+    frame.frame_number = frame_header->frame_number;
+
+    next_index++;
+
+    return true;
+}
+
+unsigned long long recording_source::frame_count(void) const
+{
+    return header ? n_frames : 0;
+}
+
+recording_source::recording_source(bool realtime, bool loop)
+{
+    recording_source::realtime = realtime;
+    recording_source::loop = loop;
+}
+
+recording_source::~recording_source(void)
+{
+    unmap();
+}
+
+void recording_source::unmap(void)
+{
+    if (mapping != nullptr)
+    {
+        munmap((void*)mapping, mapping_size);
+    }
+
+    mapping = nullptr;
+    mapping_size = 0;
+    header = nullptr;
+    n_frames = 0;
+    next_index = 0;
+}
+
+long long recording_source::count_frames(const recording_header& header, size_t mapping_size)
+{
+    if (memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0 || header.version != RECORDING_VERSION ||
+        header.width <= 0 || header.height <= 0 ||
+        header.header_size < sizeof(recording_header) || header.header_size > mapping_size)
+    {
+        return -1;
+    }
+
+    // Both sides are 32-bit sizes, so the product cannot overflow 64 bits
+    uint64_t min_stride = sizeof(recording_frame_header) + (uint64_t)header.width*header.height*sizeof(uint16_t);
+
+    if (header.frame_stride < min_stride)
+    {
+        return -1;
+    }
+
+    // Dividing instead of multiplying keeps a corrupt count from overflowing
+    uint64_t fit = (mapping_size-header.header_size)/header.frame_stride;
+
+    if (header.frame_count == 0)
+    {
+        return (long long)fit;     // Never closed. Every complete frame counts.
+    }
+
+    return header.frame_count <= fit ? (long long)header.frame_count : -1;
+}
@@ -0,0 +1,157 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Records depth streams to disk and plays them back. Recordings make it
+ * possible to profile and regression-test the pipeline on machines without
+ * a camera attached.
+ *
+ * File layout (native endianness):
+ *
+ *   recording_header
+ *   frame 0: recording_frame_header, width*height uint16_t depth values, padding to 8 bytes
+ *   frame 1: ...
+ *
+ * Every frame has the same size, so frame i starts at
+ * header_size + i*frame_stride.
+ */
+
+#ifndef DEPTHRECORDING_H
+#define DEPTHRECORDING_H
+
+#include <cstdio>
+#include <chrono>
+#include "depthSource.h"
+
+#define RECORDING_MAGIC "DEPTHREC"
+#define RECORDING_VERSION 1
+
+/**
+ * Stream-level information stored once at the start of a recording.
+ */
+struct recording_header
+{
+    char magic[8];              // RECORDING_MAGIC without the terminator
+    uint32_t version;           // RECORDING_VERSION
+    uint32_t header_size;       // sizeof(recording_header) when written
+    uint64_t frame_count;       // Number of complete frames in the file. 0 if the recorder did not
+                                // close it (e.g. it crashed): the frames are then counted from the file size.
+    uint64_t frame_stride;      // Bytes from the start of one frame to the next
+    int32_t width;              // rs::intrinsics
+    int32_t height;
+    float ppx;
+    float ppy;
+    float fx;
+    float fy;
+    int32_t model;
+    float coeffs[5];
+    float depth_scale;          // Meters per depth unit
+    uint32_t reserved;
+};
+
+/**
+ * Precedes the depth data of every recorded frame.
+ */
+struct recording_frame_header
+{
+    double timestamp;           // Sensor timestamp (milliseconds)
+    uint64_t frame_number;      // Sensor frame counter
+};
+
+/**
+ * Appends raw depth frames to a recording file.
+ */
+class depth_recorder
+{
+    public:
+        /**
+         * Creates (or overwrites) the recording file. The stream header is
+         * written with the first frame, since the intrinsics are unknown until then.
+         *
+         * @param   filename    the path to the recording to create
+         * @return  whether or not the file could be opened
+         */
+        bool open(const char* filename);
+
+        /**
+         * Appends the given frame to the recording. All frames must have
+         * the same resolution as the first one.
+         *
+         * @param   frame   the frame to store
+         * @return  whether or not the frame was written
+         */
+        bool write_frame(const raw_depth_frame& frame);
+
+        /**
+         * Finalizes the frame count and closes the file.
+         */
+        void close(void);
+
+        depth_recorder(void);
+        ~depth_recorder(void);
+
+    private:
+        FILE* file = nullptr;
+        recording_header header;    // Header of the current recording
+};
+
+/**
+ * Replays a recording by memory-mapping it. Frames are handed out without
+ * copying.
+ */
+class recording_source : public depth_source
+{
+    public:
+        /**
+         * Maps the given recording into memory and validates its header. A recording
+         * that was already open is unmapped first.
+         *
+         * @param   filename    the recording to replay
+         * @return  whether or not the recording could be opened
+         */
+        bool open(const char* filename);
+
+        bool start(void);
+        bool next_frame(raw_depth_frame& frame);
+        bool get_intrinsics(rs::intrinsics& intrin);
+
+        /**
+         * @return  the number of frames in the recording
+         */
+        unsigned long long frame_count(void) const;
+
+        /**
+         * @param   realtime    if true, frames are delivered at the recorded rate. Otherwise
+         *                      they are delivered as fast as they are requested.
+         * @param   loop        restart from the first frame instead of ending the stream
+         */
+        recording_source(bool realtime, bool loop = false);
+
+        ~recording_source(void);
+
+    private:
+        bool realtime;
+        bool loop;
+        const unsigned char* mapping = nullptr; // The memory-mapped file
+        size_t mapping_size = 0;
+        const recording_header* header = nullptr;
+        unsigned long long n_frames = 0;        // The complete frames in the mapping
+        rs::intrinsics intrin;                  // Intrinsics rebuilt from the header
+        unsigned long long next_index = 0;      // Index of the next frame to deliver
+
+        std::chrono::steady_clock::time_point replay_start;     // Wall time at which the first frame was delivered
+        double first_timestamp = 0;                             // Sensor time of the first delivered frame
+
+        /**
+         * Unmaps the recording, if one is open.
+         */
+        void unmap(void);
+
+        /**
+         * Checks that the header describes frames that fit the mapping.
+         *
+         * @return  the number of complete frames, or -1 if the header is invalid
+         */
+        static long long count_frames(const recording_header& header, size_t mapping_size);
+};
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in depthSource.h.
+ */
+
+#include "depthSource.h"
+
+bool realsense_source::start(void)
+{
+    dev->start();
+    return true;
+}
+
+bool realsense_source::next_frame(raw_depth_frame& frame)
+{
+    // Use polling to capture the next frame
+    dev->wait_for_frames();
+
+    // Update depth frame meta info
+    frame.intrin = dev->get_stream_intrinsics(rs::stream::depth);
+    frame.depth_scale = dev->get_depth_scale();
+    frame.timestamp = dev->get_frame_timestamp(rs::stream::depth);
+    frame.frame_number = dev->get_frame_number(rs::stream::depth);
+
+    // Retrieve a reference to the raw depth frame
+    frame.data = (const uint16_t *)dev->get_frame_data(rs::stream::depth);
+
+    return true;
+}
+
+bool realsense_source::get_intrinsics(rs::intrinsics& intrin)
+{
+    // The stream is enabled before the source is created, so its mode is already fixed
+    intrin = dev->get_stream_intrinsics(rs::stream::depth);
+    return true;
+}
+
+realsense_source::realsense_source(rs::device * dev)
+{
+    realsense_source::dev = dev;
+}
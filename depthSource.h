@@ -0,0 +1,81 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Abstracts where depth frames come from. The rest of the pipeline only sees
+ * raw 16-bit depth images with their intrinsics, depth scale and timestamps,
+ * so a live camera, a recording or any other producer can feed it in exactly
+ * the same way.
+ */
+
+#ifndef DEPTHSOURCE_H
+#define DEPTHSOURCE_H
+
+#include <librealsense/rs.hpp>
+#include <stdint.h>
+
+/**
+ * A single unprocessed depth frame. The depth buffer is owned by the source
+ * that produced it and is only valid until the next frame is requested.
+ */
+struct raw_depth_frame
+{
+    const uint16_t * data = nullptr;        // Row-major depth image (intrin.width x intrin.height)
+    rs::intrinsics intrin;                  // Intrinsics of the depth stream for this frame
+    float depth_scale = 0;                  // Meters per depth unit
+    double timestamp = 0;                   // Sensor timestamp (milliseconds)
+    unsigned long long frame_number = 0;    // Sensor frame counter
+};
+
+/**
+ * Interface for anything that can produce depth frames.
+ */
+class depth_source
+{
+    public:
+        /**
+         * Starts producing frames. Called once before the first next_frame.
+         *
+         * @return  whether or not the source could be started
+         */
+        virtual bool start(void) = 0;
+
+        /**
+         * Blocks until the next frame is available and describes it in the given frame.
+         *
+         * @param   frame   the frame to fill
+         * @return  false once the source has no more frames to deliver
+         */
+        virtual bool next_frame(raw_depth_frame& frame) = 0;
+
+        /**
+         * Describes the frames the source will produce, so per-frame buffers can be
+         * sized before the first frame arrives.
+         *
+         * @param   intrin  filled with the intrinsics of the depth stream
+         * @return  false if the frame size is not known
+         */
+        virtual bool get_intrinsics(rs::intrinsics& intrin) = 0;
+
+        virtual ~depth_source(void) {}
+};
+
+/**
+ * Streams depth frames from a connected librealsense device.
+ */
+class realsense_source : public depth_source
+{
+    public:
+        bool start(void);
+        bool next_frame(raw_depth_frame& frame);
+        bool get_intrinsics(rs::intrinsics& intrin);
+
+        /**
+         * @param   dev     the device to stream from. The stream must already be enabled.
+         */
+        realsense_source(rs::device * dev);
+
+    private:
+        rs::device * dev;       // The device is owned by the librealsense context
+};
+
+#endif
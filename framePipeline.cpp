@@ -0,0 +1,484 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in framePipeline.h.
+ */
+
+#include "framePipeline.h"
+#include "trace.h"
+#include "allocCheck.h"
+#include <algorithm>
+#include <chrono>
+
+template<class Config>
+void frame_pipeline<Config>::start(void)
+{
+    // The background is learned from the first frames of every run
+    rig.learn_background(config.background_learn_frames, config.background_min_gap, config.background_sigma);
+    rig.keep_full_depth(refiner.enabled());
+    reserve();
+    running = true;
+
+    capture_thread = std::thread(&frame_pipeline::capture_loop, this);
+    segment_thread = std::thread(&frame_pipeline::segment_loop, this);
+    track_thread = std::thread(&frame_pipeline::track_loop, this);
+}
+
+template<class Config>
+void frame_pipeline<Config>::stop(void)
+{
+    running = false;
+
+    if (capture_thread.joinable())
+    {
+        capture_thread.join();
+    }
+
+    if (segment_thread.joinable())
+    {
+        segment_thread.join();
+    }
+
+    if (track_thread.joinable())
+    {
+        track_thread.join();
+    }
+}
+
+template<class Config>
+pipeline_frame* frame_pipeline<Config>::wait_output(void)
+{
+    while (true)
+    {
+        pipeline_frame* frame = wait_pop(to_output);
+
+        if (frame == nullptr || frame->end_of_stream)
+        {
+            return frame;
+        }
+
+        // Only the newest completed frame is of interest
+        pipeline_frame* newer;
+
+        while (config.latest_frame_wins && !frame->end_of_stream && to_output.pop(newer))
+        {
+            release(frame);
+            frame = newer;
+        }
+
+        if (!frame->dropped || frame->end_of_stream)
+        {
+            return frame;
+        }
+
+        release(frame);
+    }
+}
+
+template<class Config>
+void frame_pipeline<Config>::release(pipeline_frame* frame)
+{
+    // There are never more frames than ring entries, so this cannot fail
+    free_slots.push(frame);
+}
+
+template<class Config>
+void frame_pipeline<Config>::reserve(void)
+{
+    int max_attempts = config.kmeans_attempts;
+
+    // The cameras size their buffers for the largest scale factor they were set to
+    for (int i = 0; config.quality && i < config.quality->size(); i++)
+    {
+        rig.set_scale_factor(config.quality->settings(i).scale_factor);
+        max_attempts = std::max(max_attempts, config.quality->settings(i).kmeans_attempts);
+    }
+
+    if (config.quality)
+    {
+        rig.set_scale_factor(config.quality->settings(config.quality->rung()).scale_factor);
+    }
+
+    rig.reserve();
+
+    // Superpixel centers are calibrated like the cloud of their camera
+    for (int cam = 0; cam < rig.size(); cam++)
+    {
+        float rotation[9], translation[3];
+        rig.camera(cam).cloud.get_calibration(rotation, translation);
+        trk.set_view_calibration(cam, rotation, translation);
+    }
+
+    int full_pixels = 0;
+
+    for (size_t i = 0; i < n_slots; i++)
+    {
+        for (int cam = 0; cam < rig.size(); cam++)
+        {
+            int rows, cols;
+
+            if (rig.camera(cam).scaled_frame_size(rows, cols))
+            {
+                slots[i].views[cam].depth.create(rows, cols, CV_16UC1);
+            }
+
+            if (refiner.enabled() && rig.camera(cam).full_frame_size(rows, cols))
+            {
+                slots[i].views[cam].full_depth.create(rows, cols, CV_16UC1);
+                full_pixels += (i == 0) ? rows*cols : 0;
+            }
+        }
+
+        slots[i].centers.create(trk.centers.rows, trk.centers.cols, trk.centers.type());
+        slots[i].adj.create(trk.adj_kmeans.rows, trk.adj_kmeans.cols, trk.adj_kmeans.type());
+    }
+
+    // Sources that cannot tell their frame size leave the rest to the warm-up frames
+    int max_points = rig.max_points();
+
+    if (max_points == 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < n_slots; i++)
+    {
+        slots[i].cloud.point_buffer(max_points);
+    }
+
+    int view_rows, view_cols;
+    rig.scaled_frame_size(view_rows, view_cols);
+
+    voxels.reserve(max_points);
+    trk.reserve(max_points, max_attempts, view_rows, view_cols);
+    arms.reserve(max_points);
+    refiner.reserve(full_pixels);
+}
+
+template<class Config>
+void frame_pipeline<Config>::end_warmup_frame(int& frames, const char* stage)
+{
+    if (frames++ == config.alloc_check_warmup)
+    {
+        ALLOC_CHECK_THREAD(stage);
+    }
+}
+
+template<class Config>
+void frame_pipeline<Config>::capture_loop(void)
+{
+    TRACE_THREAD_NAME("capture");
+    int frames = 0;
+    int rung = config.quality ? config.quality->rung() : 0;
+
+    while (running)
+    {
+        pipeline_frame* frame = wait_pop(free_slots);
+
+        if (frame == nullptr)
+        {
+            return;
+        }
+
+        frame->dropped = false;
+        frame->clustered = false;
+        frame->left_arm.tracked = false;
+        frame->right_arm.tracked = false;
+        frame->quality = config.quality ? config.quality->rung() : 0;
+
+        // The rung is applied here so every stage of the frame sees the same one
+        if (frame->quality != rung)
+        {
+            rig.set_scale_factor(config.quality->settings(frame->quality).scale_factor);
+            rung = frame->quality;
+        }
+
+        {
+            TRACE_SCOPE("capture");
+            frame->end_of_stream = !rig.capture(frame->views);
+        }
+
+        if (frame->end_of_stream)
+        {
+            to_segment.push(frame);
+            return;
+        }
+
+        frame->arrival_ns = frame->views[0].arrival_ns;
+
+        for (size_t i = 0; i < frame->views.size(); i++)
+        {
+            frame->arrival_ns = std::max(frame->arrival_ns, frame->views[i].arrival_ns);
+        }
+
+        // Waiting for the cameras is not work, so scaling is counted from the arrival
+        frame->capture_ns = trace_now_ns()-frame->arrival_ns;
+
+        for (size_t i = 0; i < frame->views.size(); i++)
+        {
+            if (config.recorders && config.recorders[i])
+            {
+                TRACE_SCOPE("record");
+                config.recorders[i]->write_frame(rig.camera(i).raw_frame);
+            }
+        }
+
+        end_warmup_frame(frames, "capture");
+        to_segment.push(frame);
+    }
+}
+
+template<class Config>
+void frame_pipeline<Config>::segment_loop(void)
+{
+    TRACE_THREAD_NAME("segment");
+    int frames = 0;
+
+    while (running)
+    {
+        pipeline_frame* frame = next_input(to_segment, to_track);
+
+        if (frame == nullptr)
+        {
+            return;
+        }
+
+        if (!frame->dropped && !frame->end_of_stream)
+        {
+            int64_t start_ns = trace_now_ns();
+            pipeline_config stage = frame_config(frame);
+
+            {
+                TRACE_SCOPE("filter_background");
+                rig.filter_background(frame->views, stage.filter_max_dist, stage.filter_manhattan);
+            }
+
+            {
+                // Build the calibrated cloud of every camera in a single pass and merge them
+                TRACE_SCOPE("to_depth_frame");
+                rig.to_cloud(frame->views, frame->cloud);
+            }
+
+            // Bound the point count however close the user is to the camera
+            if (config.voxel_leaf_size > 0)
+            {
+                TRACE_SCOPE("voxel_downsample");
+                frame->cloud.voxel_downsample(voxels);
+            }
+
+            frame->segment_ns = trace_now_ns()-start_ns;
+            end_warmup_frame(frames, "segment");
+        }
+
+        to_track.push(frame);
+
+        if (frame->end_of_stream)
+        {
+            return;
+        }
+    }
+}
+
+template<class Config>
+void frame_pipeline<Config>::track_loop(void)
+{
+    TRACE_THREAD_NAME("track");
+    int frames = 0;
+
+    while (running)
+    {
+        pipeline_frame* frame = next_input(to_track, to_output);
+
+        if (frame == nullptr)
+        {
+            return;
+        }
+
+        if (!frame->dropped && !frame->end_of_stream)
+        {
+            int64_t start_ns = trace_now_ns();
+            pipeline_config stage = frame_config(frame);
+            trk.update_point_cloud(frame->cloud);
+
+            // Locked arms are fitted, and clustering only runs to find the others
+            bool left_tracked, right_tracked;
+            frame->clustered = arms.track(trk, frame->views, left, right, stage, left_tracked, right_tracked);
+
+            if (frame->clustered)
+            {
+                // Copy the results since the tracker moves on to the next frame
+                trk.centers.copyTo(frame->centers);
+                trk.adj_kmeans.copyTo(frame->adj);
+            }
+
+            if (refiner.enabled())
+            {
+                TRACE_SCOPE("refine_hands");
+                refine_arm(left, left_tracked, frame->views);
+                refine_arm(right, right_tracked, frame->views);
+            }
+
+            snapshot_arm(left, left_tracked, frame->left_arm);
+            snapshot_arm(right, right_tracked, frame->right_arm);
+
+            frame->state_ns = frame->arrival_ns;
+
+            if (config.predictor)
+            {
+                frame->state_ns = config.predictor->update(frame->left_arm, frame->right_arm,
+                                                           frame->views[0].timestamp, frame->arrival_ns);
+            }
+
+            // The next frames are captured in the window around this one
+            window.update(rig, trk, frame->clustered, left, frame->left_arm.tracked, right, frame->right_arm.tracked);
+
+            // Publish straight from this thread so other processes skip the output stage
+            if (config.publisher)
+            {
+                config.publisher->publish(frame->left_arm, frame->right_arm, frame->views[0].frame_number,
+                                          frame->views[0].timestamp, frame->arrival_ns, frame->state_ns);
+            }
+
+            frame->track_ns = trace_now_ns()-start_ns;
+
+            if (config.quality)
+            {
+                config.quality->update(frame->quality, frame->views[0].frame_number, frame->capture_ns,
+                                       frame->segment_ns, frame->track_ns);
+            }
+
+            TRACE_SINCE("arrival_to_joints", frame->arrival_ns);
+            end_warmup_frame(frames, "track");
+        }
+
+        to_output.push(frame);
+
+        if (frame->end_of_stream)
+        {
+            return;
+        }
+    }
+}
+
+template<class Config>
+pipeline_frame* frame_pipeline<Config>::wait_pop(frame_ring& ring)
+{
+    pipeline_frame* frame;
+    int attempts = 0;
+
+    while (!ring.pop(frame))
+    {
+        if (!running)
+        {
+            return nullptr;
+        }
+
+        // Spin briefly since the next frame is usually close, then back off
+        if (++attempts < 64)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    return frame;
+}
+
+template<class Config>
+pipeline_frame* frame_pipeline<Config>::next_input(frame_ring& in, frame_ring& out)
+{
+    pipeline_frame* frame = wait_pop(in);
+    pipeline_frame* newer;
+
+    if (frame == nullptr || frame->dropped || frame->end_of_stream || !config.latest_frame_wins)
+    {
+        return frame;
+    }
+
+    // Skip ahead to the newest waiting frame. Stale frames keep their order downstream
+    // so the output stage can recycle them.
+    while (in.pop(newer))
+    {
+        frame->dropped = true;
+        out.push(frame);
+        frame = newer;
+
+        if (frame->dropped || frame->end_of_stream)
+        {
+            break;
+        }
+    }
+
+    return frame;
+}
+
+template<class Config>
+pipeline_config frame_pipeline<Config>::frame_config(const pipeline_frame* frame) const
+{
+    pipeline_config stage = config;
+
+    if (config.quality)
+    {
+        config.quality->apply(frame->quality, stage);
+    }
+
+    return stage;
+}
+
+template<class Config>
+void frame_pipeline<Config>::refine_arm(basic_arm<Config>& a, bool tracked, const std::vector<depth_frame>& views)
+{
+    if (tracked)
+    {
+        refiner.refine(rig, views, a.hand_loc, a.elbow_loc);
+    }
+}
+
+template<class Config>
+void frame_pipeline<Config>::snapshot_arm(basic_arm<Config>& src, bool tracked, arm_snapshot& dst)
+{
+    dst.tracked = tracked;
+
+    if (!tracked)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        dst.hand[i] = src.hand_loc[i];
+        dst.elbow[i] = src.elbow_loc[i];
+        dst.shoulder[i] = src.shoulder_loc[i];
+    }
+
+    dst.bend_angle = src.get_bend_angle();
+}
+
+template<class Config>
+frame_pipeline<Config>::frame_pipeline(camera_rig& rig, basic_tracker<Config>& trk, basic_arm<Config>& left,
+                                       basic_arm<Config>& right, const pipeline_config& config)
+    : rig(rig), trk(trk), left(left), right(right), config(config), voxels(config.voxel_leaf_size > 0 ? config.voxel_leaf_size : 1),
+      window(config.roi_margin, config.roi_refresh_frames, trk.num_clusters()),
+      arms(config.fit_iterations, config.fit_radius, config.fit_gate, config.fit_max_residual, config.fit_min_points),
+      refiner(config.refine_radius, config.refine_min_points),
+      running(false)
+{
+    for (size_t i = 0; i < n_slots; i++)
+    {
+        slots[i].views.resize(rig.size());
+        free_slots.push(&slots[i]);
+    }
+}
+
+template<class Config>
+frame_pipeline<Config>::~frame_pipeline(void)
+{
+    stop();
+}
+
+// The configurations pose is built with (see tracker.cpp)
+template class frame_pipeline<compiled_tracker_config>;
+template class frame_pipeline<runtime_tracker_config>;
@@ -0,0 +1,228 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Runs the tracking pipeline as a chain of stages on dedicated threads:
+ *
+ *   capture -> segmentation/cloud building/downsampling -> tracking -> output
+ *
+ * A fixed set of preallocated frame slots circulates through the stages.
+ * Stages hand slots to each other through bounded single-producer/
+ * single-consumer rings, so no locks are taken on the hot path. With the
+ * latest-frame-wins policy, a stage that falls behind skips straight to the
+ * newest waiting frame and passes the stale ones along as dropped. Latency
+ * then stays bounded under load instead of growing with the queue depth.
+ * With a tracking window (see trackingWindow.h), the tracking stage moves
+ * the window the capture stage scales the next frames in. Arms that are
+ * locked are fitted by the tracking stage without k-means (see armFitter.h).
+ */
+
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <atomic>
+#include <thread>
+#include "opencv2/core/core.hpp"
+#include "cameraRig.h"
+#include "depthCamManager.h"
+#include "depthRecording.h"
+#include "tracker.h"
+#include "trackingWindow.h"
+#include "armFitter.h"
+#include "jointRefiner.h"
+#include "spscRing.h"
+#include "voxelGrid.h"
+#include "jointPublisher.h"
+#include "jointPredictor.h"
+#include "qualityController.h"
+#include "armSnapshot.h"
+
+/**
+ * Everything produced for a single depth frame as it moves through the pipeline.
+ */
+struct pipeline_frame
+{
+    std::vector<depth_frame> views; // The scaled and segmented depth image of each camera
+    int64_t arrival_ns = 0;     // When the last view reached the host (trace_now_ns)
+    int64_t state_ns = 0;       // When the joints were where the snapshots say (see joint_predictor::update)
+    pointCloud cloud;           // The calibrated point cloud of the user, merged from all cameras
+    bool clustered = false;     // Whether or not k-means ran on this frame
+    cv::Mat centers;            // Copy of the k-means centers
+    cv::Mat adj;                // Copy of the k-means adjacency matrix
+    arm_snapshot left_arm;
+    arm_snapshot right_arm;
+    int quality = 0;            // The rung of the quality ladder the frame is processed at (see qualityController.h)
+    int64_t capture_ns = 0;     // The time each stage spent on the frame, without waiting
+    int64_t segment_ns = 0;
+    int64_t track_ns = 0;
+    bool dropped = false;       // Skipped by a stage under the latest-frame-wins policy
+    bool end_of_stream = false; // The source ran out of frames. No data is attached.
+};
+
+/**
+ * Per-frame parameters for the pipeline stages.
+ */
+struct pipeline_config
+{
+    float filter_max_dist;              // See depth_cam::filter_background
+    int filter_manhattan;
+    int kmeans_attempts;                // See tracker::cluster
+    int kmeans_iterations;
+    double kmeans_epsilon;
+    float connect_threshold;            // See tracker::connect_means
+    float voxel_leaf_size = 0;          // Downsampling grid size for the cloud. 0 disables it.
+    float joint_smoothing;              // See arm::update_joints
+    int superpixel_iterations = 0;      // Cluster the depth images into superpixels with this many SLIC
+                                        // iterations instead of running k-means (see superpixels.h). 0 runs k-means.
+    float superpixel_compactness = 0;   // See superpixel_engine::cluster
+    int fit_iterations = 0;             // ICP iterations of a locked arm (see armFitter.h). 0 runs k-means every frame.
+    float fit_radius = 0;               // See arm_fitter
+    float fit_gate = 0;
+    float fit_max_residual = 0;
+    int fit_min_points = 0;
+    float refine_radius = 0;            // Refine the hands on the unscaled images within this radius (meters,
+                                        // see jointRefiner.h). 0 disables it.
+    int refine_min_points = 0;          // See joint_refiner
+    bool latest_frame_wins = true;      // Skip stale frames instead of processing every frame
+    depth_recorder* const* recorders = nullptr; // Records the raw stream of camera i from the capture thread if recorders[i] is set
+    joint_publisher* publisher = nullptr; // Publishes the joints of every tracked frame if set
+    joint_predictor* predictor = nullptr; // Filters the joints in place of joint_smoothing and predicts them if set
+    quality_controller* quality = nullptr; // Steps the scale, segmentation and k-means settings through a ladder
+                                        // to keep frames within a deadline if set. Overrides the settings above.
+    int background_learn_frames = 0;    // Frames to learn the background from (see backgroundModel.h). 0 disables it.
+    float background_min_gap = 0;       // See depth_cam::learn_background
+    float background_sigma = 0;
+    float roi_margin = 0;               // Motion margin of the tracking window (meters). 0 processes whole frames.
+    int roi_refresh_frames = 0;         // Process every n-th frame whole even while tracked (see trackingWindow.h)
+    int alloc_check_warmup = -1;        // Frames each stage runs before allocating counts as a violation
+                                        // (see allocCheck.h). Negative disables the check.
+};
+
+/**
+ * @tparam  Config  the tracker configuration (see trackerConfig.h)
+ */
+template<class Config>
+class frame_pipeline
+{
+    public:
+        /**
+         * Starts the capture, segmentation and tracking threads. The camera stream
+         * must already be started and the calibration loaded. Every per-frame buffer
+         * is sized for the largest frame of the rig before the threads start.
+         */
+        void start(void);
+
+        /**
+         * Stops and joins the stage threads. Frames still in flight are discarded.
+         */
+        void stop(void);
+
+        /**
+         * Waits for the next completed frame. Under latest-frame-wins, older completed
+         * frames are released automatically so only the newest one is returned.
+         * The frame must be handed back through release() once it has been consumed.
+         *
+         * @return  the completed frame or nullptr if the pipeline was stopped
+         */
+        pipeline_frame* wait_output(void);
+
+        /**
+         * Hands a frame returned by wait_output back to the pipeline for reuse.
+         * Must be called from the same thread as wait_output.
+         *
+         * @param   frame   the frame to recycle
+         */
+        void release(pipeline_frame* frame);
+
+        /**
+         * @param   rig     the cameras to capture from. Their clouds hold the calibrations.
+         * @param   trk     the tracker to cluster with
+         * @param   left    the left arm, updated from the tracker
+         * @param   right   the right arm, updated from the tracker
+         * @param   config  the stage parameters
+         */
+        frame_pipeline(camera_rig& rig, basic_tracker<Config>& trk, basic_arm<Config>& left, basic_arm<Config>& right,
+                       const pipeline_config& config);
+
+        ~frame_pipeline(void);
+
+    private:
+        static const size_t n_slots = 4;    // Frames in flight. Must be a power of two.
+        typedef spsc_ring<pipeline_frame*, n_slots> frame_ring;
+
+        camera_rig& rig;
+        basic_tracker<Config>& trk;
+        basic_arm<Config>& left;
+        basic_arm<Config>& right;
+        pipeline_config config;
+        voxel_grid voxels;          // Owned by the segmentation thread
+        tracking_window<Config> window; // Owned by the tracking thread
+        fitted_arms<Config> arms;   // Owned by the tracking thread
+        joint_refiner refiner;      // Owned by the tracking thread
+
+        pipeline_frame slots[n_slots];
+        frame_ring free_slots;      // output -> capture
+        frame_ring to_segment;      // capture -> segmentation
+        frame_ring to_track;        // segmentation -> tracking
+        frame_ring to_output;       // tracking -> output
+
+        std::atomic<bool> running;
+        std::thread capture_thread;
+        std::thread segment_thread;
+        std::thread track_thread;
+
+        /**
+         * Sizes the frame slots, the voxel grid, the tracker and the cameras for the
+         * largest frames of the rig, so the stages do not allocate once they run. With a
+         * quality ladder, everything is sized for the most demanding rung, so switching
+         * rungs does not allocate either.
+         */
+        void reserve(void);
+
+        /**
+         * Counts a frame of a stage and starts checking the allocations of the stage
+         * thread once the warm-up is over.
+         *
+         * @param   frames  the frames the stage has handled so far
+         * @param   stage   the name to report violations under
+         */
+        void end_warmup_frame(int& frames, const char* stage);
+
+        void capture_loop(void);
+        void segment_loop(void);
+        void track_loop(void);
+
+        /**
+         * Pops the next frame from the ring, waiting while it is empty.
+         *
+         * @return  the frame or nullptr if the pipeline was stopped
+         */
+        pipeline_frame* wait_pop(frame_ring& ring);
+
+        /**
+         * Pops the next frame a stage should work on. Under latest-frame-wins, any
+         * frames that are already stale are marked as dropped and forwarded.
+         *
+         * @param   in      the input ring of the stage
+         * @param   out     the output ring of the stage
+         * @return  the frame or nullptr if the pipeline was stopped
+         */
+        pipeline_frame* next_input(frame_ring& in, frame_ring& out);
+
+        /**
+         * @return  the stage parameters of the given frame, with the settings of its rung
+         *          of the quality ladder
+         */
+        pipeline_config frame_config(const pipeline_frame* frame) const;
+
+        /**
+         * Refines the hand of the given arm on the unscaled images if it was tracked.
+         */
+        void refine_arm(basic_arm<Config>& a, bool tracked, const std::vector<depth_frame>& views);
+
+        /**
+         * Copies the joints of the given arm into the snapshot.
+         */
+        static void snapshot_arm(basic_arm<Config>& src, bool tracked, arm_snapshot& dst);
+};
+
+#endif
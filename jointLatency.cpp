@@ -0,0 +1,185 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Measures how long a joint record takes from being published into shared
+ * memory until another process observes it. The program forks: the child
+ * publishes records with joint_publisher at a fixed interval, while the
+ * parent polls with the C reader library and histograms observe time minus
+ * publish time.
+ *
+ *   ./joint_latency [--records n] [--interval-us n]
+ */
+
+#define LATENCY_RECORDS 10000
+#define LATENCY_INTERVAL_US 1000
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "jointPublisher.h"
+#include "jointReader.h"
+#include "armSnapshot.h"
+#include "trace.h"
+
+int n_records = LATENCY_RECORDS;
+int interval_us = LATENCY_INTERVAL_US;
+
+/**
+ * Parses the user input. Handles errors such as incorrect argument count, etc.
+ */
+void parse_input(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--records") == 0 && i+1 < argc)
+        {
+            n_records = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--interval-us") == 0 && i+1 < argc)
+        {
+            interval_us = std::max(0, atoi(argv[++i]));
+        }
+        else
+        {
+            printf("Correct Usage: %s [--records n] [--interval-us n]\n", argv[0]);
+            exit(0);
+        }
+    }
+}
+
+/**
+ * The publishing process.
+ */
+int run_publisher(const char* name, int ready_fd)
+{
+    joint_publisher publisher;
+
+    if (!publisher.open(name))
+    {
+        return 1;
+    }
+
+    // Wait for the reader to map the region so the first records are not missed
+    char ready;
+
+    if (read(ready_fd, &ready, 1) != 1)
+    {
+        return 1;
+    }
+
+    arm_snapshot left, right;
+    left.tracked = right.tracked = true;
+
+    for (int i = 0; i < 3; i++)
+    {
+        left.hand[i] = left.elbow[i] = left.shoulder[i] = 0.1f*i;
+        right.hand[i] = right.elbow[i] = right.shoulder[i] = -0.1f*i;
+    }
+
+    for (int i = 0; i < n_records; i++)
+    {
+        left.bend_angle = right.bend_angle = i % 180;
+        int64_t now = joint_publisher::now_ns();
+        publisher.publish(left, right, i, i*33.3, now, now);
+
+        if (interval_us > 0)
+        {
+            usleep(interval_us);
+        }
+    }
+
+    // Give the reader time to see the last record before the region is closed
+    usleep(100000);
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    parse_input(argc, argv);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/arm_pose_latency_%d", (int)getpid());
+
+    int ready_pipe[2];
+
+    if (pipe(ready_pipe) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+        close(ready_pipe[1]);
+        _exit(run_publisher(name, ready_pipe[0]));
+    }
+
+    close(ready_pipe[0]);
+
+    // Wait for the publisher to create the region
+    joint_reader* reader = nullptr;
+
+    for (int attempt = 0; reader == nullptr && attempt < 1000; attempt++)
+    {
+        reader = joint_reader_open(name);
+        usleep(1000);
+    }
+
+    if (reader == nullptr || write(ready_pipe[1], "r", 1) != 1)
+    {
+        fprintf(stderr, "Unable to open the shared memory of the publisher\n");
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+        shm_unlink(name);
+        return 1;
+    }
+
+    latency_histogram latency;
+    joint_shm_record record;
+    int received = 0;
+
+    while (received < n_records)
+    {
+        if (joint_reader_next(reader, &record))
+        {
+            latency.record(joint_publisher::now_ns() - record.publish_ns);
+            received++;
+            continue;
+        }
+
+        if (waitpid(child, nullptr, WNOHANG) == child)
+        {
+            child = 0;
+            break;  // The publisher is gone
+        }
+
+        // Leave the core to the publisher on single-core machines
+        sched_yield();
+    }
+
+    uint64_t missed = joint_reader_missed(reader);
+    joint_reader_close(reader);
+
+    if (child != 0)
+    {
+        waitpid(child, nullptr, 0);
+    }
+
+    // Closing the publisher keeps the region for the next one, and this one is only used once
+    shm_unlink(name);
+
+    printf("{\"records\":%d,\"missed\":%llu,\"mean_ns\":%.0f,\"p50_ns\":%lld,\"p99_ns\":%lld,\"p999_ns\":%lld,\"max_ns\":%lld}\n",
+           received, (unsigned long long)missed, latency.mean(), (long long)latency.percentile(0.5),
+           (long long)latency.percentile(0.99), (long long)latency.percentile(0.999), (long long)latency.max());
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in jointPredictor.h.
+ */
+
+#define PREDICTOR_MAX_GAP 0.5f              // Seconds between updates after which the filters restart
+#define PREDICTOR_OFFSET_LEAK_NS 100000     // How far the clock offset may rise per update, to follow clock drift
+
+#include "jointPredictor.h"
+#include "armSnapshot.h"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * Collects the measured channels of an arm.
+ */
+static void read_channels(const arm_snapshot& arm, float* z)
+{
+    memcpy(z, arm.hand, 3*sizeof(float));
+    memcpy(z+3, arm.elbow, 3*sizeof(float));
+    memcpy(z+6, arm.shoulder, 3*sizeof(float));
+    z[9] = arm.bend_angle;
+}
+
+int64_t joint_predictor::update(arm_snapshot& left, arm_snapshot& right, double sensor_timestamp, int64_t arrival_ns)
+{
+    int64_t sensor_ns = (int64_t)(sensor_timestamp*1e6);
+    float dt = synced ? (sensor_ns-last_sensor_ns)*1e-9f : 0;
+    bool restart = !synced || dt <= 0 || dt > PREDICTOR_MAX_GAP;
+
+    // The frames that arrived fastest are the closest to the true offset
+    int64_t offset = arrival_ns-sensor_ns;
+    clock_offset = synced ? std::min(offset, clock_offset+PREDICTOR_OFFSET_LEAK_NS) : offset;
+    last_sensor_ns = sensor_ns;
+    synced = true;
+
+    filter_arm(left, filters[0], dt, restart);
+    filter_arm(right, filters[1], dt, restart);
+    write_arm(filters[0], 0, left);
+    write_arm(filters[1], 0, right);
+
+    int64_t state_ns = sensor_ns+clock_offset-latency_ns;
+
+    // Mark the state as being written. The fence keeps the state stores after it.
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    published[0] = filters[0];
+    published[1] = filters[1];
+    published_ns = state_ns;
+
+    sequence.store(seq+2, std::memory_order_release);
+
+    return state_ns;
+}
+
+bool joint_predictor::predict(int64_t now_ns, arm_snapshot& left, arm_snapshot& right) const
+{
+    arm_state state[2];
+    int64_t state_ns;
+    uint32_t before;
+
+    for (;;)
+    {
+        before = sequence.load(std::memory_order_acquire);
+
+        if (before & 1)
+        {
+            continue;   // Being written, which only takes a few stores
+        }
+
+        state[0] = published[0];
+        state[1] = published[1];
+        state_ns = published_ns;
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (sequence.load(std::memory_order_relaxed) == before)
+        {
+            break;
+        }
+    }
+
+    if (before == 0)
+    {
+        return false;
+    }
+
+    float dt = std::min(std::max((now_ns-state_ns)*1e-9f, 0.0f), max_horizon);
+    write_arm(state[0], dt, left);
+    write_arm(state[1], dt, right);
+
+    return true;
+}
+
+void joint_predictor::filter_arm(const arm_snapshot& arm, arm_state& state, float dt, bool restart)
+{
+    if (!arm.tracked)
+    {
+        // Hold the last estimate until the arm is found again
+        state.tracked = false;
+        std::fill(state.vel, state.vel+n_channels, 0.0f);
+        std::fill(state.acc, state.acc+n_channels, 0.0f);
+        return;
+    }
+
+    float z[n_channels];
+    read_channels(arm, z);
+
+    if (restart || !state.tracked)
+    {
+        state.tracked = true;
+        memcpy(state.pos, z, sizeof(z));
+        std::fill(state.vel, state.vel+n_channels, 0.0f);
+        std::fill(state.acc, state.acc+n_channels, 0.0f);
+        return;
+    }
+
+    float g_vel = beta/dt;
+    float g_acc = 2*gamma/(dt*dt);
+
+    for (int i = 0; i < n_channels; i++)
+    {
+        // Predict to the measurement, then correct by the residual
+        float pos = state.pos[i] + (state.vel[i] + 0.5f*state.acc[i]*dt)*dt;
+        float vel = state.vel[i] + state.acc[i]*dt;
+        float r = z[i]-pos;
+
+        state.pos[i] = pos + alpha*r;
+        state.vel[i] = vel + g_vel*r;
+        state.acc[i] += g_acc*r;
+    }
+}
+
+void joint_predictor::write_arm(const arm_state& state, float dt, arm_snapshot& arm)
+{
+    float pos[n_channels];
+    float vel[n_channels];
+
+    for (int i = 0; i < n_channels; i++)
+    {
+        pos[i] = state.pos[i] + (state.vel[i] + 0.5f*state.acc[i]*dt)*dt;
+        vel[i] = state.vel[i] + state.acc[i]*dt;
+    }
+
+    arm.tracked = state.tracked;
+
+    memcpy(arm.hand, pos, 3*sizeof(float));
+    memcpy(arm.elbow, pos+3, 3*sizeof(float));
+    memcpy(arm.shoulder, pos+6, 3*sizeof(float));
+    arm.bend_angle = pos[9];
+
+    memcpy(arm.hand_vel, vel, 3*sizeof(float));
+    memcpy(arm.elbow_vel, vel+3, 3*sizeof(float));
+    memcpy(arm.shoulder_vel, vel+6, 3*sizeof(float));
+    arm.bend_rate = vel[9];
+
+    memcpy(arm.hand_acc, state.acc, 3*sizeof(float));
+    memcpy(arm.elbow_acc, state.acc+3, 3*sizeof(float));
+    memcpy(arm.shoulder_acc, state.acc+6, 3*sizeof(float));
+    arm.bend_acc = state.acc[9];
+}
+
+joint_predictor::joint_predictor(float memory, float max_horizon, float latency)
+    : max_horizon(max_horizon), latency_ns((int64_t)(latency*1e9)), last_sensor_ns(0), clock_offset(0), synced(false), sequence(0), published_ns(0)
+{
+    // Gains of the fading-memory filter
+    float theta = std::min(std::max(memory, 0.0f), 0.99f);
+    alpha = 1 - theta*theta*theta;
+    beta = 1.5f*(1-theta)*(1-theta)*(1+theta);
+    gamma = 0.5f*(1-theta)*(1-theta)*(1-theta);
+
+    memset(filters, 0, sizeof(filters));
+    memset(published, 0, sizeof(published));
+}
@@ -0,0 +1,113 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Estimates the motion of the arm joints and predicts where they are now.
+ * Every coordinate of the hand, elbow and shoulder and the bend angle goes
+ * through its own constant-acceleration (alpha-beta-gamma) filter stepped
+ * by the sensor timestamps. The filter gains follow from a single memory
+ * factor (the fading-memory filter), so one number trades noise for lag:
+ * 0 follows the measurements exactly and values towards 1 smooth harder.
+ *
+ * Measurements are already a pipeline delay old when they are filtered, so
+ * the filtered state is stamped with the time the frame was taken, on the
+ * host clock. The offset between the sensor and host clocks is taken from
+ * the frames that arrived fastest, less the transport latency, which has to
+ * be measured once for the camera. Any thread can then ask for the joints
+ * at any time, e.g. from a control loop at a kilohertz. The tracking thread
+ * publishes the state under a sequence lock, so readers never hold it up
+ * and simply retry if they raced with an update.
+ */
+
+#ifndef JOINTPREDICTOR_H
+#define JOINTPREDICTOR_H
+
+#include <atomic>
+#include <stdint.h>
+
+struct arm_snapshot;
+
+class joint_predictor
+{
+    public:
+        /**
+         * Filters the joints of a frame and replaces them with the estimates. Arms that
+         * were not tracked restart their filters once they are tracked again. Must only
+         * be called from one thread at a time.
+         *
+         * @param   left                the left arm, updated in place with positions and rates
+         * @param   right               the right arm, updated in place with positions and rates
+         * @param   sensor_timestamp    the sensor timestamp of the frame (milliseconds)
+         * @param   arrival_ns          when the frame reached the host (trace_now_ns)
+         * @return  when the frame was taken, on the host clock (trace_now_ns)
+         */
+        int64_t update(arm_snapshot& left, arm_snapshot& right, double sensor_timestamp, int64_t arrival_ns);
+
+        /**
+         * Predicts the joints at the given time from the last update. Can be called from
+         * any thread at any rate. Arms that were not tracked at the last update are
+         * returned as they were then.
+         *
+         * @param   now_ns  the time to predict for (trace_now_ns)
+         * @param   left    the left arm (output)
+         * @param   right   the right arm (output)
+         * @return  false if there has been no update yet
+         */
+        bool predict(int64_t now_ns, arm_snapshot& left, arm_snapshot& right) const;
+
+        /**
+         * @param   memory          the fading-memory factor of the filters, from 0 (no
+         *                          smoothing) to below 1
+         * @param   max_horizon     the furthest to predict past the last update (seconds)
+         * @param   latency         the delay between the exposure and the arrival of the fastest
+         *                          frames (seconds), which the timestamps cannot tell
+         */
+        joint_predictor(float memory, float max_horizon, float latency);
+
+    private:
+        static const int n_channels = 10;   // x, y and z of the hand, elbow and shoulder, then the bend angle
+
+        /**
+         * The filters of one arm.
+         */
+        struct arm_state
+        {
+            bool tracked;
+            float pos[n_channels];
+            float vel[n_channels];
+            float acc[n_channels];
+        };
+
+        float alpha;                // Filter gains
+        float beta;
+        float gamma;
+        float max_horizon;
+        int64_t latency_ns;
+
+        // Tracking thread only
+        arm_state filters[2];
+        int64_t last_sensor_ns;     // Sensor time of the last update (nanoseconds)
+        int64_t clock_offset;       // Host time minus sensor time of the fastest frames
+        bool synced;                // Whether or not there has been an update
+
+        // Published under the sequence lock: odd while the tracking thread writes
+        std::atomic<uint32_t> sequence;
+        arm_state published[2];
+        int64_t published_ns;
+
+        /**
+         * Steps the filters of an arm to a new measurement, or restarts them on it.
+         *
+         * @param   arm     the measured arm
+         * @param   state   the filters
+         * @param   dt      the seconds since the last update
+         * @param   restart whether or not to restart every filter
+         */
+        void filter_arm(const arm_snapshot& arm, arm_state& state, float dt, bool restart);
+
+        /**
+         * Writes the state of an arm, carried forward by dt seconds, into a snapshot.
+         */
+        static void write_arm(const arm_state& state, float dt, arm_snapshot& arm);
+};
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in jointPublisher.h.
+ */
+
+#include "jointPublisher.h"
+#include "armSnapshot.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+bool joint_publisher::open(const char* name)
+{
+    close();
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+
+    if (fd < 0)
+    {
+        perror("Unable to create the joint shared memory");
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(joint_shm_region)) != 0)
+    {
+        perror("Unable to size the joint shared memory");
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, sizeof(joint_shm_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        perror("Unable to map the joint shared memory");
+        return false;
+    }
+
+    region = (joint_shm_region*)mapping;
+
+    // Readers ignore the region until the magic is stored last
+    __atomic_store_n(&region->magic, 0, __ATOMIC_RELEASE);
+    memset(region->slots, 0, sizeof(region->slots));
+    region->version = JOINT_SHM_VERSION;
+    region->n_slots = JOINT_SHM_SLOTS;
+    region->slot_size = sizeof(joint_shm_slot);
+    region->publisher_pid = getpid();
+    __atomic_store_n(&region->head, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&region->magic, JOINT_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    published = 0;
+
+    return true;
+}
+
+void joint_publisher::close(void)
+{
+    if (region == nullptr)
+    {
+        return;
+    }
+
+    // The region stays, so readers that have it mapped pick up the next publisher
+    __atomic_store_n(&region->magic, 0, __ATOMIC_RELEASE);
+    munmap(region, sizeof(joint_shm_region));
+    region = nullptr;
+}
+
+void joint_publisher::publish(const arm_snapshot& left, const arm_snapshot& right, uint64_t frame_number,
+                              double sensor_timestamp, int64_t arrival_ns, int64_t state_ns)
+{
+    if (region == nullptr)
+    {
+        return;
+    }
+
+    uint64_t sequence = ++published;
+    joint_shm_slot& slot = region->slots[(sequence-1) & (JOINT_SHM_SLOTS-1)];
+
+    // Mark the slot as being written. The fence keeps the record stores after it.
+    uint64_t lock = slot.lock;
+    __atomic_store_n(&slot.lock, lock+1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    joint_shm_record& record = slot.record;
+    record.sequence = sequence;
+    record.frame_number = frame_number;
+    record.sensor_timestamp = sensor_timestamp;
+    record.arrival_ns = arrival_ns;
+    record.state_ns = state_ns;
+    copy_arm(left, record.left);
+    copy_arm(right, record.right);
+    record.publish_ns = now_ns();
+
+    // Complete the slot, then make it the newest record
+    __atomic_store_n(&slot.lock, lock+2, __ATOMIC_RELEASE);
+    __atomic_store_n(&region->head, sequence, __ATOMIC_RELEASE);
+}
+
+int64_t joint_publisher::now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+void joint_publisher::copy_arm(const arm_snapshot& src, joint_shm_arm& dst)
+{
+    dst.tracked = src.tracked;
+    dst.bend_angle = src.bend_angle;
+    dst.bend_rate = src.bend_rate;
+    dst.bend_acc = src.bend_acc;
+
+    for (int i = 0; i < 3; i++)
+    {
+        dst.hand[i] = src.hand[i];
+        dst.elbow[i] = src.elbow[i];
+        dst.shoulder[i] = src.shoulder[i];
+        dst.hand_vel[i] = src.hand_vel[i];
+        dst.elbow_vel[i] = src.elbow_vel[i];
+        dst.shoulder_vel[i] = src.shoulder_vel[i];
+        dst.hand_acc[i] = src.hand_acc[i];
+        dst.elbow_acc[i] = src.elbow_acc[i];
+        dst.shoulder_acc[i] = src.shoulder_acc[i];
+    }
+}
+
+joint_publisher::joint_publisher(void)
+{
+    region = nullptr;
+    published = 0;
+}
+
+joint_publisher::~joint_publisher(void)
+{
+    close();
+}
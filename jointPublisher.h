@@ -0,0 +1,65 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Publishes the joints of both arms to other processes through the POSIX
+ * shared-memory ring described in jointShm.h. Records are written straight
+ * into the shared mapping, so publishing costs a few stores and never
+ * waits on a reader. Readers use the C library in jointReader.h.
+ */
+
+#ifndef JOINTPUBLISHER_H
+#define JOINTPUBLISHER_H
+
+#include <stdint.h>
+#include "jointShm.h"
+
+struct arm_snapshot;
+
+class joint_publisher
+{
+    public:
+        /**
+         * Creates (or takes over) the shared-memory region.
+         *
+         * @param   name    the POSIX shared-memory name, e.g. JOINT_SHM_NAME
+         * @return  whether or not the region could be created and mapped
+         */
+        bool open(const char* name);
+
+        /**
+         * Marks the region as no longer published and unmaps it. The region itself is
+         * kept, so readers that have it mapped see records again once pose restarts
+         * and opens it under the same name.
+         */
+        void close(void);
+
+        /**
+         * Writes the next record. Must only be called from one thread at a time.
+         *
+         * @param   left                the left arm
+         * @param   right               the right arm
+         * @param   frame_number        the sensor frame counter of the frame the joints came from
+         * @param   sensor_timestamp    the sensor timestamp of that frame (milliseconds)
+         * @param   arrival_ns          when that frame reached the host (CLOCK_MONOTONIC)
+         * @param   state_ns            when the joints were where the snapshots say (CLOCK_MONOTONIC)
+         */
+        void publish(const arm_snapshot& left, const arm_snapshot& right, uint64_t frame_number,
+                     double sensor_timestamp, int64_t arrival_ns, int64_t state_ns);
+
+        /**
+         * @return  the current time on the clock used for publish_ns (CLOCK_MONOTONIC, nanoseconds)
+         */
+        static int64_t now_ns(void);
+
+        joint_publisher(void);
+
+        ~joint_publisher(void);
+
+    private:
+        joint_shm_region* region;   // The shared mapping, nullptr if not open
+        uint64_t published;         // Records written so far
+
+        static void copy_arm(const arm_snapshot& src, joint_shm_arm& dst);
+};
+
+#endif
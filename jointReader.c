@@ -0,0 +1,253 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in jointReader.h.
+ */
+
+#include "jointReader.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* A slot that stays locked this long belongs to a publisher that died mid-write */
+#define JOINT_READER_MAX_SPINS 1000000
+
+struct joint_reader
+{
+    const joint_shm_region* region;
+    uint64_t last_sequence;     /* The last record returned by joint_reader_next */
+    uint32_t publisher_pid;     /* The publisher last_sequence belongs to */
+    uint64_t missed;            /* Records skipped because they were overwritten */
+};
+
+/**
+ * Copies record number sequence out of its slot.
+ *
+ * @return  1 if the copy is consistent and holds that record, 0 if it was overwritten
+ *          or the slot never became readable
+ */
+static int read_slot(const joint_shm_region* region, uint64_t sequence, joint_shm_record* out)
+{
+    const joint_shm_slot* slot = &region->slots[(sequence-1) & (JOINT_SHM_SLOTS-1)];
+    int spins;
+
+    for (spins = 0; spins < JOINT_READER_MAX_SPINS; spins++)
+    {
+        uint64_t before = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+
+        if (before & 1)
+        {
+            continue;   /* Being written, which only takes a few stores */
+        }
+
+        memcpy(out, &slot->record, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&slot->lock, __ATOMIC_RELAXED) == before)
+        {
+            return out->sequence == sequence;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Moves one joint forward by dt seconds at constant acceleration.
+ */
+static void predict_joint(float* pos, float* vel, const float* acc, float dt)
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        pos[i] += (vel[i] + 0.5f*acc[i]*dt)*dt;
+        vel[i] += acc[i]*dt;
+    }
+}
+
+/**
+ * Moves the joints and bend angle of a tracked arm forward by dt seconds.
+ */
+static void predict_arm(joint_shm_arm* arm, float dt)
+{
+    if (!arm->tracked)
+    {
+        return;
+    }
+
+    predict_joint(arm->hand, arm->hand_vel, arm->hand_acc, dt);
+    predict_joint(arm->elbow, arm->elbow_vel, arm->elbow_acc, dt);
+    predict_joint(arm->shoulder, arm->shoulder_vel, arm->shoulder_acc, dt);
+    arm->bend_angle += (arm->bend_rate + 0.5f*arm->bend_acc*dt)*dt;
+    arm->bend_rate += arm->bend_acc*dt;
+}
+
+joint_reader* joint_reader_open(const char* name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    struct stat info;
+    void* mapping;
+    joint_reader* reader;
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(joint_shm_region))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    mapping = mmap(NULL, sizeof(joint_shm_region), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    reader = (joint_reader*)calloc(1, sizeof(joint_reader));
+
+    if (reader == NULL)
+    {
+        munmap(mapping, sizeof(joint_shm_region));
+        return NULL;
+    }
+
+    reader->region = (const joint_shm_region*)mapping;
+
+    /* The layout is checked as soon as a publisher has initialized it */
+    if (__atomic_load_n(&reader->region->magic, __ATOMIC_ACQUIRE) == JOINT_SHM_MAGIC &&
+        (reader->region->version != JOINT_SHM_VERSION || reader->region->n_slots != JOINT_SHM_SLOTS ||
+         reader->region->slot_size != sizeof(joint_shm_slot)))
+    {
+        joint_reader_close(reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+int joint_reader_latest(joint_reader* reader, joint_shm_record* out)
+{
+    const joint_shm_region* region = reader->region;
+
+    for (;;)
+    {
+        uint64_t head;
+
+        if (__atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) != JOINT_SHM_MAGIC)
+        {
+            return 0;
+        }
+
+        head = __atomic_load_n(&region->head, __ATOMIC_ACQUIRE);
+
+        if (head == 0)
+        {
+            return 0;
+        }
+
+        if (read_slot(region, head, out))
+        {
+            return 1;
+        }
+
+        /* Normally the publisher lapped the ring meanwhile, so retry with the new head */
+        if (__atomic_load_n(&region->head, __ATOMIC_ACQUIRE) == head)
+        {
+            return 0;
+        }
+    }
+}
+
+int joint_reader_next(joint_reader* reader, joint_shm_record* out)
+{
+    const joint_shm_region* region = reader->region;
+
+    for (;;)
+    {
+        uint64_t head, oldest, sequence;
+
+        if (__atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) != JOINT_SHM_MAGIC)
+        {
+            return 0;
+        }
+
+        head = __atomic_load_n(&region->head, __ATOMIC_ACQUIRE);
+
+        /* A restarted publisher reuses the region and counts from 1 again */
+        if (region->publisher_pid != reader->publisher_pid || head < reader->last_sequence)
+        {
+            reader->publisher_pid = region->publisher_pid;
+            reader->last_sequence = 0;
+        }
+
+        if (head == reader->last_sequence)
+        {
+            return 0;
+        }
+
+        oldest = head > JOINT_SHM_SLOTS ? head-JOINT_SHM_SLOTS+1 : 1;
+        sequence = reader->last_sequence+1;
+
+        if (sequence < oldest)
+        {
+            reader->missed += oldest-sequence;
+            sequence = oldest;
+        }
+
+        if (read_slot(region, sequence, out))
+        {
+            reader->last_sequence = sequence;
+            return 1;
+        }
+
+        /* Overwritten while copying, so it counts as missed on the next pass */
+        if (__atomic_load_n(&region->head, __ATOMIC_ACQUIRE) == head)
+        {
+            return 0;
+        }
+    }
+}
+
+int joint_reader_predict(joint_reader* reader, int64_t now_ns, float max_horizon, joint_shm_record* out)
+{
+    float dt;
+
+    if (!joint_reader_latest(reader, out))
+    {
+        return 0;
+    }
+
+    dt = (float)((now_ns - out->state_ns)*1e-9);
+    dt = dt < 0 ? 0 : (dt > max_horizon ? max_horizon : dt);
+
+    predict_arm(&out->left, dt);
+    predict_arm(&out->right, dt);
+    out->state_ns += (int64_t)(dt*1e9);
+
+    return 1;
+}
+
+uint64_t joint_reader_missed(const joint_reader* reader)
+{
+    return reader->missed;
+}
+
+void joint_reader_close(joint_reader* reader)
+{
+    if (reader == NULL)
+    {
+        return;
+    }
+
+    munmap((void*)reader->region, sizeof(joint_shm_region));
+    free(reader);
+}
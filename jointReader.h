@@ -0,0 +1,100 @@
+/**
+ * Author: Adam Mooers
+ *
+ * C library for reading the joints pose publishes through shared memory
+ * (see jointShm.h). Reading never blocks the publisher: a reader that
+ * races with a write simply retries. Link with libjointreader.a (and -lrt
+ * on older glibc).
+ *
+ *   joint_reader* reader = joint_reader_open(JOINT_SHM_NAME);
+ *   joint_shm_record record;
+ *
+ *   while (running)
+ *   {
+ *       if (joint_reader_next(reader, &record) > 0)
+ *       {
+ *           use(record.left.hand, record.left.bend_angle, ...);
+ *       }
+ *   }
+ *
+ *   joint_reader_close(reader);
+ */
+
+#ifndef JOINTREADER_H
+#define JOINTREADER_H
+
+#include "jointShm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct joint_reader joint_reader;
+
+/**
+ * Maps the shared-memory region for reading. The first publisher creates the
+ * region and it outlives the publisher, so once pose has run the reader can
+ * be opened whether or not it is still running. A publisher that stops and
+ * starts again reuses the region, and the reader picks up its records
+ * without being reopened.
+ *
+ * @param   name    the POSIX shared-memory name, e.g. JOINT_SHM_NAME
+ * @return  the reader, or NULL if no publisher has created the region yet or it has
+ *          the wrong layout
+ */
+joint_reader* joint_reader_open(const char* name);
+
+/**
+ * Copies out the newest record.
+ *
+ * @param   reader  the reader
+ * @param   out     the record (output)
+ * @return  1 if a record was copied, 0 if nothing has been published yet or the
+ *          publisher is not running
+ */
+int joint_reader_latest(joint_reader* reader, joint_shm_record* out);
+
+/**
+ * Copies out the record after the last one this reader returned. If the
+ * reader fell so far behind that the record was overwritten, it skips
+ * ahead to the oldest record still available.
+ *
+ * @param   reader  the reader
+ * @param   out     the record (output)
+ * @return  1 if a record was copied, 0 if there is no newer record yet or the
+ *          publisher is not running
+ */
+int joint_reader_next(joint_reader* reader, joint_shm_record* out);
+
+/**
+ * Copies out the newest record with the joints of the tracked arms carried
+ * forward to the given time along their estimated velocity and acceleration.
+ * Cheap enough to call from a control loop running at a kilohertz or more.
+ * Without the joint predictor in pose the rates are zero and the joints are
+ * returned as published.
+ *
+ * @param   reader          the reader
+ * @param   now_ns          the time to predict for (CLOCK_MONOTONIC, nanoseconds)
+ * @param   max_horizon     the furthest to predict past the state of the record (seconds),
+ *                          so a stalled publisher does not send the joints flying off
+ * @param   out             the record (output). state_ns is the time predicted for.
+ * @return  1 if a record was copied, 0 if nothing has been published yet or the
+ *          publisher is not running
+ */
+int joint_reader_predict(joint_reader* reader, int64_t now_ns, float max_horizon, joint_shm_record* out);
+
+/**
+ * @return  the number of records this reader skipped because they were overwritten
+ */
+uint64_t joint_reader_missed(const joint_reader* reader);
+
+/**
+ * Unmaps the region and frees the reader.
+ */
+void joint_reader_close(joint_reader* reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
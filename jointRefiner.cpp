@@ -0,0 +1,169 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in jointRefiner.h.
+ */
+
+#define REFINE_HAND_LENGTH 0.08f    // Meters from the end of the arm that make up the hand
+#define REFINE_TIP_OUTLIERS 50      // One in this many points may lie past the end of the arm (flying pixels)
+#define REFINE_MIN_DEPTH 0.1f       // Meters. Keeps the windows of joints close to the camera bounded.
+
+#include "jointRefiner.h"
+#include <algorithm>
+#include <cmath>
+
+bool joint_refiner::refine(camera_rig& rig, const std::vector<depth_frame>& views, float* hand, const float* elbow)
+{
+    float axis[3] = {hand[0]-elbow[0], hand[1]-elbow[1], hand[2]-elbow[2]};
+    float length = sqrtf(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+
+    if (!enabled() || length <= 0)
+    {
+        return false;
+    }
+
+    for (int j = 0; j < 3; j++)
+    {
+        axis[j] /= length;
+    }
+
+    int n = gather(rig, views, hand);
+
+    if (n < min_points)
+    {
+        return false;
+    }
+
+    // Find the end of the arm along the forearm, past all but the stray points
+    int n_outliers = n/REFINE_TIP_OUTLIERS;
+    along.resize(n);
+
+    for (int i = 0; i < n; i++)
+    {
+        const float* p = &near[3*i];
+        along[i] = (p[0]-hand[0])*axis[0] + (p[1]-hand[1])*axis[1] + (p[2]-hand[2])*axis[2];
+    }
+
+    std::nth_element(along.begin(), along.begin()+(n-1-n_outliers), along.begin()+n);
+    float t_end = along[n-1-n_outliers];
+
+    // The hand is the centroid of the last hand length of the arm
+    double sum[3] = {0, 0, 0};
+    int count = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        const float* p = &near[3*i];
+        float t = (p[0]-hand[0])*axis[0] + (p[1]-hand[1])*axis[1] + (p[2]-hand[2])*axis[2];
+
+        if (t >= t_end-REFINE_HAND_LENGTH && t <= t_end)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                sum[j] += p[j];
+            }
+
+            count++;
+        }
+    }
+
+    if (count < min_points)
+    {
+        return false;
+    }
+
+    for (int j = 0; j < 3; j++)
+    {
+        hand[j] = (float)(sum[j]/count);
+    }
+
+    return true;
+}
+
+int joint_refiner::gather(camera_rig& rig, const std::vector<depth_frame>& views, const float* center)
+{
+    int n = 0;
+    float radius_sq = radius*radius;
+
+    for (int v = 0; v < (int)views.size() && v < rig.size(); v++)
+    {
+        const depth_frame& f = views[v];
+        depth_cam& cam = rig.camera(v);
+        float pixel[2], depth;
+
+        if (f.full_depth.empty() || !cam.project(center, pixel, depth))
+        {
+            continue;
+        }
+
+        // The box the sphere around the joint projects into, at its near side
+        float near_depth = std::max(depth-radius, REFINE_MIN_DEPTH);
+        float reach_x = radius*f.intrin.fx/near_depth;
+        float reach_y = radius*f.intrin.fy/near_depth;
+        int x0 = (int)floorf(std::max(pixel[0]-reach_x, 0.0f));
+        int y0 = (int)floorf(std::max(pixel[1]-reach_y, 0.0f));
+        int x1 = (int)ceilf(std::min(pixel[0]+reach_x, (float)f.intrin.width));
+        int y1 = (int)ceilf(std::min(pixel[1]+reach_y, (float)f.intrin.height));
+        cv::Rect window = cv::Rect(x0, y0, std::max(x1-x0, 0), std::max(y1-y0, 0)) & depth_cam::full_window(f);
+
+        if (window.area() == 0)
+        {
+            continue;
+        }
+
+        if (near.size() < 3*(size_t)(n+window.area()))
+        {
+            near.resize(3*(n+window.area()));
+        }
+
+        float rotation[9], translation[3];
+        cam.cloud.get_calibration(rotation, translation);
+
+        // Only pixels in the depth range of the sphere are deprojected
+        float d_min = (depth-radius)/f.depth_scale;
+        float d_max = (depth+radius)/f.depth_scale;
+
+        for (int i = window.y; i < window.y+window.height; i++)
+        {
+            const uint16_t* row = f.full_depth.ptr<uint16_t>(i);
+
+            for (int j = window.x; j < window.x+window.width; j++)
+            {
+                if (row[j] == 0 || row[j] < d_min || row[j] > d_max)
+                {
+                    continue;
+                }
+
+                rs::float2 depth_pixel = {(float)j, (float)i};
+                rs::float3 p = f.intrin.deproject(depth_pixel, row[j]*f.depth_scale);
+
+                // Calibrate (row vector convention, p*R + t)
+                float* out = &near[3*n];
+                out[0] = p.x*rotation[0] + p.y*rotation[3] + p.z*rotation[6] + translation[0];
+                out[1] = p.x*rotation[1] + p.y*rotation[4] + p.z*rotation[7] + translation[1];
+                out[2] = p.x*rotation[2] + p.y*rotation[5] + p.z*rotation[8] + translation[2];
+
+                float dx = out[0]-center[0];
+                float dy = out[1]-center[1];
+                float dz = out[2]-center[2];
+
+                if (dx*dx + dy*dy + dz*dz <= radius_sq)
+                {
+                    n++;
+                }
+            }
+        }
+    }
+
+    return n;
+}
+
+void joint_refiner::reserve(int max_pixels)
+{
+    near.reserve(3*max_pixels);
+    along.reserve(max_pixels);
+}
+
+joint_refiner::joint_refiner(float radius, int min_points) : radius(radius), min_points(min_points)
+{
+}
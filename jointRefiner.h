@@ -0,0 +1,81 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Refines the hand of a tracked arm at the full resolution of the depth
+ * camera. Tracking runs on images scaled down for speed, so the hand is
+ * quantized to the cluster centers of a sparse cloud. Once an arm is found,
+ * the hand is projected into the unscaled image of every camera and only the
+ * pixels within a small window around it are deprojected: the ones within
+ * the refinement radius of the hand are kept. The hand is the end of the
+ * arm, so these points are searched for the extremity along the forearm,
+ * and the hand is moved to the centroid of the last hand length of the arm.
+ *
+ * The elbow is left as tracked. It is in the middle of the arm, where the
+ * centroid of the points around it is pulled into the bend, and it came
+ * out further from the true elbow than the coarse one.
+ *
+ * The windows are a few thousand pixels however large the image is, so the
+ * refinement costs little next to tracking. The cameras keep the unscaled
+ * image of their tracking window for it (see depth_cam::keep_full_depth).
+ */
+
+#ifndef JOINTREFINER_H
+#define JOINTREFINER_H
+
+#include <vector>
+#include "cameraRig.h"
+
+class joint_refiner
+{
+    public:
+        /**
+         * Refines the hand of a tracked arm in place. A hand with too few points around
+         * it keeps its coarse position.
+         *
+         * @param   rig     the cameras the views were captured from
+         * @param   views   the frames of the cameras, with their unscaled images
+         * @param   hand    the hand (calibrated), refined in place
+         * @param   elbow   the elbow (calibrated), which gives the direction of the forearm
+         * @return  whether or not the hand was refined
+         */
+        bool refine(camera_rig& rig, const std::vector<depth_frame>& views, float* hand, const float* elbow);
+
+        /**
+         * @return  whether or not hands are refined
+         */
+        bool enabled(void) const
+        {
+            return radius > 0;
+        }
+
+        /**
+         * Sizes the scratch for the largest windows, so refining does not allocate once
+         * it is running.
+         *
+         * @param   max_pixels  the most pixels the unscaled images of a frame have together
+         */
+        void reserve(int max_pixels);
+
+        /**
+         * @param   radius      how far from the coarse hand points are refined from (meters).
+         *                      0 disables the refinement.
+         * @param   min_points  the fewest points the hand is refined from
+         */
+        joint_refiner(float radius, int min_points);
+
+    private:
+        float radius;
+        int min_points;
+        std::vector<float> near;    // The points around the hand, x, y and z interleaved
+        std::vector<float> along;   // How far each point around the hand is along the forearm
+
+        /**
+         * Deprojects the pixels of every view within the radius of the given point into near.
+         *
+         * @param   center  the calibrated point
+         * @return  the number of points found
+         */
+        int gather(camera_rig& rig, const std::vector<depth_frame>& views, const float* center);
+};
+
+#endif
@@ -0,0 +1,92 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Layout of the POSIX shared-memory region that pose publishes the joints
+ * of both arms through. Shared between the C++ publisher (jointPublisher.h)
+ * and the C reader library (jointReader.h), so this header is plain C.
+ *
+ * The region holds a ring of fixed-size records. Each slot is guarded by
+ * its own sequence lock: the counter is odd while the publisher writes the
+ * slot and even once the record is complete, so readers never block the
+ * publisher and simply retry if they raced with a write. head counts the
+ * records published so far; record n lives in slot (n-1) % JOINT_SHM_SLOTS.
+ *
+ * All times are on CLOCK_MONOTONIC (nanoseconds), so they can be compared
+ * between processes on the same machine.
+ */
+
+#ifndef JOINTSHM_H
+#define JOINTSHM_H
+
+#include <stdint.h>
+
+#define JOINT_SHM_NAME "/arm_pose_joints"
+#define JOINT_SHM_MAGIC 0x4a4f494e54534d31ull   /* "JOINTSM1" */
+#define JOINT_SHM_VERSION 2
+#define JOINT_SHM_SLOTS 64                      /* Must be a power of two */
+
+/**
+ * The joints of one arm. Coordinates are in the calibrated frame, in meters.
+ * The rates are estimated by the joint predictor (see jointPredictor.h) and
+ * are zero when pose runs without it.
+ */
+typedef struct
+{
+    uint32_t tracked;           /* 1 if the arm was tracked in this frame, 0 otherwise */
+    float hand[3];
+    float elbow[3];
+    float shoulder[3];
+    float bend_angle;           /* Degrees */
+    float hand_vel[3];          /* m/s */
+    float elbow_vel[3];
+    float shoulder_vel[3];
+    float hand_acc[3];          /* m/s^2 */
+    float elbow_acc[3];
+    float shoulder_acc[3];
+    float bend_rate;            /* Degrees/s */
+    float bend_acc;             /* Degrees/s^2 */
+} joint_shm_arm;
+
+/**
+ * Everything published for one frame.
+ */
+typedef struct
+{
+    uint64_t sequence;          /* Record number, starting at 1 */
+    uint64_t frame_number;      /* Sensor frame counter */
+    double sensor_timestamp;    /* Sensor timestamp (milliseconds, device clock) */
+    int64_t arrival_ns;         /* When the depth frame reached the host */
+    int64_t publish_ns;         /* When the record was published */
+    int64_t state_ns;           /* When the joints were where the record says: the sensor
+                                   timestamp on the host clock, or arrival_ns without the predictor */
+    joint_shm_arm left;
+    joint_shm_arm right;
+} joint_shm_record;
+
+/**
+ * One ring entry, padded to whole cache lines so slots never share one.
+ */
+typedef struct
+{
+    uint64_t lock;              /* Sequence lock: odd while the record is being written */
+    joint_shm_record record;
+    uint8_t pad[64 - (sizeof(uint64_t) + sizeof(joint_shm_record)) % 64];
+} joint_shm_slot;
+
+/**
+ * The whole shared-memory region.
+ */
+typedef struct
+{
+    uint64_t magic;             /* JOINT_SHM_MAGIC once the region is initialized */
+    uint32_t version;           /* JOINT_SHM_VERSION */
+    uint32_t n_slots;           /* JOINT_SHM_SLOTS */
+    uint32_t slot_size;         /* sizeof(joint_shm_slot) */
+    uint32_t publisher_pid;
+    uint8_t pad0[64 - 2*sizeof(uint64_t) - 2*sizeof(uint32_t)];
+    uint64_t head;              /* Records published so far */
+    uint8_t pad1[64 - sizeof(uint64_t)];
+    joint_shm_slot slots[JOINT_SHM_SLOTS];
+} joint_shm_region;
+
+#endif
@@ -0,0 +1,433 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in kmeans3d.h.
+ */
+
+#include "kmeans3d.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Padding centers sit far away so they never win the nearest-center search
+#define KMEANS_FAR_AWAY 1e15f
+
+template<int K>
+double kmeans_3d<K>::cluster(const float* points, int n, int attempts, int max_iter, double epsilon,
+                             float* centers, int32_t* labels, bool warm)
+{
+    attempts = std::max(attempts, 1);
+    run_count++;
+
+    if ((int)states.size() < attempts)
+    {
+        states.resize(attempts);
+    }
+
+    auto run = [&](int attempt)
+    {
+        attempt_state& st = states[attempt];
+        resize_state(st, n);
+        st.rng = (uint32_t)(attempt+1)*2654435761u ^ run_count*40503u;
+
+        // The previous frame's centers are the best guess for this frame
+        run_attempt(st, points, n, max_iter, epsilon, (warm && attempt == 0) ? centers : nullptr);
+    };
+
+    if (workers)
+    {
+        workers->run(attempts, run);
+    }
+    else
+    {
+        for (int attempt = 0; attempt < attempts; attempt++)
+        {
+            run(attempt);
+        }
+    }
+
+    // Keep the most compact result
+    int best = 0;
+
+    for (int attempt = 1; attempt < attempts; attempt++)
+    {
+        if (states[attempt].compactness < states[best].compactness)
+        {
+            best = attempt;
+        }
+    }
+
+    const attempt_state& st = states[best];
+    const int kk = num_clusters();
+
+    for (int c = 0; c < kk; c++)
+    {
+        centers[3*c] = st.cx[c];
+        centers[3*c+1] = st.cy[c];
+        centers[3*c+2] = st.cz[c];
+    }
+
+    memcpy(labels, st.labels.data(), n*sizeof(int32_t));
+
+    return st.compactness;
+}
+
+template<int K>
+void kmeans_3d<K>::run_attempt(attempt_state& st, const float* points, int n, int max_iter,
+                               double epsilon, const float* init)
+{
+    const int kk = num_clusters();
+    const int kp = K > 0 ? k_padded_fixed : k_padded;
+
+    if (init)
+    {
+        for (int c = 0; c < kk; c++)
+        {
+            st.cx[c] = init[3*c];
+            st.cy[c] = init[3*c+1];
+            st.cz[c] = init[3*c+2];
+        }
+    }
+    else
+    {
+        seed_centers(st, points, n);
+    }
+
+    for (int c = kk; c < kp; c++)
+    {
+        st.cx[c] = st.cy[c] = st.cz[c] = KMEANS_FAR_AWAY;
+    }
+
+    // Exact initial assignment sets up the bounds
+    for (int i = 0; i < n; i++)
+    {
+        int best;
+        float best_sq, second_sq;
+        nearest_centers(st, points+3*i, best, best_sq, second_sq);
+
+        st.labels[i] = best;
+        st.upper[i] = sqrtf(best_sq);
+        st.lower[i] = sqrtf(second_sq);
+    }
+
+    for (int iter = 0; iter < max_iter; iter++)
+    {
+        // Move each center to the mean of its points
+        for (int c = 0; c < kk; c++)
+        {
+            st.sum_x[c] = st.sum_y[c] = st.sum_z[c] = 0;
+            st.counts[c] = 0;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            int c = st.labels[i];
+            st.sum_x[c] += points[3*i];
+            st.sum_y[c] += points[3*i+1];
+            st.sum_z[c] += points[3*i+2];
+            st.counts[c]++;
+        }
+
+        float max_shift = 0, second_shift = 0;
+        int max_shift_ind = -1;
+
+        for (int c = 0; c < kk; c++)
+        {
+            float nx, ny, nz;
+
+            if (st.counts[c] > 0)
+            {
+                float inv = 1.0f/st.counts[c];
+                nx = st.sum_x[c]*inv;
+                ny = st.sum_y[c]*inv;
+                nz = st.sum_z[c]*inv;
+            }
+            else
+            {
+                // Empty cluster: restart it on the point furthest from its own center
+                int far_ind = 0;
+                float far_dist = -1;
+
+                for (int i = 0; i < n; i++)
+                {
+                    if (st.upper[i] > far_dist && st.upper[i] < FLT_MAX)
+                    {
+                        far_dist = st.upper[i];
+                        far_ind = i;
+                    }
+                }
+
+                nx = points[3*far_ind];
+                ny = points[3*far_ind+1];
+                nz = points[3*far_ind+2];
+
+                // Force a full search for the point and keep it from being picked twice
+                st.upper[far_ind] = FLT_MAX;
+            }
+
+            float dx = nx-st.cx[c], dy = ny-st.cy[c], dz = nz-st.cz[c];
+            st.shift[c] = sqrtf(dx*dx + dy*dy + dz*dz);
+            st.cx[c] = nx;
+            st.cy[c] = ny;
+            st.cz[c] = nz;
+
+            if (st.shift[c] > max_shift)
+            {
+                second_shift = max_shift;
+                max_shift = st.shift[c];
+                max_shift_ind = c;
+            }
+            else if (st.shift[c] > second_shift)
+            {
+                second_shift = st.shift[c];
+            }
+        }
+
+        // Loosen the bounds by how far the centers moved
+        for (int i = 0; i < n; i++)
+        {
+            int c = st.labels[i];
+            st.upper[i] += st.shift[c];
+            st.lower[i] -= (c == max_shift_ind) ? second_shift : max_shift;
+        }
+
+        // A point can only change cluster if it is further than half the separation
+        for (int c = 0; c < kk; c++)
+        {
+            float closest_sq = FLT_MAX;
+
+            for (int o = 0; o < kk; o++)
+            {
+                float dx = st.cx[c]-st.cx[o], dy = st.cy[c]-st.cy[o], dz = st.cz[c]-st.cz[o];
+                float d_sq = dx*dx + dy*dy + dz*dz;
+
+                if (o != c && d_sq < closest_sq)
+                {
+                    closest_sq = d_sq;
+                }
+            }
+
+            st.half_sep[c] = 0.5f*sqrtf(closest_sq);
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            int c = st.labels[i];
+            float bound = std::max(st.half_sep[c], st.lower[i]);
+
+            if (st.upper[i] <= bound)
+            {
+                continue;
+            }
+
+            // Tighten the upper bound and try again before searching all centers
+            const float* p = points+3*i;
+            float dx = p[0]-st.cx[c], dy = p[1]-st.cy[c], dz = p[2]-st.cz[c];
+            st.upper[i] = sqrtf(dx*dx + dy*dy + dz*dz);
+
+            if (st.upper[i] <= bound)
+            {
+                continue;
+            }
+
+            int best;
+            float best_sq, second_sq;
+            nearest_centers(st, p, best, best_sq, second_sq);
+
+            st.labels[i] = best;
+            st.upper[i] = sqrtf(best_sq);
+            st.lower[i] = sqrtf(second_sq);
+        }
+
+        if (max_shift <= epsilon)
+        {
+            break;
+        }
+    }
+
+    st.compactness = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        int c = st.labels[i];
+        float dx = points[3*i]-st.cx[c], dy = points[3*i+1]-st.cy[c], dz = points[3*i+2]-st.cz[c];
+        st.compactness += dx*dx + dy*dy + dz*dz;
+    }
+}
+
+template<int K>
+void kmeans_3d<K>::seed_centers(attempt_state& st, const float* points, int n)
+{
+    const int kk = num_clusters();
+
+    // The lower bounds are not needed yet, so they hold the squared distance to the closest seed
+    float* closest_sq = st.lower.data();
+
+    auto next_random = [&st]()
+    {
+        st.rng ^= st.rng << 13;
+        st.rng ^= st.rng >> 17;
+        st.rng ^= st.rng << 5;
+        return st.rng;
+    };
+
+    int pick = next_random() % n;
+
+    for (int c = 0; c < kk; c++)
+    {
+        st.cx[c] = points[3*pick];
+        st.cy[c] = points[3*pick+1];
+        st.cz[c] = points[3*pick+2];
+
+        // Update the distances to the closest seed and their total
+        double total = 0;
+
+        for (int i = 0; i < n; i++)
+        {
+            float dx = points[3*i]-st.cx[c], dy = points[3*i+1]-st.cy[c], dz = points[3*i+2]-st.cz[c];
+            float d_sq = dx*dx + dy*dy + dz*dz;
+
+            closest_sq[i] = (c == 0 || d_sq < closest_sq[i]) ? d_sq : closest_sq[i];
+            total += closest_sq[i];
+        }
+
+        // Pick the next seed with probability proportional to the squared distance
+        double target = (next_random()/4294967296.0)*total;
+        pick = n-1;
+
+        for (int i = 0; i < n; i++)
+        {
+            target -= closest_sq[i];
+
+            if (target < 0)
+            {
+                pick = i;
+                break;
+            }
+        }
+    }
+}
+
+template<int K>
+void kmeans_3d<K>::nearest_centers(attempt_state& st, const float* point, int& best, float& best_sq, float& second_sq)
+{
+    const int kk = num_clusters();
+    const int kp = K > 0 ? k_padded_fixed : k_padded;
+    float* dist_sq = st.dist_sq.data();
+    int c = 0;
+
+#ifdef __SSE2__
+    const __m128 px = _mm_set1_ps(point[0]);
+    const __m128 py = _mm_set1_ps(point[1]);
+    const __m128 pz = _mm_set1_ps(point[2]);
+
+    for (; c < kp; c += 4)
+    {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(&st.cx[c]), px);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(&st.cy[c]), py);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(&st.cz[c]), pz);
+        __m128 d_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        _mm_storeu_ps(dist_sq+c, d_sq);
+    }
+#endif
+
+    for (; c < kk; c++)
+    {
+        float dx = st.cx[c]-point[0], dy = st.cy[c]-point[1], dz = st.cz[c]-point[2];
+        dist_sq[c] = dx*dx + dy*dy + dz*dz;
+    }
+
+    best = 0;
+    best_sq = FLT_MAX;
+    second_sq = FLT_MAX;
+
+    for (c = 0; c < kk; c++)
+    {
+        if (dist_sq[c] < best_sq)
+        {
+            second_sq = best_sq;
+            best_sq = dist_sq[c];
+            best = c;
+        }
+        else if (dist_sq[c] < second_sq)
+        {
+            second_sq = dist_sq[c];
+        }
+    }
+}
+
+template<int K>
+void kmeans_3d<K>::reserve(int max_points, int attempts)
+{
+    if ((int)states.size() < attempts)
+    {
+        states.resize(attempts);
+    }
+
+    for (attempt_state& st : states)
+    {
+        resize_state(st, max_points);
+    }
+}
+
+template<int K>
+void kmeans_3d<K>::resize_state(attempt_state& st, int n)
+{
+    if ((int)st.cx.size() != k_padded)
+    {
+        st.cx.assign(k_padded, 0);
+        st.cy.assign(k_padded, 0);
+        st.cz.assign(k_padded, 0);
+        st.sum_x.resize(k);
+        st.sum_y.resize(k);
+        st.sum_z.resize(k);
+        st.counts.resize(k);
+        st.shift.resize(k);
+        st.half_sep.resize(k);
+        st.dist_sq.resize(k_padded);
+    }
+
+    // Only ever grows, so steady-state frames do not allocate
+    if ((int)st.labels.size() < n)
+    {
+        st.labels.resize(n);
+        st.upper.resize(n);
+        st.lower.resize(n);
+    }
+}
+
+template<int K>
+kmeans_3d<K>::kmeans_3d(int k, worker_pool* workers)
+{
+    kmeans_3d::k = K > 0 ? K : k;
+    kmeans_3d::k_padded = (kmeans_3d::k+3)/4*4;
+    kmeans_3d::workers = workers;
+}
+
+kmeans_engine* kmeans_engine::create(int k, worker_pool* workers)
+{
+    // Specializations for the cluster counts that are used in practice
+    switch (k)
+    {
+        case 16: return new kmeans_3d<16>(k, workers);
+        case 20: return new kmeans_3d<20>(k, workers);
+        case 24: return new kmeans_3d<24>(k, workers);
+        case 30: return new kmeans_3d<30>(k, workers);
+        case 32: return new kmeans_3d<32>(k, workers);
+        case 40: return new kmeans_3d<40>(k, workers);
+        default: return new kmeans_3d<0>(k, workers);
+    }
+}
+
+template class kmeans_3d<0>;
+template class kmeans_3d<16>;
+template class kmeans_3d<20>;
+template class kmeans_3d<24>;
+template class kmeans_3d<30>;
+template class kmeans_3d<32>;
+template class kmeans_3d<40>;
@@ -0,0 +1,146 @@
+/**
+ * Author: Adam Mooers
+ *
+ * K-means clustering specialized for 3D float points. Compared to the
+ * generic cv::kmeans, the engine can warm-start from the previous frame's
+ * centers, skips most distance computations using Hamerly's bounds, uses
+ * SSE for the nearest-center search and runs its restarts in parallel.
+ * The number of clusters can be fixed at compile time so the inner loops
+ * are fully unrolled.
+ */
+
+#ifndef KMEANS3D_H
+#define KMEANS3D_H
+
+#include <stdint.h>
+#include <vector>
+#include "workerPool.h"
+
+/**
+ * Interface shared by all instantiations of kmeans_3d.
+ */
+class kmeans_engine
+{
+    public:
+        /**
+         * Clusters the given points.
+         *
+         * @param   points      the points to cluster (x,y,z interleaved)
+         * @param   n           the number of points. Must be at least k.
+         * @param   attempts    the number of start configurations. The best result is kept.
+         * @param   max_iter    the maximum number of iterations per start configuration
+         * @param   epsilon     stop once no center moves further than this
+         * @param   centers     the k centers (x,y,z interleaved). Used as the first start
+         *                      configuration if warm is set, and overwritten with the result.
+         * @param   labels      the index of the center of each point (output)
+         * @param   warm        whether or not centers holds a usable start configuration
+         * @return  the compactness (sum of squared distances to the centers) of the result
+         */
+        virtual double cluster(const float* points, int n, int attempts, int max_iter, double epsilon,
+                               float* centers, int32_t* labels, bool warm) = 0;
+
+        /**
+         * Sizes the state of every start configuration up front, so clustering
+         * never allocates.
+         *
+         * @param   max_points  the most points that will be clustered at once
+         * @param   attempts    the most start configurations that will be run
+         */
+        virtual void reserve(int max_points, int attempts) = 0;
+
+        /**
+         * @return  the number of clusters
+         */
+        virtual int num_clusters(void) const = 0;
+
+        virtual ~kmeans_engine(void) {}
+
+        /**
+         * Creates the engine for the given number of clusters. A compile-time
+         * specialization is used when one exists for k, and the runtime-sized
+         * fallback otherwise.
+         *
+         * @param   k       the number of clusters
+         * @param   workers the pool to run the start configurations on. May be nullptr.
+         */
+        static kmeans_engine* create(int k, worker_pool* workers);
+};
+
+/**
+ * @tparam  K   the number of clusters. 0 selects the number given to the constructor at runtime.
+ */
+template<int K>
+class kmeans_3d : public kmeans_engine
+{
+    public:
+        double cluster(const float* points, int n, int attempts, int max_iter, double epsilon,
+                       float* centers, int32_t* labels, bool warm);
+
+        void reserve(int max_points, int attempts);
+
+        int num_clusters(void) const
+        {
+            return K > 0 ? K : k;
+        }
+
+        /**
+         * @param   k       the number of clusters. Ignored unless K is 0.
+         * @param   workers the pool to run the start configurations on. May be nullptr.
+         */
+        kmeans_3d(int k, worker_pool* workers);
+
+    private:
+        // Centers are stored as structure-of-arrays and padded to a multiple of the SSE width
+        static const int k_padded_fixed = (K+3)/4*4;
+
+        /**
+         * Everything one start configuration works on. Kept between frames so
+         * clustering does not allocate once the point count stabilizes.
+         */
+        struct attempt_state
+        {
+            std::vector<float> cx, cy, cz;      // Centers (padded)
+            std::vector<float> sum_x, sum_y, sum_z;
+            std::vector<int> counts;            // Points per center
+            std::vector<float> shift;           // How far each center moved in the last update
+            std::vector<float> half_sep;        // Half the distance to the closest other center
+            std::vector<float> dist_sq;         // Scratch for the nearest-center search
+            std::vector<int32_t> labels;        // Center of each point
+            std::vector<float> upper;           // Upper bound on the distance to the assigned center
+            std::vector<float> lower;           // Lower bound on the distance to any other center
+            double compactness;
+            uint32_t rng;                       // Random state for kmeans++ seeding
+        };
+
+        int k;                                  // The number of clusters
+        int k_padded;                           // k rounded up to a multiple of four
+        worker_pool* workers;
+        std::vector<attempt_state> states;      // One per start configuration
+        uint32_t run_count = 0;                 // Varies the random seeds between calls
+
+        /**
+         * Runs a single start configuration to completion.
+         *
+         * @param   init    the initial centers, or nullptr to seed with kmeans++
+         */
+        void run_attempt(attempt_state& st, const float* points, int n, int max_iter,
+                         double epsilon, const float* init);
+
+        /**
+         * Picks the initial centers with the kmeans++ heuristic.
+         */
+        void seed_centers(attempt_state& st, const float* points, int n);
+
+        /**
+         * Finds the closest and second closest centers to the given point.
+         *
+         * @param   best        the index of the closest center (output)
+         * @param   best_sq     the squared distance to the closest center (output)
+         * @param   second_sq   the squared distance to the second closest center (output)
+         */
+        void nearest_centers(attempt_state& st, const float* point, int& best, float& best_sq, float& second_sq);
+
+        void resize_state(attempt_state& st, int n);
+};
+
+#endif
@@ -4,10 +4,13 @@
  * Implements the library found in pointcloud.h.
  */
 
+#define CALIB_BOOTSTRAP_FITS 3      // Plane fits to the first calibration frame alone
+
 #include <iostream>
 #include <math.h>
-#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
 #include "pointCloud.h"
+#include "cloudKernels.h"
 
 void pointCloud::get_transform_from_cloud(void)
 {
@@ -17,17 +20,62 @@ void pointCloud::get_transform_from_cloud(void)
         return;
     }
 
-    // Find the mean: This works best if the point cloud density is normalized
-    cv::reduce(cloud_array, calib_origin, 0, CV_REDUCE_AVG);
+    const float* points = cloud_array.ptr<float>(0);
 
-    cv::Mat z_vec = get_normal_from_cloud();
-    cv::Mat y_vec_props, y_vec; 
-    cv::Mat x_vec;
+    // Take the moments about a point on the target to keep their precision
+    if (calib_sums[0] == 0)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            calib_shift[i] = points[i];
+        }
+    }
+
+    // The first frame has no plane to be trimmed against yet, so it is fitted on its own, each fit trimmed by the last
+    for (int i = 0; i < CALIB_BOOTSTRAP_FITS && calib_sums[0] == 0; i++)
+    {
+        double frame_sums[10] = {0};
+        double mean[3], cov[3][3];
+
+        accumulate_moments(points, cloud_array.rows, calib_shift, calib_plane_sigma >= 0 ? calib_plane : nullptr,
+                           std::max(calib_trim_sigmas*calib_plane_sigma, calib_trim_min), frame_sums);
+
+        if (!fit_plane(frame_sums, mean, cov, calib_plane, calib_plane_sigma))
+        {
+            break;
+        }
+    }
+
+    // Trim points far from the plane once there is one
+    accumulate_moments(points, cloud_array.rows, calib_shift, calib_plane_sigma >= 0 ? calib_plane : nullptr,
+                       std::max(calib_trim_sigmas*calib_plane_sigma, calib_trim_min), calib_sums);
 
-    cv::fitLine(cloud_array, y_vec_props, CV_DIST_L2, 0, line_fitting_reps, line_fitting_aeps);
+    double mean[3], cov[3][3];
 
-    // Extract the y-vector
-    y_vec = y_vec_props(cv::Rect(0,0,1,3)).t();
+    if (!fit_plane(calib_sums, mean, cov, calib_plane, calib_plane_sigma))
+    {
+        return;
+    }
+
+    // The mean is the origin: This works best if the point cloud density is normalized
+    calib_origin.create(1, 3, CV_32FC1);
+
+    for (int i = 0; i < 3; i++)
+    {
+        calib_origin.at<float>(0, i) = (float)(calib_shift[i] + mean[i]);
+    }
+
+    // The y-axis is the principal axis, which is what an L2 line fit finds
+    cv::Mat cov_mat(3, 3, CV_64FC1, &cov), eigenvalues, eigenvectors;
+    cv::eigen(cov_mat, eigenvalues, eigenvectors);
+
+    float normal_arr_z[] = {(float)calib_plane[1], (float)calib_plane[2], -1.0f};
+    float y_arr[] = {(float)eigenvectors.at<double>(0, 0), (float)eigenvectors.at<double>(0, 1),
+                     (float)eigenvectors.at<double>(0, 2)};
+
+    cv::Mat z_vec(1, 3, CV_32FC1, &normal_arr_z);
+    cv::Mat y_vec(1, 3, CV_32FC1, &y_arr);
+    cv::Mat x_vec;
 
     // Reverse vector if axis is facing the wrong way
     if (y_vec.at<float>(2) < 0)
@@ -75,14 +123,107 @@ void pointCloud::get_transform_from_cloud(void)
     calib_origin = -calib_origin;
 }
 
+bool pointCloud::fit_plane(const double sums[10], double mean[3], double cov[3][3], double plane[3], double& sigma)
+{
+    double n = sums[0];
+
+    if (n < 3)
+    {
+        return false;
+    }
+
+    // Mean and covariance of the accumulated points
+    const int second_moment[3][3] = {{4, 5, 6},
+                                     {5, 7, 8},
+                                     {6, 8, 9}};
+
+    for (int i = 0; i < 3; i++)
+    {
+        mean[i] = sums[i+1]/n;
+    }
+
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            cov[r][c] = sums[second_moment[r][c]]/n - mean[r]*mean[c];
+        }
+    }
+
+    // Least-squares plane z = Ax + By + C from the normal equations of the centered moments
+    double det = cov[0][0]*cov[1][1] - cov[0][1]*cov[0][1];
+
+    if (fabs(det) < 1e-18)
+    {
+        return false;   // The points are on a line
+    }
+
+    double A = (cov[0][2]*cov[1][1] - cov[1][2]*cov[0][1])/det;
+    double B = (cov[1][2]*cov[0][0] - cov[0][2]*cov[0][1])/det;
+
+    plane[0] = mean[2] - A*mean[0] - B*mean[1];
+    plane[1] = A;
+    plane[2] = B;
+    sigma = sqrt(std::max(0.0, cov[2][2] - A*cov[0][2] - B*cov[1][2]));
+
+    return true;
+}
+
+void pointCloud::reset_calibration(void)
+{
+    for (int i = 0; i < 10; i++)
+    {
+        calib_sums[i] = 0;
+    }
+
+    calib_plane_sigma = -1;
+}
+
 void pointCloud::clear(void)
 {
-    cloud_array.resize(0);   // Nothing in the array now
+    set_size(0);   // Nothing in the array now
 }
 
 void pointCloud::add_point(cv::Mat point)
 {
-    cloud_array.push_back(point);
+    float* p = point_buffer(cur_size+1) + cur_size*3;
+    const float* src = point.ptr<float>(0);
+
+    p[0] = src[0];
+    p[1] = src[1];
+    p[2] = src[2];
+
+    set_size(cur_size+1);
+}
+
+float* pointCloud::point_buffer(int max_points)
+{
+    if (cloud_buffer.rows < max_points)
+    {
+        // Grow geometrically so repeated add_point calls stay cheap
+        cv::Mat grown(std::max(max_points, cloud_buffer.rows*2), 3, CV_32FC1);
+        cloud_buffer.rowRange(0, cur_size).copyTo(grown.rowRange(0, cur_size));
+        cloud_buffer = grown;
+        set_size(cur_size);
+    }
+
+    return cloud_buffer.ptr<float>(0);
+}
+
+void pointCloud::set_size(int n_points)
+{
+    cur_size = n_points;
+    cloud_array = cloud_buffer.rowRange(0, n_points);
+}
+
+void pointCloud::voxel_downsample(voxel_grid& grid)
+{
+    if (cur_size == 0)
+    {
+        return;
+    }
+
+    set_size(grid.filter(cloud_buffer.ptr<float>(0), cur_size));
 }
 
 void pointCloud::save_calibration_matrix(const char* filename)
@@ -106,41 +247,24 @@ void pointCloud::load_calibration_matrix(const char* filename)
 
 void pointCloud::transform_cloud(void)
 {
+    float rotation[9], translation[3];
+    get_calibration(rotation, translation);
+
     // Transform the pointcloud
-    cloud_array=cloud_array*calib_rot_transform;
-    apply_translation(calib_origin, cloud_array);
+    transform_points(cloud_array.ptr<float>(0), cloud_array.rows, rotation, translation);
 }
 
-cv::Mat pointCloud::get_normal_from_cloud(void)
+void pointCloud::get_calibration(float rotation[9], float translation[3]) const
 {
-    // The X matrix needs a column of ones
-    cv::Mat X_components[] = {
-        cv::Mat::ones(cloud_array.rows, 1, cloud_array.type()),         // just ones
-        cloud_array(cv::Rect(0,0,cloud_array.cols-1,cloud_array.rows)), // x and y columns
-    };
-
-    cv::Mat X, X_trans, beta, y;
-
-    y = cloud_array(cv::Rect(cloud_array.cols-1,0,1,cloud_array.rows));
-
-    cv::hconcat(X_components, 2, X);
-
-    // Get x'
-    cv::transpose(X, X_trans);
-
-    // Calculate the least-squares plane
-    beta = (X_trans*X).inv()*(X_trans*y);
-
-    // Extract the normal
-    float normal_arr_z[] = {beta.at<float>(0,1), beta.at<float>(0,2), -1.0f};
-
-    // Convert the normal to cv::mat format
-    cv::Mat normal_z_src(1, 3, CV_32FC1, &normal_arr_z);
-    cv::Mat normal_z; 
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            rotation[r*3+c] = calib_rot_transform.at<float>(r, c);
+        }
 
-    normal_z_src.copyTo(normal_z);
-    
-    return normal_z;
+        translation[r] = calib_origin.at<float>(0, r);
+    }
 }
 
 void pointCloud::prompt_for_manual_offset(void)
@@ -165,15 +289,10 @@ void pointCloud::prompt_for_manual_offset(void)
 
 pointCloud::pointCloud(void)
 {
+    cur_size = 0;
+    cloud_buffer = cv::Mat(0, 3, CV_32FC1);
     cloud_array = cv::Mat(0, 3, CV_32FC1);
     calib_rot_transform = cv::Mat::eye(3,3, CV_32FC1);
     calib_origin = cv::Mat::zeros(1, 3, CV_32FC1);
+    reset_calibration();
 }
-
-void pointCloud::apply_translation(cv::Mat translation, cv::Mat& matrix)
-{
-    // Move the pointcloud to the new origin
-    for (int r = 0; r < matrix.rows; ++r) {
-        matrix.row(r) = matrix.row(r) + translation;
-    }
-}
\ No newline at end of file
@@ -11,6 +11,7 @@
 #define POINTCLOUD_H
 
 #include "opencv2/core/core.hpp"
+#include "voxelGrid.h"
 
 class pointCloud
 {
@@ -19,12 +20,22 @@ class pointCloud
         // Normalize
 
         /**
-         * Gets the calibration transform from the current point-cloud.
-         * Linear least-squares planar regression is used to identify the 
-         * X-Y plane. 
+         * Refines the calibration transform with the current point-cloud.
+         * The first and second moments of the cloud are added to those of
+         * the previous frames in one pass, then the X-Y plane (least-squares
+         * plane regression) and the Y axis (principal axis) are solved from
+         * the accumulated 3x3 moments. Points far from the plane are trimmed,
+         * so stray points do not pull the estimate. The first frame is trimmed
+         * against a plane fitted to it alone.
          */
         void get_transform_from_cloud(void);
 
+        /**
+         * Forgets the moments accumulated by get_transform_from_cloud, e.g. after
+         * the calibration target was moved.
+         */
+        void reset_calibration(void);
+
         /**
          * Logically clears the pointcloud. Use this in-between frames.
          */
@@ -38,6 +49,32 @@ class pointCloud
          */
         void add_point(cv::Mat point);
 
+        /**
+         * Provides direct access to the point storage so producers can write points
+         * without any per-point overhead. The storage grows to hold at least max_points
+         * (x,y,z interleaved) and the current points are kept. Call set_size once the
+         * points have been written.
+         *
+         * @param   max_points  the number of points that may be written
+         * @return  the start of the point storage
+         */
+        float* point_buffer(int max_points);
+
+        /**
+         * Sets the number of valid points at the start of the point storage.
+         *
+         * @param   n_points    the number of points in the cloud
+         */
+        void set_size(int n_points);
+
+        /**
+         * Normalizes the density of the cloud by replacing it with the centroid of
+         * each occupied voxel of the given grid. Runs in place.
+         *
+         * @param   grid        the grid to downsample with. Its tables are reused between calls.
+         */
+        void voxel_downsample(voxel_grid& grid);
+
         /**
          * Saves the calibration transform to the given file in XML format.
          * The matrix is saved in floating-point format. Both rotation and
@@ -59,13 +96,22 @@ class pointCloud
         void load_calibration_matrix(const char* filename);
 
         /**
-         * Transforms the entire cloud using the current rotation and translation
+         * Transforms the entire cloud in place using the current rotation and translation
          * matrices. point_cloud = point_cloud*R + T. Be sure to load the desired
          * transform from file (load_calibration_matrix(...)) or from a calibration
          * cube first.
          */
         void transform_cloud(void);
 
+        /**
+         * Copies out the current calibration transform so it can be applied outside
+         * of the point cloud (e.g. while deprojecting).
+         *
+         * @param   rotation    the 3x3 rotation R, row-major
+         * @param   translation the translation T
+         */
+        void get_calibration(float rotation[9], float translation[3]) const;
+
         /** 
          * Prompts the user for the manual offset to add to the calibration
          * translation. The result entered by the user is added immediately
@@ -74,7 +120,7 @@ class pointCloud
          */
         void prompt_for_manual_offset(void);
 
-        cv::Mat cloud_array;            // The current point cloud
+        cv::Mat cloud_array;            // The current point cloud, a view of the filled part of cloud_buffer
 
         /**
          * Initializes the point cloud. The homogeneous transform matrix equivalent 
@@ -84,30 +130,29 @@ class pointCloud
 
     private:
         int cur_size;                   // The currently-filled portion of the array
+        cv::Mat cloud_buffer;           // Backing storage for the cloud, reused between frames
         cv::Mat calib_rot_transform;    // The rotational transform from the point-cloud
         cv::Mat calib_origin;           // The translation from the camera to the box center
 
-        const double line_fitting_reps = 0.01;  // Radius accuracy parameter for line fitting
-        const double line_fitting_aeps = 0.01;  // Angle accuracy parameter for line fitting
+        double calib_sums[10];          // Moments of the calibration points about calib_shift (see accumulate_moments)
+        double calib_shift[3];          // A point of the first calibration frame
+        double calib_plane[3];          // The current plane z = C + Ax + By about calib_shift as [C A B]
+        double calib_plane_sigma;       // The standard deviation of the plane residuals. Negative until known.
 
         /**
-         * Finds the transform plane using least-squares regression. The
-         * normal is the new z-axis of the system. Uses cloud_array as the
-         * source.
+         * Fits the least-squares plane z = C + Ax + By to accumulated moments.
          *
-         * @return  parameters of z = Ax + By + C as [C A B]
+         * @param   sums    the moments (see accumulate_moments)
+         * @param   mean    set to the mean of the points
+         * @param   cov     set to the covariance of the points
+         * @param   plane   set to the plane as [C A B]
+         * @param   sigma   set to the standard deviation of the residuals
+         * @return  false if there are too few points or they are on a line, leaving plane and sigma as they were
          */
-        cv::Mat get_normal_from_cloud(void);
+        static bool fit_plane(const double sums[10], double mean[3], double cov[3][3], double plane[3], double& sigma);
 
-        /**
-         * Applies the selected translation to the selected matrix.
-         * The given translation (1xn) is added to each row of the matrix (mxn).
-         * Matlab-equivalent operation: M = M + repmat(T, m, 1);
-         *
-         * @param   translation     the translation to apply (T)
-         * @param   matrix          the matrix to apply the transformation to (M)
-         */
-        static void apply_translation(cv::Mat translation, cv::Mat& matrix);
+        const double calib_trim_sigmas = 3.0;       // Points further from the plane are trimmed (standard deviations)
+        const double calib_trim_min = 0.005;        // Never trim points closer than this to the plane (meters)
 };
 
 #endif
\ No newline at end of file
@@ -3,288 +3,401 @@
  *
  * Runs the high-level operations of the pose estimator. This 
  * includes capturing inputs, running clusting, and displaying
- * the result in realtime.
+ * the result in realtime. Headless builds (make HEADLESS=1) leave
+ * the display out and track as fast as frames arrive.
  */
 
-#define POINT_CLOUD_SCALING_CALIB 0.2f
-#define POINT_CLOUD_SCALING_TRACKING 0.16f
-#define PREFILTER_MANHATTAN_DIST 4
-#define PREFILTER_DEPTH_MAX_DIST 0.05f
-#define KMEANS_K 30
-#define KMEANS_ATTEMPTS 2
-#define KMEANS_ITERATIONS 10
-#define KMEANS_EPSILON 0.002f
-#define KMEANS_CONNECT_THRESHOLD 0.25f
-#define LEFT_ARM_START_POS {0.2f, 0.0f, -0.05f}
-#define RIGHT_ARM_START_POS {-0.2f, 0.0f, -0.05f}
-#define HAND_MAX_DIST_TO_START 0.2f
-#define SHOULDER_DXDZ_THRESHOLD 1.2f
-#define JOINT_SMOOTHING 1.f//0.11f
-#define ARM_LOCKED_ANGLE_THESHOLD_D 23
-#define CALIBRATION_FILE "calibration.xml"
+#define PIPELINE_LATEST_FRAME_WINS true
+#define CALIBRATION_FILE "calibration.xml"     // Camera i > 0 defaults to calibration_i.xml
+#define MAX_CAMERAS 4
+#define RIG_SYNC_TOLERANCE_MS 20.0  // Just over half a frame at 30 fps, so free-running cameras always line up
+#define TRACE_FILE "trace.json"
+#define ALLOC_CHECK_WARMUP_FRAMES 30    // Frames before allocations count as violations (ALLOC_CHECK=1)
 
+#include <algorithm>
+#include <cctype>
 #include <iostream>
+#include <csignal>
+#include <string>
 #include <strings.h>
-#include <SFML/Window.hpp>
-#include <SFML/OpenGL.hpp>
-#include <SFML/Graphics.hpp>
-#include <SFML/OpenGL.hpp>
-#include <GL/glu.h>
+#include <vector>
+#include "cameraRig.h"
 #include "depthCamManager.h"
+#include "depthRecording.h"
+#include "framePipeline.h"
+#include "jointPublisher.h"
+#include "qualityController.h"
+#include "allocCheck.h"
 #include "tracker.h"
+#include "trackerConfig.h"
+#include "trackingParams.h"
+#include "trace.h"
+
+#ifndef HEADLESS
+#include "poseView.h"
+#endif
 
 enum opModes {TRACKING, CALIBRATION};
 
 opModes curMode;
+int calib_camera = 0;               // The camera to calibrate
+int n_live_cameras = 1;             // Realsense devices to stream from
+std::vector<const char*> record_paths;  // Record the live depth stream of camera i to the i-th file
+std::vector<const char*> replay_paths;  // Run from these recordings, one per camera, instead of the cameras
+std::vector<std::string> calib_paths;   // The calibration file of each camera
+bool replay_fast = false;           // Replay as fast as possible instead of at the recorded rate
+const char* trace_path = TRACE_FILE; // Chrome trace output. Written when T is pressed and on exit (TRACE=1)
+const char* publish_name = nullptr; // Shared-memory name to publish the joints under
+tracking_params params;             // Defaults, overridden by --params and then --k
+int kmeans_k = 0;                   // Set by --k. Any k but the compiled one runs on the runtime tracker configuration
+volatile sig_atomic_t stop_requested = 0;
 
 /**
  * Parses the user input. Handles errors such as incorrect argument count, etc.
  */
 void parse_input(int argc, char* argv[]) 
 {
-    if (argc > 2)
+    curMode = TRACKING;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "calibrate") == 0)
+        {
+            curMode = CALIBRATION;
+
+            // The camera index is optional
+            if (i+1 < argc && isdigit(argv[i+1][0]))
+            {
+                calib_camera = atoi(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--cameras") == 0 && i+1 < argc)
+        {
+            n_live_cameras = std::max(1, std::min(MAX_CAMERAS, atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--calibration") == 0 && i+1 < argc)
+        {
+            calib_paths.push_back(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i+1 < argc && record_paths.size() < MAX_CAMERAS)
+        {
+            record_paths.push_back(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i+1 < argc && replay_paths.size() < MAX_CAMERAS)
+        {
+            replay_paths.push_back(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fast") == 0)
+        {
+            replay_fast = true;
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i+1 < argc)
+        {
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--params") == 0 && i+1 < argc)
+        {
+            if (!params.load(argv[++i]))
+            {
+                exit(0);
+            }
+        }
+        else if (strcmp(argv[i], "--k") == 0 && i+1 < argc)
+        {
+            kmeans_k = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--publish") == 0)
+        {
+            // The name is optional
+            publish_name = (i+1 < argc && argv[i+1][0] == '/') ? argv[++i] : JOINT_SHM_NAME;
+        }
+        else
+        {
+            printf("Correct Usage: %s [calibrate [camera]] [--cameras n] [--calibration file]... "
+                   "[--record file... | --replay file... [--fast]] [--trace file] [--publish [/name]] [--params file] [--k n]\n", argv[0]);
+            exit(0);
+        }
+    }
+
+    if (kmeans_k > 0)
     {
-        printf("Correct Usage: %s [calibrate]\n", argv[0]);
+        params.kmeans_k = kmeans_k;
+    }
+
+    if (!record_paths.empty() && !replay_paths.empty())
+    {
+        printf("--record and --replay cannot be combined\n");
         exit(0);
     }
 
-    if (argc == 2 && strcmp(argv[1], "calibrate") == 0)
+    int n_cameras = replay_paths.empty() ? n_live_cameras : (int)replay_paths.size();
+
+    if (calib_camera >= n_cameras)
+    {
+        printf("There is no camera %d to calibrate\n", calib_camera);
+        exit(0);
+    }
+
+    // Cameras without a --calibration file get a default one
+    for (int i = (int)calib_paths.size(); i < n_cameras; i++)
+    {
+        calib_paths.push_back(i == 0 ? std::string(CALIBRATION_FILE) : "calibration_" + std::to_string(i) + ".xml");
+    }
+
+    if (curMode == CALIBRATION)
     {
         printf("Entering calibration mode...\n");
-        curMode = CALIBRATION;
     }
     else
     {
         printf("Entering tracking mode...\n");
-        curMode = TRACKING;
     }
 }
 
 /**
- * Draws the given pointcloud to the specified window.
+ * Ends the main loop on Ctrl-C so everything shuts down cleanly.
  */
-
-void draw_pointcloud(cv::Mat cloud)
+void handle_interrupt(int)
 {
-    glPointSize(4);
-    glBegin(GL_POINTS);
-
-        for (int r = 0; r<cloud.rows; r++)
-        {
-            float* curPoint = cloud.ptr<float>(r);
-
-            glColor3ub(0, 0, 0);
-            //glColor3ub(0, (256-(int)(curPoint[1]*512))%256, 0);
-
-            if (curMode == CALIBRATION)
-            {
-                glVertex3f(curPoint[0], curPoint[1], 0);    // Render x->x, y->y
-            }
-            else
-            {
-                glVertex3f(curPoint[0], -curPoint[2], 0);   // Render x->x, -z->y
-            }
-        }
-
-    glEnd();
+    stop_requested = 1;
 }
 
 /**
- * Draws the given adjacency matrix with the corresponding kmeans centers.
+ * Runs calibration or tracking until the stream ends or the user stops it.
+ *
+ * @tparam  Config  the tracker configuration (see trackerConfig.h)
+ * @return  the exit code
  */
-
-void draw_kmeans_mesh(cv::Mat centers, cv::Mat adj)
+template<class Config>
+int run(void)
 {
-    if (centers.rows != KMEANS_K)
-    {
-        return;
-    }
-
-    glPointSize(12);
-
-    // Draw cloud centers
-    glBegin(GL_POINTS);
-
-        for (int r = 0; r<centers.rows; r+=1)
-        {
-            float* curPoint = centers.ptr<float>(r/1);
+    float scale_size = (curMode == CALIBRATION) ?
+                        params.point_cloud_scaling_calib:
+                        params.point_cloud_scaling_tracking;
 
-            glColor3ub(255, 0, 0);
-            glVertex3f(curPoint[0], -curPoint[2], 0); 
-        }
+    camera_rig rig(scale_size, RIG_SYNC_TOLERANCE_MS);
+    basic_tracker<Config> tracker_top(params.kmeans_k);
+    basic_arm<Config> left_arm(tracker_top, cv::Mat(1, 3, CV_32FC1, params.left_arm_start_pos), 
+                    params.hand_max_dist_to_start, params.shoulder_dxdz_threshold);
 
-    glEnd();
+    basic_arm<Config> right_arm(tracker_top, cv::Mat(1, 3, CV_32FC1, params.right_arm_start_pos), 
+                    params.hand_max_dist_to_start, params.shoulder_dxdz_threshold);
 
-    glLineWidth(3);
-    glBegin(GL_LINES);
+    for (const char* replay_path : replay_paths)
+    {
+        recording_source* recording = new recording_source(!replay_fast);
 
-        for (int r = 0; r<centers.rows; r+=1)
+        if (!recording->open(replay_path))
         {
-            float* curPoint = centers.ptr<float>(r);
-
-            for (int c = r; c<adj.cols; c++)
-            {
-                if (adj.at<float>(r,c) > 0.5f)
-                {
-                    float* connectedTo = centers.ptr<float>(c);
-                    glColor3ub(255, 0, 0);
-                    glVertex3f(curPoint[0], -curPoint[2], 0);
-                    glVertex3f(connectedTo[0], -connectedTo[2], 0);
-                }
-            }
+            delete recording;
+            return 1;
         }
-    glEnd();
-}
 
-/**
- * Draws the given arm and highlights the key points.
- */
-void draw_arm(arm& to_draw)
-{
-    if (to_draw.get_bend_angle() < ARM_LOCKED_ANGLE_THESHOLD_D)
-    {
-        glPointSize(35);
-        glColor3ub(255, 0, 0);
+        rig.add_camera(recording);
     }
-    else
+
+    // Connect to the depth cameras
+    if (replay_paths.empty() && rig.add_realsense_cameras(n_live_cameras) <= calib_camera)
     {
-        glPointSize(25);
-        glColor3ub(0, 0, 255);
+        return 1;
     }
 
-    
-    glBegin(GL_POINTS);
-        float* curPoint = to_draw.hand_loc.ptr<float>(0);
-        glVertex3f(curPoint[0], -curPoint[2], 0);   // Render x->x, -z->y
+    rig.start_stream();
 
-        curPoint = to_draw.elbow_loc.ptr<float>(0);
-        glVertex3f(curPoint[0], -curPoint[2], 0);   // Render x->x, -z->y
+    depth_recorder recorders[MAX_CAMERAS];
+    depth_recorder* active_recorders[MAX_CAMERAS] = {};
 
-        curPoint = to_draw.shoulder_loc.ptr<float>(0);
-        glVertex3f(curPoint[0], -curPoint[2], 0);   // Render x->x, -z->y
-    glEnd();
-}
+    for (size_t i = 0; i < record_paths.size() && (int)i < rig.size(); i++)
+    {
+        if (!recorders[i].open(record_paths[i]))
+        {
+            return 1;
+        }
 
-int main(int argc, char* argv[])
-{
-    sf::Clock clock;
+        active_recorders[i] = &recorders[i];
+    }
 
-    parse_input(argc, argv);
+    joint_publisher publisher;
 
-    float scale_size = (curMode == CALIBRATION) ?
-                        POINT_CLOUD_SCALING_CALIB:
-                        POINT_CLOUD_SCALING_TRACKING;
+    if (publish_name && !publisher.open(publish_name))
+    {
+        return 1;
+    }
 
-    depth_cam cam_top(scale_size);
-    tracker tracker_top(KMEANS_K);
-    float left_arm_start_pos[3] = LEFT_ARM_START_POS;
-    arm left_arm(tracker_top, cv::Mat(1, 3, CV_32FC1, &left_arm_start_pos), 
-                    HAND_MAX_DIST_TO_START, SHOULDER_DXDZ_THRESHOLD);
+    joint_predictor predictor(params.predictor_memory, params.predictor_max_horizon, params.predictor_latency);
+    quality_controller quality(params.quality_deadline, params.ladder());
 
-    float right_arm_start_pos[3] = RIGHT_ARM_START_POS;
-    arm right_arm(tracker_top, cv::Mat(1, 3, CV_32FC1, &right_arm_start_pos), 
-                    HAND_MAX_DIST_TO_START, SHOULDER_DXDZ_THRESHOLD);
+    // Tracking runs on the staged pipeline. Calibration stays on the main thread.
+    pipeline_config config;
+    params.apply(config);
+    config.latest_frame_wins = PIPELINE_LATEST_FRAME_WINS;
+    config.recorders = active_recorders;
+    config.publisher = publish_name ? &publisher : nullptr;
+    config.predictor = params.predictor_memory >= 0 ? &predictor : nullptr;
+    config.quality = params.quality_deadline > 0 ? &quality : nullptr;
+    config.alloc_check_warmup = ALLOC_CHECK_WARMUP_FRAMES;
 
-    cam_top.depth_cam_init();    // Connect to the depth camera
-    cam_top.start_stream();
+    frame_pipeline<Config> pipeline(rig, tracker_top, left_arm, right_arm, config);
+    depth_cam& calib_cam = rig.camera(calib_camera);
+    voxel_grid calib_voxels(params.voxel_leaf_size > 0 ? params.voxel_leaf_size : 1);
 
     if (curMode == TRACKING)
     {
-        cam_top.cloud.load_calibration_matrix(CALIBRATION_FILE);
-    }
+        for (int i = 0; i < rig.size(); i++)
+        {
+            rig.camera(i).cloud.load_calibration_matrix(calib_paths[i].c_str());
+        }
 
-    // Create a window
-    sf::RenderWindow window(sf::VideoMode(800, 600), "OpenGL", sf::Style::Default, sf::ContextSettings(24));
-    sf::View graphView(sf::FloatRect(-0.5, -0.75, 1, 1.5));
-    window.setVerticalSyncEnabled(true);
-    window.setActive(true);
-    window.setView(graphView);
+        pipeline.start();
+    }
 
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
+#ifndef HEADLESS
+    // The view draws on its own thread and never holds up the loop below
+    pose_view view(curMode == CALIBRATION);
+    view.reserve(rig.max_points(), tracker_top.num_clusters());
+    view.start();
+#endif
 
-    // Match coordinates between SFML view with the orthographic view
-    sf::Vector2f viewSize = window.getView().getSize();
-    sf::Vector2f viewCenter = window.getView().getCenter();
-    gluOrtho2D( viewCenter.x-viewSize.x/2,
-                viewCenter.x+viewSize.x/2,
-                viewCenter.y+viewSize.y/2,
-                viewCenter.y-viewSize.y/2);
+    std::signal(SIGINT, handle_interrupt);
+    int output_frames = 0;
 
     // run the main loop
-    bool running = true;
-    int elapsed = 0;
-    while (running)
+    while (!stop_requested)
     {
-        clock.restart();
-        // Update window view
-        window.clear(sf::Color::White);
-
-        cam_top.capture_next_frame();
-        cam_top.filter_background(PREFILTER_DEPTH_MAX_DIST, PREFILTER_MANHATTAN_DIST);
-        cam_top.to_depth_frame();
-
-        // Convert to point cloud and apply calibration transform to it
         if (curMode == CALIBRATION)
         {
-            cam_top.cloud.get_transform_from_cloud();
-            draw_pointcloud(cam_top.cloud.cloud_array);
+            if (!calib_cam.capture_next_frame())
+            {
+                break;  // End of the recording
+            }
+
+            if (active_recorders[calib_camera])
+            {
+                active_recorders[calib_camera]->write_frame(calib_cam.raw_frame);
+            }
+
+            calib_cam.filter_background(params.prefilter_depth_max_dist, params.prefilter_manhattan_dist);
+            calib_cam.to_depth_frame();
+
+            if (params.voxel_leaf_size > 0)
+            {
+                calib_cam.cloud.voxel_downsample(calib_voxels);
+            }
+
+            calib_cam.cloud.get_transform_from_cloud();
+
+#ifndef HEADLESS
+            view_snapshot& snapshot = view.begin_publish();
+            snapshot.set_cloud(calib_cam.cloud.cloud_array);
+            snapshot.clustered = false;
+            view.publish();
+#endif
         }
 
         if (curMode == TRACKING)
         {
-            cam_top.cloud.transform_cloud();
-            
-            draw_pointcloud(cam_top.cloud.cloud_array);
+            // Output stage: hand the newest frame the pipeline has finished to the view
+            pipeline_frame* frame = pipeline.wait_output();
 
-            // Run clustering algorithm
-            tracker_top.update_point_cloud(cam_top.cloud);
-
-            bool couldCluster = tracker_top.cluster(KMEANS_ATTEMPTS, KMEANS_ITERATIONS, KMEANS_EPSILON);
-
-            if (couldCluster)
+            if (frame == nullptr || frame->end_of_stream)
             {
-                tracker_top.connect_means(KMEANS_CONNECT_THRESHOLD);
-                draw_kmeans_mesh(tracker_top.centers, tracker_top.adj_kmeans);
+                break;  // End of the recording
+            }
 
-                
-                
+#ifndef HEADLESS
+            {
+                TRACE_SCOPE("publish_view");
+                view_snapshot& snapshot = view.begin_publish();
+                snapshot.set_cloud(frame->cloud.cloud_array);
+                snapshot.clustered = frame->clustered;
 
-                if (left_arm.update_joints(JOINT_SMOOTHING))
+                if (frame->clustered)
                 {
-                    draw_arm(left_arm);
-                    std::cout << elapsed << "\n";
+                    snapshot.set_clusters(frame->centers, frame->adj);
                 }
 
-                if (right_arm.update_joints(JOINT_SMOOTHING))
-                {
-                    draw_arm(right_arm);
-                }
+                snapshot.left_arm = frame->left_arm;
+                snapshot.right_arm = frame->right_arm;
+                view.publish();
             }
-        }
+#endif
 
-        sf::Event event;
-        while (window.pollEvent(event))
-        {
-            if (event.type == sf::Event::Closed)
+            TRACE_SINCE("arrival_to_output", frame->arrival_ns);
+            pipeline.release(frame);
+
+            if (output_frames++ == ALLOC_CHECK_WARMUP_FRAMES)
             {
-                running = false;    // end the program
+                ALLOC_CHECK_THREAD("output");
             }
         }
 
-        window.display();
-        elapsed = clock.getElapsedTime().asMicroseconds();
+#ifndef HEADLESS
+        if (!view.is_open())
+        {
+            break;  // The window was closed
+        }
+
+        if (view.take_trace_request())
+        {
+            // Dumping on request is not part of the frame loop
+            const char* checked = ALLOC_CHECK_CURRENT();
+            ALLOC_CHECK_THREAD(nullptr);
+            trace_dump_chrome(trace_path);
+            ALLOC_CHECK_THREAD(checked);
+        }
+#endif
     }
 
-    window.close();
+    ALLOC_CHECK_THREAD(nullptr);
+
+#ifndef HEADLESS
+    view.stop();
+#endif
+    pipeline.stop();
+
+    for (int i = 0; i < MAX_CAMERAS; i++)
+    {
+        recorders[i].close();
+    }
+
+    publisher.close();
+
+    if (config.quality)
+    {
+        quality.print_log(stdout);
+    }
+
+#ifdef TRACE_ENABLED
+    trace_print_summary(stdout);
+    trace_dump_chrome(trace_path);
+#endif
 
     // Get transform from cloud
     if (curMode == CALIBRATION)
     {
-        cam_top.cloud.prompt_for_manual_offset();
-        printf("Saving calibration transform to " CALIBRATION_FILE "...\n");
-        cam_top.cloud.save_calibration_matrix(CALIBRATION_FILE);
+        calib_cam.cloud.prompt_for_manual_offset();
+        printf("Saving calibration transform to %s...\n", calib_paths[calib_camera].c_str());
+        calib_cam.cloud.save_calibration_matrix(calib_paths[calib_camera].c_str());
     }
 
-    return 0;
-}
\ No newline at end of file
+    // Only ALLOC_CHECK builds count, so this fails the run only when checking
+    return alloc_check_report(stdout) ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    TRACE_THREAD_NAME("output");
+
+    parse_input(argc, argv);
+
+    // The tracker is unrolled for the compiled k. Any other k falls back to the runtime configuration.
+    if (params.kmeans_k == compiled_tracker_config::k)
+    {
+        return run<compiled_tracker_config>();
+    }
+
+    printf("k = %d differs from the compiled k = %d, using the runtime tracker configuration\n",
+           params.kmeans_k, compiled_tracker_config::k);
+
+    return run<runtime_tracker_config>();
+}
@@ -0,0 +1,131 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in poseView.h.
+ */
+
+#include <SFML/Window.hpp>
+#include <SFML/OpenGL.hpp>
+#include <SFML/Graphics.hpp>
+#include <GL/glu.h>
+#include "poseView.h"
+#include "viewRenderer.h"
+#include "trace.h"
+
+void view_snapshot::set_cloud(const cv::Mat& points)
+{
+    const float* src = points.rows ? points.ptr<float>(0) : nullptr;
+    cloud.assign(src, src+3*points.rows);
+}
+
+void view_snapshot::set_clusters(const cv::Mat& centers, const cv::Mat& adj)
+{
+    const float* src = centers.rows ? centers.ptr<float>(0) : nullptr;
+    view_snapshot::centers.assign(src, src+3*centers.rows);
+    view_snapshot::adj.resize(adj.rows*adj.cols);
+
+    for (int r = 0; r < adj.rows; r++)
+    {
+        for (int c = 0; c < adj.cols; c++)
+        {
+            view_snapshot::adj[r*adj.cols+c] = adj.at<float>(r,c) > 0.5f;
+        }
+    }
+}
+
+void view_snapshot::reserve(int max_points, int k)
+{
+    cloud.reserve(3*max_points);
+    centers.reserve(3*k);
+    adj.reserve(k*k);
+}
+
+void pose_view::reserve(int max_points, int k)
+{
+    snapshots.for_each([&](view_snapshot& snapshot) { snapshot.reserve(max_points, k); });
+}
+
+void pose_view::start(void)
+{
+    running = true;
+    open = true;
+    thread = std::thread(&pose_view::run, this);
+}
+
+void pose_view::stop(void)
+{
+    running = false;
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+void pose_view::run(void)
+{
+    TRACE_THREAD_NAME("view");
+
+    // Create a window
+    sf::RenderWindow window(sf::VideoMode(800, 600), "OpenGL", sf::Style::Default, sf::ContextSettings(24));
+    sf::View graphView(sf::FloatRect(-0.5, -0.75, 1, 1.5));
+    window.setVerticalSyncEnabled(true);
+    window.setActive(true);
+    window.setView(graphView);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+
+    // Match coordinates between SFML view with the orthographic view
+    sf::Vector2f viewSize = window.getView().getSize();
+    sf::Vector2f viewCenter = window.getView().getCenter();
+    gluOrtho2D( viewCenter.x-viewSize.x/2,
+                viewCenter.x+viewSize.x/2,
+                viewCenter.y+viewSize.y/2,
+                viewCenter.y-viewSize.y/2);
+
+    view_renderer renderer;
+    renderer.init();
+
+    // The display refresh paces this loop, independently of the tracking
+    while (running)
+    {
+        snapshots.update();
+        const view_snapshot& snapshot = snapshots.read_buffer();
+
+        window.clear(sf::Color::White);
+
+        {
+            TRACE_SCOPE("draw");
+            renderer.draw(snapshot, calibration, window.getSize().x, window.getSize().y);
+        }
+
+        sf::Event event;
+        while (window.pollEvent(event))
+        {
+            if (event.type == sf::Event::Closed)
+            {
+                open = false;    // end the program
+            }
+            else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::T)
+            {
+                // Snapshot the recent stage timings without stopping
+                trace_request = true;
+            }
+        }
+
+        window.display();
+    }
+
+    renderer.release();
+    window.close();
+}
+
+pose_view::pose_view(bool calibration) : calibration(calibration), running(false), open(false), trace_request(false)
+{
+}
+
+pose_view::~pose_view(void)
+{
+    stop();
+}
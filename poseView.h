@@ -0,0 +1,127 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Visualizes the tracker in an SFML/OpenGL window. The view runs on its own
+ * thread at the display refresh rate and draws the most recent snapshot it
+ * was given with the vertex-buffer renderer in viewRenderer.h. Publishing a
+ * snapshot never blocks, so the tracking loop runs as fast as frames arrive
+ * no matter how slow the display is.
+ *
+ * Everything in here is left out of headless builds (make HEADLESS=1).
+ */
+
+#ifndef POSEVIEW_H
+#define POSEVIEW_H
+
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+#include "opencv2/core/core.hpp"
+#include "framePipeline.h"
+#include "tripleBuffer.h"
+
+/**
+ * Everything drawn for one frame. Buffers keep their capacity between
+ * frames, so publishing does not allocate once the sizes settle.
+ */
+struct view_snapshot
+{
+    std::vector<float> cloud;       // The point cloud (x,y,z interleaved)
+    bool clustered = false;         // Whether or not centers and adj are valid
+    std::vector<float> centers;     // The k-means centers (x,y,z interleaved)
+    std::vector<uint8_t> adj;       // k x k, 1 where two centers are connected
+    arm_snapshot left_arm;
+    arm_snapshot right_arm;
+
+    /**
+     * Copies the given point cloud (n x 3, CV_32FC1).
+     */
+    void set_cloud(const cv::Mat& points);
+
+    /**
+     * Copies the given k-means centers (k x 3) and adjacency matrix (k x k, 0/1 floats).
+     */
+    void set_clusters(const cv::Mat& centers, const cv::Mat& adj);
+
+    /**
+     * Sizes the buffers for the given cloud size and number of centers.
+     */
+    void reserve(int max_points, int k);
+};
+
+class pose_view
+{
+    public:
+        /**
+         * Opens the window and starts drawing on the view thread.
+         */
+        void start(void);
+
+        /**
+         * Closes the window and joins the view thread.
+         */
+        void stop(void);
+
+        /**
+         * Sizes every snapshot up front, so publishing never allocates. Call before start().
+         *
+         * @param   max_points  the most points a published cloud will have
+         * @param   k           the number of k-means centers
+         */
+        void reserve(int max_points, int k);
+
+        /**
+         * @return  the snapshot to fill for the next publish. Call from one thread only.
+         */
+        view_snapshot& begin_publish(void)
+        {
+            return snapshots.write_buffer();
+        }
+
+        /**
+         * Hands the snapshot from begin_publish to the view. Never blocks.
+         */
+        void publish(void)
+        {
+            snapshots.publish();
+        }
+
+        /**
+         * @return  false once the user closed the window
+         */
+        bool is_open(void) const
+        {
+            return open;
+        }
+
+        /**
+         * @return  whether or not the user asked for a trace dump (T) since the last call
+         */
+        bool take_trace_request(void)
+        {
+            return trace_request.exchange(false);
+        }
+
+        /**
+         * @param   calibration     draw the camera's x-y plane instead of the calibrated top view
+         */
+        pose_view(bool calibration);
+
+        ~pose_view(void);
+
+    private:
+        bool calibration;
+        triple_buffer<view_snapshot> snapshots;
+        std::thread thread;
+        std::atomic<bool> running;
+        std::atomic<bool> open;
+        std::atomic<bool> trace_request;
+
+        /**
+         * The view thread. Owns the window and the GL context.
+         */
+        void run(void);
+};
+
+#endif
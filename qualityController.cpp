@@ -0,0 +1,120 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in qualityController.h.
+ */
+
+#define QUALITY_WINDOW 30           // Frames judged together, a second at 30 fps
+#define QUALITY_MAX_MISSES 3        // Frames of a window that may miss the deadline (the 90th percentile)
+#define QUALITY_HEADROOM 0.7f       // A window under this fraction of the deadline may step up
+#define QUALITY_MAX_HOLD 32         // The most good windows a step up waits for
+#define QUALITY_LOG_SIZE 64         // Switches kept in the log
+
+#include "qualityController.h"
+#include "framePipeline.h"
+#include <algorithm>
+#include <functional>
+
+void quality_controller::apply(int rung, pipeline_config& config) const
+{
+    const quality_rung& r = ladder[rung];
+
+    config.filter_manhattan = r.filter_manhattan;
+    config.kmeans_attempts = r.kmeans_attempts;
+    config.kmeans_iterations = r.kmeans_iterations;
+}
+
+void quality_controller::update(int rung, unsigned long long frame_number, int64_t capture_ns, int64_t segment_ns,
+                                int64_t track_ns)
+{
+    // Frames captured before the last switch say nothing about this rung
+    if (rung != current.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    int64_t frame_ns = capture_ns+segment_ns+track_ns;
+    window_ns[n_frames++] = frame_ns;
+    misses += frame_ns > deadline_ns;
+    stage_sums[0] += capture_ns;
+    stage_sums[1] += segment_ns;
+    stage_sums[2] += track_ns;
+
+    if (n_frames < QUALITY_WINDOW)
+    {
+        return;
+    }
+
+    // The time every frame of the window but the allowed misses fit in
+    std::nth_element(window_ns.begin(), window_ns.begin()+QUALITY_MAX_MISSES, window_ns.end(), std::greater<int64_t>());
+
+    quality_switch entry;
+    entry.frame_number = frame_number;
+    entry.frame_ns = window_ns[QUALITY_MAX_MISSES];
+    entry.capture_ns = stage_sums[0]/n_frames;
+    entry.segment_ns = stage_sums[1]/n_frames;
+    entry.track_ns = stage_sums[2]/n_frames;
+
+    bool overrun = misses > QUALITY_MAX_MISSES;
+    bool fits = entry.frame_ns < QUALITY_HEADROOM*deadline_ns;
+
+    n_frames = 0;
+    misses = 0;
+    std::fill(stage_sums, stage_sums+3, 0);
+
+    if (overrun && rung < size()-1)
+    {
+        // A step up that did not hold waits longer before it is tried again
+        if (stepped_up)
+        {
+            hold = std::min(2*hold, QUALITY_MAX_HOLD);
+        }
+
+        step(rung+1, entry);
+        stepped_up = false;
+        return;
+    }
+
+    if (stepped_up)
+    {
+        hold = std::max(hold/2, 1);
+        stepped_up = false;
+    }
+
+    good_windows = fits ? good_windows+1 : 0;
+
+    if (good_windows >= hold && rung > 0)
+    {
+        step(rung-1, entry);
+        stepped_up = true;
+    }
+}
+
+void quality_controller::step(int to, quality_switch& entry)
+{
+    entry.from = current.load(std::memory_order_relaxed);
+    entry.to = to;
+    log[n_switches % QUALITY_LOG_SIZE] = entry;
+    n_switches++;
+
+    good_windows = 0;
+    current.store(to, std::memory_order_relaxed);
+}
+
+void quality_controller::print_log(FILE* out) const
+{
+    fprintf(out, "Quality switches: %d (deadline %.1f ms)\n", n_switches, deadline_ns*1e-6);
+
+    for (int i = std::max(n_switches-QUALITY_LOG_SIZE, 0); i < n_switches; i++)
+    {
+        const quality_switch& s = log[i % QUALITY_LOG_SIZE];
+        fprintf(out, "  frame %llu: rung %d -> %d, p90 %.2f ms (capture %.2f, segment %.2f, track %.2f ms)\n",
+                s.frame_number, s.from, s.to, s.frame_ns*1e-6, s.capture_ns*1e-6, s.segment_ns*1e-6, s.track_ns*1e-6);
+    }
+}
+
+quality_controller::quality_controller(float deadline, const std::vector<quality_rung>& ladder)
+    : deadline_ns((int64_t)(deadline*1e9)), ladder(ladder), current(0), window_ns(QUALITY_WINDOW),
+      log(QUALITY_LOG_SIZE)
+{
+}
@@ -0,0 +1,156 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Holds the tracker to a per-frame time budget by stepping through a ladder
+ * of settings. Rung 0 is the best quality and every rung below it is cheaper:
+ * a smaller scale factor, a smaller segmentation neighborhood, fewer k-means
+ * attempts or iterations. Each rung should have been checked with the tune
+ * tool beforehand, since the controller only looks at time, not accuracy.
+ *
+ * Every frame is stamped with the rung it is captured at and keeps it through
+ * all of the stages, so a frame is never processed half at one rung and half
+ * at another. After a frame is tracked, the time its stages spent on it is
+ * judged against the deadline. Frames are judged a window at a time:
+ *
+ *   - More than a few frames over the deadline steps down one rung.
+ *   - A window whose frames all but those few fit well under the deadline
+ *     counts towards stepping up one rung. The windows needed double every
+ *     time a step up has to be taken back right away, and halve with every
+ *     step up that holds, so a rung that is just too slow is not retried on
+ *     every window.
+ *
+ * Frames still in flight at the old rung after a switch are not judged. Every
+ * switch is kept in a log with the timings of the window that caused it.
+ *
+ *   quality_controller quality(0.016f, params.ladder());
+ *   config.quality = &quality;
+ *   ...
+ *   quality.print_log(stdout);
+ */
+
+#ifndef QUALITYCONTROLLER_H
+#define QUALITYCONTROLLER_H
+
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+#include <vector>
+
+struct pipeline_config;
+
+/**
+ * The settings of one rung of the ladder.
+ */
+struct quality_rung
+{
+    float scale_factor;     // See camera_rig::set_scale_factor
+    int filter_manhattan;   // See depth_cam::filter_background
+    int kmeans_attempts;    // See tracker::cluster
+    int kmeans_iterations;
+};
+
+class quality_controller
+{
+    public:
+        /**
+         * A change of rung and the window of frames that led to it.
+         */
+        struct quality_switch
+        {
+            unsigned long long frame_number;    // The frame that completed the window
+            int from;
+            int to;
+            int64_t frame_ns;       // The time all but the allowed misses of the window fit in
+            int64_t capture_ns;     // The mean time of each stage over the window
+            int64_t segment_ns;
+            int64_t track_ns;
+        };
+
+        /**
+         * @return  the rung new frames are processed at. Can be called from any thread.
+         */
+        int rung(void) const
+        {
+            return current.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @return  the settings of the given rung
+         */
+        const quality_rung& settings(int rung) const
+        {
+            return ladder[rung];
+        }
+
+        /**
+         * @return  the number of rungs
+         */
+        int size(void) const
+        {
+            return (int)ladder.size();
+        }
+
+        /**
+         * Sets the segmentation and clustering parameters of the given rung. The scale
+         * factor is up to the caller, since it is applied when a frame is captured.
+         *
+         * @param   rung    the rung of the frame
+         * @param   config  the configuration to update
+         */
+        void apply(int rung, pipeline_config& config) const;
+
+        /**
+         * Judges a tracked frame and switches rungs at the end of a window. Must only be
+         * called from one thread at a time.
+         *
+         * @param   rung            the rung the frame was processed at
+         * @param   frame_number    the frame, for the log
+         * @param   capture_ns      the time the frame spent in each stage (nanoseconds)
+         * @param   segment_ns
+         * @param   track_ns
+         */
+        void update(int rung, unsigned long long frame_number, int64_t capture_ns, int64_t segment_ns, int64_t track_ns);
+
+        /**
+         * @return  the number of switches so far, including those that fell out of the log
+         */
+        int switch_count(void) const
+        {
+            return n_switches;
+        }
+
+        /**
+         * Prints the logged switches, oldest first. Call once update() is no longer called.
+         */
+        void print_log(FILE* out) const;
+
+        /**
+         * @param   deadline    the time the stages may spend on a frame (seconds)
+         * @param   ladder      the rungs, best quality first. Must not be empty.
+         */
+        quality_controller(float deadline, const std::vector<quality_rung>& ladder);
+
+    private:
+        int64_t deadline_ns;
+        std::vector<quality_rung> ladder;
+        std::atomic<int> current;
+        std::vector<int64_t> window_ns;     // The time of each judged frame of the window
+        int n_frames = 0;                   // Frames judged in the window so far
+        int misses = 0;                     // Of those, the frames over the deadline
+        int64_t stage_sums[3] = {0, 0, 0};  // Capture, segment and track time over the window
+        int hold = 1;                       // Good windows needed to step up
+        int good_windows = 0;               // Good windows in a row at this rung
+        bool stepped_up = false;            // Whether or not the last switch was a step up
+        std::vector<quality_switch> log;    // A ring of the latest switches
+        int n_switches = 0;
+
+        /**
+         * Moves to another rung and logs the switch.
+         *
+         * @param   to      the new rung
+         * @param   entry   the switch, with the timings of the window filled in
+         */
+        void step(int to, quality_switch& entry);
+};
+
+#endif
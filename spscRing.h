@@ -0,0 +1,87 @@
+/**
+ * Author: Adam Mooers
+ *
+ * A bounded, lock-free ring buffer for handing items from exactly one
+ * producer thread to exactly one consumer thread. Storage is fixed at
+ * compile time, so pushing and popping never allocate.
+ */
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @tparam  T   the item type. Items are copied in and out, so keep them small (e.g. pointers).
+ * @tparam  N   the capacity. Must be a power of two.
+ */
+template<class T, size_t N>
+class spsc_ring
+{
+    static_assert(N > 0 && (N & (N-1)) == 0, "spsc_ring capacity must be a power of two");
+
+    public:
+        /**
+         * Appends an item. Only call from the producer thread.
+         *
+         * @return  false if the ring is full
+         */
+        bool push(const T& item)
+        {
+            size_t tail = tail_ind.load(std::memory_order_relaxed);
+
+            if (tail - head_ind.load(std::memory_order_acquire) == N)
+            {
+                return false;
+            }
+
+            items[tail & (N-1)] = item;
+            tail_ind.store(tail+1, std::memory_order_release);
+
+            return true;
+        }
+
+        /**
+         * Removes the oldest item. Only call from the consumer thread.
+         *
+         * @return  false if the ring is empty
+         */
+        bool pop(T& item)
+        {
+            size_t head = head_ind.load(std::memory_order_relaxed);
+
+            if (head == tail_ind.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+
+            item = items[head & (N-1)];
+            head_ind.store(head+1, std::memory_order_release);
+
+            return true;
+        }
+
+        /**
+         * @return  the number of items waiting. Exact only on the consumer thread.
+         */
+        size_t size(void) const
+        {
+            return tail_ind.load(std::memory_order_acquire) - head_ind.load(std::memory_order_acquire);
+        }
+
+        bool empty(void) const
+        {
+            return size() == 0;
+        }
+
+        spsc_ring(void) : head_ind(0), tail_ind(0) {}
+
+    private:
+        // Producer and consumer indices live on separate cache lines to avoid false sharing
+        alignas(64) std::atomic<size_t> head_ind;   // Next item to pop
+        alignas(64) std::atomic<size_t> tail_ind;   // Next free position to push
+        alignas(64) T items[N];
+};
+
+#endif
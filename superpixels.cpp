@@ -0,0 +1,506 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in superpixels.h.
+ */
+
+#define SUPERPIXEL_MIN_BORDER 2         // Neighboring pixel pairs for two superpixels to be connected
+#define SUPERPIXEL_OTHER_VIEW 1e6f      // Penalty for giving a stray pixel to a superpixel of another view
+
+#include "superpixels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/**
+ * Grows a buffer to at least n entries. Buffers never shrink, so they stop
+ * allocating once they have seen the largest frame.
+ */
+template<class T>
+static void grow(std::vector<T>& buffer, size_t n)
+{
+    if (buffer.size() < n)
+    {
+        buffer.resize(n);
+    }
+}
+
+int superpixel_engine::cluster(const std::vector<depth_frame>& views, int max_iter, float compactness, float max_step,
+                               float* centers, int32_t* labels, float* adjacency)
+{
+    const int n_views = (int)views.size();
+
+    // Lay the views out in the maps and build their pinhole rays
+    view_offsets.resize(n_views+1);
+    col_offsets.resize(n_views+1);
+    row_offsets.resize(n_views+1);
+    view_offsets[0] = col_offsets[0] = row_offsets[0] = 0;
+
+    for (int v = 0; v < n_views; v++)
+    {
+        const cv::Mat& depth = views[v].depth;
+        view_offsets[v+1] = view_offsets[v] + depth.rows*depth.cols;
+        col_offsets[v+1] = col_offsets[v] + depth.cols;
+        row_offsets[v+1] = row_offsets[v] + depth.rows;
+    }
+
+    // Views without a calibration stay in camera coordinates
+    if ((int)calibrations.size() < 12*n_views)
+    {
+        const float identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+        const float zero[3] = {0, 0, 0};
+        set_calibration(n_views-1, identity, zero);
+    }
+
+    grow(dist_map, view_offsets[n_views]);
+    grow(label_map, view_offsets[n_views]);
+    grow(ray_cols, col_offsets[n_views]);
+    grow(ray_rows, row_offsets[n_views]);
+
+    int n = 0;
+
+    for (int v = 0; v < n_views; v++)
+    {
+        const depth_frame& f = views[v];
+
+        for (int j = 0; j < f.depth.cols; j++)
+        {
+            ray_cols[col_offsets[v]+j] = (j/f.scale_factor - f.intrin.ppx)/f.intrin.fx;
+        }
+
+        for (int i = 0; i < f.depth.rows; i++)
+        {
+            ray_rows[row_offsets[v]+i] = (i/f.scale_factor - f.intrin.ppy)/f.intrin.fy;
+        }
+
+        cv::Rect roi = depth_cam::frame_window(f);
+
+        for (int i = roi.y; i < roi.y+roi.height; i++)
+        {
+            const uint16_t* row = f.depth.ptr<uint16_t>(i);
+
+            for (int j = roi.x; j < roi.x+roi.width; j++)
+            {
+                n += row[j] != 0;
+            }
+        }
+    }
+
+    if (n < k)
+    {
+        return -1;
+    }
+
+    // One superpixel per step x step pixels of foreground. Cells of that size can hold
+    // no more than step^2 pixels each, so at least k of them have foreground.
+    int step = std::max(1, (int)sqrtf((float)n/k));
+
+    seed(views, step);
+
+    // The labels come from the assignment, so there is always at least one
+    for (int it = 0; it < std::max(max_iter, 1); it++)
+    {
+        iterate(views, step, compactness);
+    }
+
+    int n_labels = write_labels(views, labels);
+    write_centers(views, centers);
+    connect(views, max_step, centers, adjacency);
+
+    return n_labels;
+}
+
+void superpixel_engine::set_mean(const moments& m, superpixel& sp)
+{
+    sp.u = (float)(m.u/m.count);
+    sp.v = (float)(m.v/m.count);
+    sp.x = (float)(m.x/m.count);
+    sp.y = (float)(m.y/m.count);
+    sp.z = (float)(m.z/m.count);
+
+    double mean_sq = sp.x*sp.x + sp.y*sp.y + sp.z*sp.z;
+    sp.radius = (float)sqrt(std::max(m.sq/m.count - mean_sq, 0.0));
+}
+
+void superpixel_engine::seed(const std::vector<depth_frame>& views, int step)
+{
+    const int n_views = (int)views.size();
+
+    // The cells follow the superpixels in sums
+    int n_cells = 0;
+
+    for (int v = 0; v < n_views; v++)
+    {
+        cv::Rect roi = depth_cam::frame_window(views[v]);
+        n_cells += ((roi.width+step-1)/step)*((roi.height+step-1)/step);
+    }
+
+    grow(sums, k+n_cells);
+    moments* cells = &sums[k];
+    int cell_base = 0;
+
+    for (int v = 0; v < n_views; v++)
+    {
+        const depth_frame& f = views[v];
+        cv::Rect roi = depth_cam::frame_window(f);
+        int grid_cols = (roi.width+step-1)/step;
+        int grid_cells = grid_cols*((roi.height+step-1)/step);
+
+        for (int c = cell_base; c < cell_base+grid_cells; c++)
+        {
+            memset(&cells[c], 0, sizeof(moments));
+            cells[c].view = v;
+        }
+
+        for (int i = roi.y; i < roi.y+roi.height; i++)
+        {
+            const uint16_t* row = f.depth.ptr<uint16_t>(i);
+            moments* cell_row = &cells[cell_base + (i-roi.y)/step*grid_cols];
+
+            for (int j = roi.x; j < roi.x+roi.width; j++)
+            {
+                if (row[j] == 0)
+                {
+                    continue;
+                }
+
+                float p[3];
+                point(v, i, j, row[j]*f.depth_scale, p);
+
+                moments& m = cell_row[(j-roi.x)/step];
+                m.count++;
+                m.u += j;
+                m.v += i;
+                m.x += p[0];
+                m.y += p[1];
+                m.z += p[2];
+                m.sq += p[0]*p[0] + p[1]*p[1] + p[2]*p[2];
+            }
+        }
+
+        cell_base += grid_cells;
+    }
+
+    // Seed from the k fullest cells. Partly filled cells lie on the edges, where
+    // their pixels are taken over by the neighboring superpixels.
+    seed_order.clear();
+
+    for (int c = 0; c < n_cells; c++)
+    {
+        if (cells[c].count > 0)
+        {
+            seed_order.push_back(c);
+        }
+    }
+
+    std::nth_element(seed_order.begin(), seed_order.begin()+(k-1), seed_order.end(),
+                     [cells](int a, int b) { return cells[a].count > cells[b].count; });
+
+    pixels.resize(k);
+
+    for (int c = 0; c < k; c++)
+    {
+        const moments& m = cells[seed_order[c]];
+        superpixel& sp = pixels[c];
+        sp.view = m.view;
+        set_mean(m, sp);
+    }
+}
+
+void superpixel_engine::iterate(const std::vector<depth_frame>& views, int step, float compactness)
+{
+    const int n_views = (int)views.size();
+    const float inv_space = 1/(compactness*compactness);
+    const float inv_image = 1.0f/(step*step);
+
+    for (int v = 0; v < n_views; v++)
+    {
+        cv::Rect roi = depth_cam::frame_window(views[v]);
+
+        for (int i = roi.y; i < roi.y+roi.height; i++)
+        {
+            int start = view_offsets[v] + i*views[v].depth.cols + roi.x;
+            std::fill(&dist_map[start], &dist_map[start]+roi.width, INFINITY);
+            std::fill(&label_map[start], &label_map[start]+roi.width, -1);
+        }
+    }
+
+    // Each superpixel only competes for the pixels within one step of its mean
+    for (int c = 0; c < k; c++)
+    {
+        const superpixel& sp = pixels[c];
+        const depth_frame& f = views[sp.view];
+        cv::Rect roi = depth_cam::frame_window(f);
+        int center_col = (int)lroundf(sp.u);
+        int center_row = (int)lroundf(sp.v);
+        int i_end = std::min(roi.y+roi.height, center_row+step+1);
+        int j_start = std::max(roi.x, center_col-step);
+        int j_end = std::min(roi.x+roi.width, center_col+step+1);
+
+        for (int i = std::max(roi.y, center_row-step); i < i_end; i++)
+        {
+            const uint16_t* row = f.depth.ptr<uint16_t>(i);
+            int start = view_offsets[sp.view] + i*f.depth.cols;
+            float* dist = &dist_map[start];
+            int32_t* label = &label_map[start];
+            float di = (i-sp.v)*(i-sp.v);
+
+            for (int j = j_start; j < j_end; j++)
+            {
+                if (row[j] == 0)
+                {
+                    continue;
+                }
+
+                float p[3];
+                point(sp.view, i, j, row[j]*f.depth_scale, p);
+
+                float dx = p[0]-sp.x;
+                float dy = p[1]-sp.y;
+                float dz = p[2]-sp.z;
+                float d = (dx*dx + dy*dy + dz*dz)*inv_space + (di + (j-sp.u)*(j-sp.u))*inv_image;
+
+                if (d < dist[j])
+                {
+                    dist[j] = d;
+                    label[j] = c;
+                }
+            }
+        }
+    }
+
+    // Move every superpixel to the mean of its pixels. Superpixels that lost all
+    // of their pixels stay where they were.
+    memset(sums.data(), 0, k*sizeof(moments));
+
+    for (int v = 0; v < n_views; v++)
+    {
+        const depth_frame& f = views[v];
+        cv::Rect roi = depth_cam::frame_window(f);
+
+        for (int i = roi.y; i < roi.y+roi.height; i++)
+        {
+            const uint16_t* row = f.depth.ptr<uint16_t>(i);
+            const int32_t* label = &label_map[view_offsets[v] + i*f.depth.cols];
+
+            for (int j = roi.x; j < roi.x+roi.width; j++)
+            {
+                if (row[j] == 0 || label[j] < 0)
+                {
+                    continue;
+                }
+
+                float p[3];
+                point(v, i, j, row[j]*f.depth_scale, p);
+
+                moments& m = sums[label[j]];
+                m.count++;
+                m.u += j;
+                m.v += i;
+                m.x += p[0];
+                m.y += p[1];
+                m.z += p[2];
+                m.sq += p[0]*p[0] + p[1]*p[1] + p[2]*p[2];
+            }
+        }
+    }
+
+    for (int c = 0; c < k; c++)
+    {
+        const moments& m = sums[c];
+        superpixel& sp = pixels[c];
+
+        if (m.count > 0)
+        {
+            set_mean(m, sp);
+        }
+    }
+}
+
+int superpixel_engine::write_labels(const std::vector<depth_frame>& views, int32_t* labels)
+{
+    const int n_views = (int)views.size();
+    int n = 0;
+
+    for (int v = 0; v < n_views; v++)
+    {
+        const depth_frame& f = views[v];
+        cv::Rect roi = depth_cam::frame_window(f);
+
+        for (int i = roi.y; i < roi.y+roi.height; i++)
+        {
+            const uint16_t* row = f.depth.ptr<uint16_t>(i);
+            int32_t* label = &label_map[view_offsets[v] + i*f.depth.cols];
+
+            for (int j = roi.x; j < roi.x+roi.width; j++)
+            {
+                if (row[j] == 0)
+                {
+                    continue;
+                }
+
+                if (label[j] < 0)
+                {
+                    // Out of reach of every superpixel, which is rare enough to search them all
+                    float p[3];
+                    point(v, i, j, row[j]*f.depth_scale, p);
+                    float best = INFINITY;
+
+                    for (int c = 0; c < k; c++)
+                    {
+                        const superpixel& sp = pixels[c];
+                        float dx = p[0]-sp.x;
+                        float dy = p[1]-sp.y;
+                        float dz = p[2]-sp.z;
+                        float d = dx*dx + dy*dy + dz*dz + (sp.view != v ? SUPERPIXEL_OTHER_VIEW : 0);
+
+                        if (d < best)
+                        {
+                            best = d;
+                            label[j] = c;
+                        }
+                    }
+                }
+
+                labels[n++] = label[j];
+            }
+        }
+    }
+
+    return n;
+}
+
+void superpixel_engine::connect(const std::vector<depth_frame>& views, float max_step, const float* centers, float* adjacency)
+{
+    const int n_views = (int)views.size();
+
+    grow(border_counts, (size_t)k*k);
+    std::fill(border_counts.begin(), border_counts.begin()+k*k, 0);
+
+    // Count the pairs of neighboring pixels of different superpixels on the same surface
+    for (int v = 0; v < n_views; v++)
+    {
+        const depth_frame& f = views[v];
+        cv::Rect roi = depth_cam::frame_window(f);
+        float max_jump = max_step/f.depth_scale;
+
+        for (int i = roi.y; i < roi.y+roi.height; i++)
+        {
+            const uint16_t* row = f.depth.ptr<uint16_t>(i);
+            const int32_t* label = &label_map[view_offsets[v] + i*f.depth.cols];
+            bool has_below = i+1 < roi.y+roi.height;
+            const uint16_t* below = has_below ? f.depth.ptr<uint16_t>(i+1) : nullptr;
+            const int32_t* label_below = label+f.depth.cols;
+
+            for (int j = roi.x; j < roi.x+roi.width; j++)
+            {
+                if (row[j] == 0)
+                {
+                    continue;
+                }
+
+                int a = label[j];
+
+                if (j+1 < roi.x+roi.width && row[j+1] != 0 && label[j+1] != a &&
+                    fabsf((float)row[j+1]-row[j]) <= max_jump)
+                {
+                    border_counts[a*k+label[j+1]]++;
+                }
+
+                if (has_below && below[j] != 0 && label_below[j] != a &&
+                    fabsf((float)below[j]-row[j]) <= max_jump)
+                {
+                    border_counts[a*k+label_below[j]]++;
+                }
+            }
+        }
+    }
+
+    std::fill(adjacency, adjacency+k*k, 0.0f);
+
+    for (int a = 0; a < k-1; a++)
+    {
+        for (int b = a+1; b < k; b++)
+        {
+            bool neighbors;
+
+            if (pixels[a].view == pixels[b].view)
+            {
+                neighbors = border_counts[a*k+b] + border_counts[b*k+a] >= SUPERPIXEL_MIN_BORDER;
+            }
+            else
+            {
+                // Different cameras see the same surface where their superpixels overlap
+                const float* ca = centers+3*a;
+                const float* cb = centers+3*b;
+                float d[3] = {ca[0]-cb[0], ca[1]-cb[1], ca[2]-cb[2]};
+                float reach = pixels[a].radius + pixels[b].radius;
+                neighbors = d[0]*d[0] + d[1]*d[1] + d[2]*d[2] < reach*reach;
+            }
+
+            if (neighbors)
+            {
+                adjacency[a*k+b] = 1.0f;
+                adjacency[b*k+a] = 1.0f;
+            }
+        }
+    }
+}
+
+void superpixel_engine::write_centers(const std::vector<depth_frame>& views, float* centers)
+{
+    for (int c = 0; c < k; c++)
+    {
+        const superpixel& sp = pixels[c];
+        const rs::intrinsics& intrin = views[sp.view].intrin;
+        rs::float3 p = {sp.x, sp.y, sp.z};
+
+        // Back to the pixel the pinhole model put the mean at, then through the lens model
+        if (sp.z > 0)
+        {
+            rs::float2 pixel = {sp.x/sp.z*intrin.fx + intrin.ppx, sp.y/sp.z*intrin.fy + intrin.ppy};
+            p = intrin.deproject(pixel, sp.z);
+        }
+
+        // Calibrate (row vector convention, p*R + t)
+        const float* rotation = &calibrations[12*sp.view];
+        const float* translation = rotation+9;
+        float* out = centers+3*c;
+
+        out[0] = p.x*rotation[0] + p.y*rotation[3] + p.z*rotation[6] + translation[0];
+        out[1] = p.x*rotation[1] + p.y*rotation[4] + p.z*rotation[7] + translation[1];
+        out[2] = p.x*rotation[2] + p.y*rotation[5] + p.z*rotation[8] + translation[2];
+    }
+}
+
+void superpixel_engine::set_calibration(int view, const float rotation[9], const float translation[3])
+{
+    const float identity[12] = {1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0};
+
+    while ((int)calibrations.size() < 12*(view+1))
+    {
+        calibrations.insert(calibrations.end(), identity, identity+12);
+    }
+
+    memcpy(&calibrations[12*view], rotation, 9*sizeof(float));
+    memcpy(&calibrations[12*view+9], translation, 3*sizeof(float));
+}
+
+void superpixel_engine::reserve(int max_pixels, int max_rows, int max_cols)
+{
+    dist_map.reserve(max_pixels);
+    label_map.reserve(max_pixels);
+    seed_order.reserve(max_pixels);
+    ray_rows.reserve(max_rows);
+    ray_cols.reserve(max_cols);
+
+    // A step of one pixel makes every pixel of the windows a seed cell
+    sums.reserve(k+max_pixels);
+}
+
+superpixel_engine::superpixel_engine(int k) : k(k)
+{
+    pixels.resize(k);
+    sums.resize(k);
+    border_counts.resize(k*k);
+}
@@ -0,0 +1,168 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Clusters the user into superpixels on the depth images instead of running
+ * k-means on the cloud. SLIC is run on the segmented depth image of every
+ * camera: seeds are spread on a grid over the foreground, and each one only
+ * searches the pixels within one grid step of it in the image, so an
+ * iteration costs a few visits per pixel however large k is. Pixels are
+ * compared by their distance in space, scaled by the compactness, plus their
+ * distance in the image, scaled by the grid step.
+ *
+ * Since the superpixels are laid out on the image, the neighbors of a
+ * superpixel are the ones that share a border with it where the depth does
+ * not jump, which replaces the density test of connect_means. A hand in front
+ * of the body borders the torso in the image but not in depth, so it stays
+ * apart. Superpixels of different cameras are connected where they overlap
+ * in space.
+ *
+ * Points are deprojected with a pinhole model while clustering. Only the
+ * final centers go through the full lens model and the calibration.
+ */
+
+#ifndef SUPERPIXELS_H
+#define SUPERPIXELS_H
+
+#include <stdint.h>
+#include <vector>
+#include "depthCamManager.h"
+
+class superpixel_engine
+{
+    public:
+        /**
+         * Clusters the foreground of the views into k superpixels.
+         *
+         * @param   views       the segmented frames. Pixels inside the window of a frame that
+         *                      are not 0 are the foreground.
+         * @param   max_iter    the number of SLIC iterations
+         * @param   compactness the distance in space that weighs as much as one grid step in
+         *                      the image (meters). Smaller values follow the depth more closely.
+         * @param   max_step    the largest depth difference between neighboring pixels of two
+         *                      superpixels for them to be connected (meters)
+         * @param   centers     the k calibrated centers, x, y and z interleaved (output)
+         * @param   labels      the superpixel of every foreground pixel, in the order
+         *                      camera_rig::to_cloud deprojects them (output)
+         * @param   adjacency   the k x k connectivity, 1 for neighbors and 0 otherwise (output)
+         * @return  the number of foreground pixels, or -1 if there are fewer than k
+         */
+        int cluster(const std::vector<depth_frame>& views, int max_iter, float compactness, float max_step,
+                    float* centers, int32_t* labels, float* adjacency);
+
+        /**
+         * Sets the calibration the centers found on a view are transformed by. Views without
+         * one are left in camera coordinates.
+         *
+         * @param   view        the index of the view
+         * @param   rotation    see pointCloud::get_calibration
+         * @param   translation
+         */
+        void set_calibration(int view, const float rotation[9], const float translation[3]);
+
+        /**
+         * Sizes the per-pixel buffers, so clustering does not allocate once it is running.
+         *
+         * @param   max_pixels  the most pixels the views of a frame will have together
+         * @param   max_rows    the most rows the views of a frame will have together
+         * @param   max_cols    the most columns the views of a frame will have together
+         */
+        void reserve(int max_pixels, int max_rows, int max_cols);
+
+        /**
+         * @param   k   the number of superpixels
+         */
+        superpixel_engine(int k);
+
+    private:
+        /**
+         * The state of a superpixel. Positions are in the camera frame of its view.
+         */
+        struct superpixel
+        {
+            int view;
+            float u, v;         // Mean pixel
+            float x, y, z;      // Mean point
+            float radius;       // RMS distance of its points to the mean
+        };
+
+        /**
+         * Sums over the pixels of a superpixel or a seed cell.
+         */
+        struct moments
+        {
+            int view;
+            int count;
+            double u, v;
+            double x, y, z;
+            double sq;          // Sum of the squared norms of the points
+        };
+
+        int k;
+        std::vector<superpixel> pixels;         // The k superpixels
+        std::vector<moments> sums;              // Per superpixel, then per seed cell
+        std::vector<int> seed_order;            // The seed cells, by foreground count
+        std::vector<int> border_counts;         // k x k neighboring pixel pairs
+        std::vector<float> dist_map;            // The distance of every pixel to its superpixel
+        std::vector<int32_t> label_map;         // The superpixel of every pixel, -1 if none
+        std::vector<int> view_offsets;          // The first pixel of each view in the maps
+        std::vector<float> ray_cols;            // x/z of every column of every view (pinhole)
+        std::vector<float> ray_rows;            // y/z of every row of every view
+        std::vector<int> col_offsets;           // The first column of each view in ray_cols
+        std::vector<int> row_offsets;           // The first row of each view in ray_rows
+        std::vector<float> calibrations;        // Rotation then translation of each view
+
+        /**
+         * Spreads the k seeds over the foreground: the views are cut into square cells of
+         * the grid step, and the k cells with the most foreground seed the superpixels.
+         *
+         * @param   step    the grid step (pixels)
+         */
+        void seed(const std::vector<depth_frame>& views, int step);
+
+        /**
+         * Assigns every foreground pixel within one grid step of a superpixel to the
+         * closest one, then moves the superpixels to the means of their pixels.
+         */
+        void iterate(const std::vector<depth_frame>& views, int step, float compactness);
+
+        /**
+         * Gives the foreground pixels no superpixel reached to the closest superpixel
+         * of their view and writes the labels in cloud order.
+         *
+         * @return  the number of labels written
+         */
+        int write_labels(const std::vector<depth_frame>& views, int32_t* labels);
+
+        /**
+         * Connects the superpixels that border each other without a jump in depth, and
+         * those of different views that overlap.
+         *
+         * @param   centers the calibrated centers
+         */
+        void connect(const std::vector<depth_frame>& views, float max_step, const float* centers, float* adjacency);
+
+        /**
+         * Deprojects the superpixel centers through the lens model and calibrates them.
+         */
+        void write_centers(const std::vector<depth_frame>& views, float* centers);
+
+        /**
+         * Moves a superpixel to the mean of its moments.
+         */
+        static void set_mean(const moments& m, superpixel& sp);
+
+        /**
+         * Computes the pinhole point of the pixel (i, j) of a view.
+         *
+         * @param   depth   the depth of the pixel (meters)
+         * @param   p       the point (output)
+         */
+        void point(int view, int i, int j, float depth, float* p) const
+        {
+            p[0] = ray_cols[col_offsets[view]+j]*depth;
+            p[1] = ray_rows[row_offsets[view]+i]*depth;
+            p[2] = depth;
+        }
+};
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in syntheticSource.h.
+ */
+
+#include "syntheticSource.h"
+#include <math.h>
+#include <cstring>
+
+#define SYNTH_DEPTH_SCALE 0.001f    // Meters per depth unit
+#define SYNTH_WALL_DIST 3.0f        // Meters
+#define SYNTH_TORSO_DIST 1.3f       // Meters
+#define SYNTH_SPHERES_PER_LIMB 10
+
+bool synthetic_source::start(void)
+{
+    frame_count = 0;
+    return true;
+}
+
+bool synthetic_source::get_intrinsics(rs::intrinsics& intrin)
+{
+    intrin = synthetic_source::intrin;
+    return true;
+}
+
+bool synthetic_source::next_frame(raw_depth_frame& frame)
+{
+    if (n_frames > 0 && frame_count >= (unsigned long long)n_frames)
+    {
+        return false;
+    }
+
+    double timestamp = frame_count*frame_period;
+    render(timestamp/1000.0);
+
+    frame.data = depth.data();
+    frame.intrin = intrin;
+    frame.depth_scale = SYNTH_DEPTH_SCALE;
+    frame.timestamp = timestamp;
+    frame.frame_number = frame_count++;
+
+    return true;
+}
+
+void synthetic_source::render(double t)
+{
+    // Camera coordinates: x right, y down, z away from the camera
+    float sway = 0.05f*sin(2*M_PI*0.5*t);
+
+    float l_shoulder[3] = { 0.2f, -0.25f, SYNTH_TORSO_DIST};
+    float r_shoulder[3] = {-0.2f, -0.25f, SYNTH_TORSO_DIST};
+    float l_elbow[3] = { 0.3f, -0.15f+sway, 1.05f};
+    float r_elbow[3] = {-0.3f, -0.15f-sway, 1.05f};
+    float l_hand[3] = { 0.25f, -0.1f, 0.8f+sway};
+    float r_hand[3] = {-0.25f, -0.1f, 0.8f-sway};
+
+    spheres.clear();
+    add_limb(l_shoulder, l_elbow, 0.045f);
+    add_limb(l_elbow, l_hand, 0.04f);
+    add_limb(r_shoulder, r_elbow, 0.045f);
+    add_limb(r_elbow, r_hand, 0.04f);
+
+    sphere head = {{0, -0.5f, SYNTH_TORSO_DIST}, 0.11f};
+    spheres.push_back(head);
+
+    for (int v = 0; v < intrin.height; v++)
+    {
+        for (int u = 0; u < intrin.width; u++)
+        {
+            // Ray through the pixel with a unit z component, so t along the ray is the depth
+            float rx = (u-intrin.ppx)/intrin.fx;
+            float ry = (v-intrin.ppy)/intrin.fy;
+            float d_sq = rx*rx + ry*ry + 1;
+            float z = SYNTH_WALL_DIST;
+
+            // Torso: a flat box facing the camera
+            float tx = rx*SYNTH_TORSO_DIST, ty = ry*SYNTH_TORSO_DIST;
+
+            if (tx > -0.2f && tx < 0.2f && ty > -0.35f && ty < 0.4f)
+            {
+                z = SYNTH_TORSO_DIST;
+            }
+
+            for (size_t s = 0; s < spheres.size(); s++)
+            {
+                const sphere& sp = spheres[s];
+                float dc = rx*sp.center[0] + ry*sp.center[1] + sp.center[2];
+                float cc = sp.center[0]*sp.center[0] + sp.center[1]*sp.center[1] + sp.center[2]*sp.center[2];
+                float disc = dc*dc - d_sq*(cc - sp.radius*sp.radius);
+
+                if (disc >= 0)
+                {
+                    float hit = (dc - sqrtf(disc))/d_sq;
+
+                    if (hit > 0 && hit < z)
+                    {
+                        z = hit;
+                    }
+                }
+            }
+
+            // A millimeter of deterministic noise keeps the image from being perfectly smooth
+            uint32_t noise = (uint32_t)(u*73856093u ^ v*19349663u ^ (uint32_t)frame_count*83492791u);
+            depth[v*intrin.width+u] = (uint16_t)((int)(z/SYNTH_DEPTH_SCALE) + (int)((noise >> 16)%3) - 1);
+        }
+    }
+}
+
+void synthetic_source::add_limb(const float a[3], const float b[3], float radius)
+{
+    for (int i = 0; i < SYNTH_SPHERES_PER_LIMB; i++)
+    {
+        float f = (float)i/(SYNTH_SPHERES_PER_LIMB-1);
+        sphere s = {{a[0]+(b[0]-a[0])*f, a[1]+(b[1]-a[1])*f, a[2]+(b[2]-a[2])*f}, radius};
+        spheres.push_back(s);
+    }
+}
+
+synthetic_source::synthetic_source(int width, int height, int n_frames, float frame_rate)
+{
+    synthetic_source::n_frames = n_frames;
+    frame_period = 1000.0f/frame_rate;
+    frame_count = 0;
+
+    // A pinhole model roughly matching the F200/SR300 depth stream
+    memset(&intrin, 0, sizeof(intrin));
+    intrin.width = width;
+    intrin.height = height;
+    intrin.ppx = width/2.0f;
+    intrin.ppy = height/2.0f;
+    intrin.fx = 475.0f*width/640.0f;
+    intrin.fy = 475.0f*width/640.0f;
+    intrin.model = rs::distortion::none;
+
+    depth.resize((size_t)width*height);
+}
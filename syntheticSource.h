@@ -0,0 +1,58 @@
+/**
+ * Author: Adam Mooers
+ *
+ * A depth source that renders a simple scene instead of reading a camera:
+ * a user with both arms reaching towards the camera in front of a wall.
+ * The arms sway a little from frame to frame. Intended for benchmarking
+ * and testing without any hardware attached.
+ */
+
+#ifndef SYNTHETICSOURCE_H
+#define SYNTHETICSOURCE_H
+
+#include "depthSource.h"
+#include <vector>
+
+class synthetic_source : public depth_source
+{
+    public:
+        bool start(void);
+        bool next_frame(raw_depth_frame& frame);
+        bool get_intrinsics(rs::intrinsics& intrin);
+
+        /**
+         * @param   width       the width of the depth image
+         * @param   height      the height of the depth image
+         * @param   n_frames    the number of frames to produce. 0 produces frames forever.
+         * @param   frame_rate  the frame rate the timestamps advance by (Hz)
+         */
+        synthetic_source(int width = 640, int height = 480, int n_frames = 0, float frame_rate = 30);
+
+    private:
+        struct sphere
+        {
+            float center[3];
+            float radius;
+        };
+
+        int n_frames;
+        float frame_period;                 // Milliseconds between frames
+        unsigned long long frame_count;     // Frames produced so far
+        rs::intrinsics intrin;
+        std::vector<uint16_t> depth;        // The most recently rendered frame
+        std::vector<sphere> spheres;        // Scratch for the body parts of the current frame
+
+        /**
+         * Ray casts the scene at the given time into depth.
+         *
+         * @param   t   the time since the start of the stream (seconds)
+         */
+        void render(double t);
+
+        /**
+         * Adds a chain of spheres approximating a capsule from a to b.
+         */
+        void add_limb(const float a[3], const float b[3], float radius);
+};
+
+#endif
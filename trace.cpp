@@ -0,0 +1,265 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in trace.h.
+ */
+
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#define TRACE_MAX_POINTS 256
+#define TRACE_RING_SIZE 16384       // Recent events kept per thread. Must be a power of two.
+
+/**
+ * One timed span, as kept in the per-thread rings.
+ */
+struct trace_event
+{
+    const trace_point* point;
+    int64_t start_ns;
+    int64_t end_ns;
+};
+
+/**
+ * The recent events of one thread. Only the owning thread writes; readers
+ * detect entries that were overwritten while they copied them using head.
+ */
+struct thread_ring
+{
+    const char* name = nullptr;
+    int tid;
+    std::atomic<uint64_t> head;     // Number of events ever written
+    trace_event events[TRACE_RING_SIZE];
+};
+
+static std::mutex registry_lock;                    // Guards registration only, never recording
+static trace_point* points[TRACE_MAX_POINTS];
+static std::atomic<int> n_points(0);
+static std::vector<thread_ring*> rings;             // Rings outlive their threads so they can be dumped
+static thread_local thread_ring* local_ring = nullptr;
+
+/**
+ * @return  the calling thread's ring, created on first use
+ */
+static thread_ring* get_ring(void)
+{
+    if (local_ring == nullptr)
+    {
+        thread_ring* ring = new thread_ring();
+        ring->head = 0;
+
+        std::lock_guard<std::mutex> lock(registry_lock);
+        ring->tid = (int)rings.size()+1;
+        rings.push_back(ring);
+        local_ring = ring;
+    }
+
+    return local_ring;
+}
+
+int64_t trace_now_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void latency_histogram::record(int64_t ns)
+{
+    ns = std::max<int64_t>(ns, 0);
+
+    buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    n.fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(ns, std::memory_order_relaxed);
+
+    int64_t cur_max = max_ns.load(std::memory_order_relaxed);
+
+    while (ns > cur_max && !max_ns.compare_exchange_weak(cur_max, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+int64_t latency_histogram::percentile(double p) const
+{
+    uint64_t total = count();
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    // The rank of the sample at the percentile, counting from 1
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)(p*total + 0.5));
+    uint64_t seen = 0;
+
+    for (int b = 0; b < n_buckets; b++)
+    {
+        seen += buckets[b].load(std::memory_order_relaxed);
+
+        if (seen >= rank)
+        {
+            return std::min(bucket_max(b), max());
+        }
+    }
+
+    return max();
+}
+
+double latency_histogram::mean(void) const
+{
+    uint64_t total = count();
+    return total ? (double)sum_ns.load(std::memory_order_relaxed)/total : 0;
+}
+
+int latency_histogram::bucket_of(int64_t ns)
+{
+    // The first power-of-two range is exact
+    if (ns < sub_count)
+    {
+        return (int)ns;
+    }
+
+    int msb = 63-__builtin_clzll((uint64_t)ns);
+    int shift = msb-sub_bits;
+
+    return (shift+1)*sub_count + (int)((ns >> shift) - sub_count);
+}
+
+int64_t latency_histogram::bucket_max(int bucket)
+{
+    if (bucket < sub_count)
+    {
+        return bucket;
+    }
+
+    int shift = bucket/sub_count - 1;
+    int64_t sub = bucket%sub_count + sub_count;
+
+    return ((sub+1) << shift) - 1;
+}
+
+latency_histogram::latency_histogram(void) : n(0), sum_ns(0), max_ns(0)
+{
+    for (int b = 0; b < n_buckets; b++)
+    {
+        buckets[b] = 0;
+    }
+}
+
+void trace_point::record(int64_t start_ns, int64_t end_ns)
+{
+    histogram.record(end_ns-start_ns);
+
+    thread_ring* ring = get_ring();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    trace_event& event = ring->events[head & (TRACE_RING_SIZE-1)];
+
+    event.point = this;
+    event.start_ns = start_ns;
+    event.end_ns = end_ns;
+
+    ring->head.store(head+1, std::memory_order_release);
+}
+
+trace_point::trace_point(const char* name) : name(name)
+{
+    std::lock_guard<std::mutex> lock(registry_lock);
+    int ind = n_points.load();
+
+    // Points past the limit are still timed, just not reported
+    if (ind < TRACE_MAX_POINTS)
+    {
+        points[ind] = this;
+        n_points.store(ind+1);
+    }
+}
+
+void trace_thread_name(const char* name)
+{
+    get_ring()->name = name;
+}
+
+void trace_print_summary(FILE* out)
+{
+    int count = n_points.load();
+
+    fprintf(out, "%-24s %10s %10s %10s %10s %10s %10s\n", "trace point (us)", "count", "mean", "p50", "p99", "p999", "max");
+
+    for (int i = 0; i < count; i++)
+    {
+        const latency_histogram& h = points[i]->histogram;
+
+        if (h.count() == 0)
+        {
+            continue;
+        }
+
+        fprintf(out, "%-24s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", points[i]->name,
+                (unsigned long long)h.count(), h.mean()/1000.0, h.percentile(0.5)/1000.0,
+                h.percentile(0.99)/1000.0, h.percentile(0.999)/1000.0, h.max()/1000.0);
+    }
+}
+
+bool trace_dump_chrome(const char* path)
+{
+    FILE* out = fopen(path, "w");
+
+    if (out == nullptr)
+    {
+        perror("Unable to write the trace");
+        return false;
+    }
+
+    std::vector<thread_ring*> ring_list;
+
+    {
+        std::lock_guard<std::mutex> lock(registry_lock);
+        ring_list = rings;
+    }
+
+    std::vector<trace_event> events(TRACE_RING_SIZE);
+    bool first = true;
+
+    fprintf(out, "{\"traceEvents\":[\n");
+
+    for (size_t r = 0; r < ring_list.size(); r++)
+    {
+        thread_ring* ring = ring_list[r];
+
+        if (ring->name)
+        {
+            fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", ring->tid, ring->name);
+            first = false;
+        }
+
+        // Copy the newest events, then drop any the owner overwrote during the copy
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = head > TRACE_RING_SIZE ? head-TRACE_RING_SIZE : 0;
+
+        for (uint64_t i = begin; i < head; i++)
+        {
+            events[i-begin] = ring->events[i & (TRACE_RING_SIZE-1)];
+        }
+
+        // The owner may be writing event new_head, which shares its slot with new_head-TRACE_RING_SIZE
+        uint64_t new_head = ring->head.load(std::memory_order_acquire);
+        uint64_t valid = new_head >= TRACE_RING_SIZE ? std::max(begin, new_head-TRACE_RING_SIZE+1) : begin;
+
+        for (uint64_t i = valid; i < head; i++)
+        {
+            const trace_event& event = events[i-begin];
+
+            fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n", event.point->name, ring->tid,
+                    event.start_ns/1000.0, (event.end_ns-event.start_ns)/1000.0);
+            first = false;
+        }
+    }
+
+    fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    return fclose(out) == 0;
+}
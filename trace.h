@@ -0,0 +1,179 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Low-overhead instrumentation for the hot path. TRACE_SCOPE times the
+ * enclosing scope; every measurement goes into the calling thread's own
+ * ring of recent events and into a log-linear latency histogram for the
+ * trace point. Nothing is locked on the hot path: the rings have a single
+ * writer and the histograms use relaxed atomic counters.
+ *
+ * Tracing is compiled in with -DTRACE_ENABLED (make TRACE=1). Without it
+ * the macros expand to nothing. The reporting functions still exist, but
+ * have nothing to report.
+ *
+ *   void segment(...)
+ *   {
+ *       TRACE_SCOPE("filter_background");
+ *       ...
+ *   }
+ *
+ *   trace_print_summary(stdout);        // p50/p99/p999/max per trace point
+ *   trace_dump_chrome("trace.json");    // open in chrome://tracing or Perfetto
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <stdint.h>
+#include <cstdio>
+
+/**
+ * @return  the current time on the monotonic clock used by all trace points (nanoseconds)
+ */
+int64_t trace_now_ns(void);
+
+/**
+ * A histogram of durations with buckets of constant relative width, in the
+ * spirit of HdrHistogram. Each power of two is split into 2^sub_bits linear
+ * buckets, so any recorded value is reported within ~3%.
+ */
+class latency_histogram
+{
+    public:
+        /**
+         * Adds one duration. Safe to call from any number of threads.
+         *
+         * @param   ns      the duration (nanoseconds)
+         */
+        void record(int64_t ns);
+
+        /**
+         * @param   p       the fraction of samples at or below the result, 0 to 1
+         * @return  the duration at the given percentile (nanoseconds)
+         */
+        int64_t percentile(double p) const;
+
+        uint64_t count(void) const
+        {
+            return n.load(std::memory_order_relaxed);
+        }
+
+        int64_t max(void) const
+        {
+            return max_ns.load(std::memory_order_relaxed);
+        }
+
+        double mean(void) const;
+
+        latency_histogram(void);
+
+    private:
+        static const int sub_bits = 5;
+        static const int sub_count = 1 << sub_bits;
+        static const int n_buckets = (64-sub_bits)*sub_count;
+
+        std::atomic<uint64_t> buckets[n_buckets];
+        std::atomic<uint64_t> n;
+        std::atomic<int64_t> sum_ns;
+        std::atomic<int64_t> max_ns;
+
+        static int bucket_of(int64_t ns);
+
+        /**
+         * @return  the largest value that falls into the given bucket
+         */
+        static int64_t bucket_max(int bucket);
+};
+
+/**
+ * A named location in the code that durations are recorded for. Trace points
+ * are created once (as function statics by the macros) and live forever.
+ */
+class trace_point
+{
+    public:
+        const char* name;
+        latency_histogram histogram;
+
+        /**
+         * Records a measured span of this trace point.
+         *
+         * @param   start_ns    the start of the span (trace_now_ns)
+         * @param   end_ns      the end of the span (trace_now_ns)
+         */
+        void record(int64_t start_ns, int64_t end_ns);
+
+        /**
+         * @param   name    the name shown in the reports. Must outlive the program (a literal).
+         */
+        trace_point(const char* name);
+};
+
+/**
+ * Times its own lifetime into a trace point.
+ */
+class trace_scope
+{
+    public:
+        trace_scope(trace_point& point) : point(point), start_ns(trace_now_ns()) {}
+
+        ~trace_scope(void)
+        {
+            point.record(start_ns, trace_now_ns());
+        }
+
+    private:
+        trace_point& point;
+        int64_t start_ns;
+};
+
+/**
+ * Names the calling thread in the Chrome trace.
+ *
+ * @param   name    the thread name. Must outlive the program (a literal).
+ */
+void trace_thread_name(const char* name);
+
+/**
+ * Prints the count, mean, p50, p99, p999 and max of every trace point.
+ */
+void trace_print_summary(FILE* out);
+
+/**
+ * Writes the recent events of every thread in Chrome trace_event JSON format.
+ * May be called while other threads are tracing.
+ *
+ * @param   path    the file to create/overwrite
+ * @return  whether or not the file could be written
+ */
+bool trace_dump_chrome(const char* path);
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef TRACE_ENABLED
+
+// Times the rest of the enclosing scope
+#define TRACE_SCOPE(name) \
+    static trace_point TRACE_CONCAT(trace_point_, __LINE__)(name); \
+    trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(TRACE_CONCAT(trace_point_, __LINE__))
+
+// Records the time from start_ns (trace_now_ns) until now, e.g. a latency across threads
+#define TRACE_SINCE(name, start_ns) \
+    do { \
+        static trace_point TRACE_CONCAT(trace_point_, __LINE__)(name); \
+        TRACE_CONCAT(trace_point_, __LINE__).record(start_ns, trace_now_ns()); \
+    } while (0)
+
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_SINCE(name, start_ns) do { } while (0)
+#define TRACE_THREAD_NAME(name) do { } while (0)
+
+#endif
+
+#endif
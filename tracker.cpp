@@ -5,112 +5,264 @@
  */
 
 #include "tracker.h"
+#include "cloudKernels.h"
+#include "superpixels.h"
 #include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
 #include <iostream>
 #include <math.h>
 
-void tracker::update_point_cloud(pointCloud source)
+template<class Config>
+void basic_tracker<Config>::update_point_cloud(const pointCloud& source)
 {
     source_cloud = source.cloud_array;
     cluster_ind.resize(source_cloud.rows);
 }
 
-bool tracker::cluster(int n, int max_iter, double epsilon)
+template<class Config>
+void basic_tracker<Config>::reserve(int max_points, int attempts, int view_rows, int view_cols)
 {
-    // Setup kmeans to terminate after a set number of iterations or when the points have converged
-    cv::TermCriteria crit(cv::TermCriteria::EPS+cv::TermCriteria::COUNT, max_iter, epsilon);
+    // Resizing within the reserved rows keeps the buffer
+    cluster_ind.reserve(max_points);
+    engine->reserve(max_points, attempts);
+    superpixels->reserve(max_points, view_rows, view_cols);
+}
 
-    if (source_cloud.rows < k)
+template<class Config>
+bool basic_tracker<Config>::cluster(int n, int max_iter, double epsilon)
+{
+    if (source_cloud.rows < num_clusters())
     {
         // Not enough data, so clear the buffers
-        cluster_ind = cv::Mat(0, 1, CV_32FC1);
+        cluster_ind.resize(0);
+        return false;
+    }
+
+    // Warm start from the last frame's centers once there are any
+    engine->cluster(source_cloud.ptr<float>(0), source_cloud.rows, n, max_iter, epsilon,
+                    centers.ptr<float>(0), cluster_ind.ptr<int32_t>(0), has_centers);
+
+    has_centers = true;
+
+    return true;
+}
+
+template<class Config>
+bool basic_tracker<Config>::cluster_superpixels(const std::vector<depth_frame>& views, int max_iter,
+                                                float compactness, float max_step)
+{
+    int max_labels = 0;
+
+    for (const depth_frame& view : views)
+    {
+        max_labels += view.depth.rows*view.depth.cols;
+    }
+
+    if (max_labels < num_clusters())
+    {
+        cluster_ind.resize(0);
         return false;
     }
 
-    int flags = cv::KMEANS_PP_CENTERS;  // Use kmeans++ heuristic
-    
-    if (cluster_ind.rows == 0)
+    // Room for every pixel, then trimmed to the foreground
+    cluster_ind.resize(max_labels);
+    int n = superpixels->cluster(views, max_iter, compactness, max_step, centers.ptr<float>(0),
+                                 cluster_ind.ptr<int32_t>(0), adj_kmeans.ptr<float>(0));
+
+    if (n < 0)
     {
-        printf("Triggered\n");
-        flags += cv::KMEANS_USE_INITIAL_LABELS;
+        cluster_ind.resize(0);
+        return false;
     }
 
-    // Calculate k-means
-    cv::kmeans(source_cloud, k, cluster_ind, crit, n, flags, centers);
+    cluster_ind.resize(n);
+    adj_graph.clear();
+
+    for (int row = 0; row < num_clusters()-1; ++row)
+    {
+        for (int col = row+1; col < num_clusters(); ++col)
+        {
+            if (adj_kmeans.at<float>(row, col) > 0)
+            {
+                adj_graph.connect(row, col);
+            }
+        }
+    }
+
+    // k-means warm-starts from the superpixels if the engines are switched
+    has_centers = true;
 
     return true;
 }
 
-void tracker::connect_means(float threshold)
+template<class Config>
+void basic_tracker<Config>::set_view_calibration(int view, const float rotation[9], const float translation[3])
+{
+    superpixels->set_calibration(view, rotation, translation);
+}
+
+// Points per block of distances. Keeps a block of distances in the L1 cache.
+#define CONNECT_BLOCK_POINTS 64
+
+// Fewest points worth handing to another thread
+#define CONNECT_MIN_CHUNK_POINTS 1024
+
+// Padding centers sit far away so their weights vanish
+#define CONNECT_FAR_AWAY 1e15f
+
+template<class Config>
+void basic_tracker<Config>::connect_means(float threshold)
 {
-	cv::Mat k_histogram = cv::Mat::zeros(k, 1, CV_32FC1);
-	
-	// Clear the matrix
-	adj_kmeans = adj_kmeans*0;
-	
-	// for each point in the cloud
-	for (int r_cl=0; r_cl<source_cloud.rows; r_cl++)
+	// Constants when the configuration fixes k, so the loops over the clusters unroll
+	const int k = num_clusters();
+	const int kp = padded_clusters();
+	const int n = source_cloud.rows;
+	const float* points = source_cloud.ptr<float>(0);
+	const int32_t* labels = cluster_ind.ptr<int32_t>(0);
+
+	float* cx = center_soa.data();
+	float* cy = cx+kp;
+	float* cz = cy+kp;
+
+	for (int c = 0; c < k; c++)
 	{
-		int32_t curKInd = cluster_ind.at<int32_t>(r_cl,0);
-		
-		// Calculate distance to the center of the home cluster
-		float homeDist = cv::norm(centers.row(curKInd), source_cloud.row(r_cl));
-		
-		// Update histogram for normalization
-		k_histogram.at<float>(curKInd,0) += 1;
-		
-		// for each k-mean
-		for(int r_center=0; r_center<centers.rows; r_center++)
+		cx[c] = centers.at<float>(c,0);
+		cy[c] = centers.at<float>(c,1);
+		cz[c] = centers.at<float>(c,2);
+	}
+
+	const int n_chunks = std::max(1, std::min(workers.size(), n/CONNECT_MIN_CHUNK_POINTS));
+	const int chunk_size = (n+n_chunks-1)/n_chunks;
+
+	// Each chunk of points sums its weights into its own tile, so no locking is needed
+	auto accumulate = [&](int chunk)
+	{
+		float* tile = &connect_tiles[chunk*k*kp];
+		int* counts = &connect_counts[chunk*k];
+		float* dist = &connect_dist[chunk*CONNECT_BLOCK_POINTS*kp];
+		const int end = std::min(n, (chunk+1)*chunk_size);
+
+		std::fill(tile, tile+k*kp, 0.f);
+		std::fill(counts, counts+k, 0);
+
+		for (int block = chunk*chunk_size; block < end; block += CONNECT_BLOCK_POINTS)
 		{
-			// Add to all except the diagonal
-			if (r_center != curKInd)
+			const int block_n = std::min(CONNECT_BLOCK_POINTS, end-block);
+			point_center_distances(points+3*block, block_n, cx, cy, cz, kp, dist);
+
+			for (int i = 0; i < block_n; i++)
 			{
-				// Find the L2 dist from the current point to the current k-mean center,
-				float deltaDist = cv::norm(centers.row(r_center), source_cloud.row(r_cl));
+				const int home = labels[block+i];
+				const float* d = dist+i*kp;
+				const float home_dist = d[home];
+				float* row = tile+home*kp;
 
-				// How much closer is the pint to its own cluster than the current one?
-				deltaDist = (float)fabs(deltaDist-homeDist);
-			
-				// Update adjacency matrix
-				adj_kmeans.at<float>(r_center, curKInd) += 1/deltaDist;
+				counts[home]++;
 
-				// Graph is not directed
-				adj_kmeans.at<float>(curKInd, r_center) = adj_kmeans.at<float>(r_center, curKInd);
+				// How much closer is the point to its own cluster than each other one?
+				// The home cluster is skipped by splitting the loop around it.
+				for (int c = 0; c < home; c++)
+				{
+					row[c] += 1/fabsf(d[c]-home_dist);
+				}
+
+				for (int c = home+1; c < kp; c++)
+				{
+					row[c] += 1/fabsf(d[c]-home_dist);
+				}
 			}
 		}
-	}
+	};
+
+	workers.run(n_chunks, accumulate);
 
-	// Normalize density
-	for (int j=0; j<adj_kmeans.rows; j++)
+	// Reduce the tiles into the first one
+	float* sums = connect_tiles.data();
+	int* hist = connect_counts.data();
+
+	for (int chunk = 1; chunk < n_chunks; chunk++)
 	{
-		adj_kmeans.col(j) /= k_histogram;
-		adj_kmeans.row(j) /= k_histogram.t();
+		const float* tile = &connect_tiles[chunk*k*kp];
+		const int* counts = &connect_counts[chunk*k];
+
+		for (int i = 0; i < k*kp; i++)
+		{
+			sums[i] += tile[i];
+		}
+
+		for (int c = 0; c < k; c++)
+		{
+			hist[c] += counts[c];
+		}
 	}
-	
-	// Remove below cutoff weight
-	for( int row = 0; row < adj_kmeans.rows-1; ++row)
+
+	// The graph is not directed, so both directions count towards an edge.
+	// Normalize by the density and remove below the cutoff weight.
+	adj_graph.clear();
+	adj_kmeans.setTo(0);
+
+	for (int row = 0; row < k-1; ++row)
 	{
-		for( int col = row+1; col < adj_kmeans.cols; ++col)
+		for (int col = row+1; col < k; ++col)
 		{
-			adj_kmeans.at<float>(row, col) = adj_kmeans.at<float>(row, col)>threshold? 1.f:0.f;
+			float weight = (sums[row*kp+col] + sums[col*kp+row]) / ((float)hist[row]*hist[col]);
+
+			if (weight > threshold)
+			{
+				adj_graph.connect(row, col);
+				adj_kmeans.at<float>(row, col) = 1.f;
+				adj_kmeans.at<float>(col, row) = 1.f;
+			}
 		}
 	}
-
-	// Make the matrix symmetrical after the thesholding
-	cv::completeSymm(adj_kmeans);
 }
 
-tracker::tracker(int k)
+template<class Config>
+basic_tracker<Config>::basic_tracker(int k)
 {
-    tracker::k = k;
+    basic_tracker::k = k = Config::k > 0 ? Config::k : k;
+    has_centers = false;
     cluster_ind = cv::Mat(0, 1, CV_32SC1);
-    adj_kmeans = cv::Mat(k, k, CV_32FC1);
-    centers = cv::Mat(k, 3, CV_32FC1);
+    engine = kmeans_engine::create(k, &workers);
+    superpixels = new superpixel_engine(k);
+    adj_graph.resize(k);
+
+    // The matrices are views of the fixed storage
+    config_storage<float, 3*Config::k>::size(center_storage, 3*k, 0);
+    config_storage<float, Config::k*Config::k>::size(adj_storage, k*k, 0);
+    centers = cv::Mat(k, 3, CV_32FC1, center_storage.data());
+    adj_kmeans = cv::Mat(k, k, CV_32FC1, adj_storage.data());
+
+    k_padded = (k+3)/4*4;
+    config_storage<float, 3*Config::k_padded>::size(center_soa, 3*k_padded, CONNECT_FAR_AWAY);
+    connect_tiles.resize(workers.size()*k*k_padded);
+    connect_counts.resize(workers.size()*k);
+    connect_dist.resize(workers.size()*CONNECT_BLOCK_POINTS*k_padded);
+}
+
+template<class Config>
+basic_tracker<Config>::~basic_tracker(void)
+{
+    delete engine;
+    delete superpixels;
 }
 
-bool arm::update_arm_list()
+/**
+ * @return  the distance between two points (x,y,z)
+ */
+static inline float distance3(const float* a, const float* b)
+{
+	float dx = a[0]-b[0];
+	float dy = a[1]-b[1];
+	float dz = a[2]-b[2];
+
+	return sqrtf(dx*dx + dy*dy + dz*dz);
+}
+
+template<class Config>
+bool basic_arm<Config>::update_arm_list()
 {
-	kmean_ind.clear();
+	chain_length = 0;
 	int hand_ind = find_closest_center_hand();
 
 	// Was the hand_index found?
@@ -119,26 +271,27 @@ bool arm::update_arm_list()
 		return false;
 	}
 
-	cv::Mat adj = source->adj_kmeans;
-	cv::Mat ctrs = source->centers;
+	const adjacency_graph<Config::k>& adj = source->adj_graph;
+	const float* ctrs = source->centers.template ptr<float>(0);	// k x 3
 
-	kmean_ind.push_back(hand_ind);
+	kmean_ind[chain_length++] = hand_ind;
 
-	float x_last = ctrs.at<float>(hand_ind,0);
-	float z_last = ctrs.at<float>(hand_ind,2);
-	float orientation = start_pos.at<float>(0,0)>0?-1:1;
+	float x_last = ctrs[hand_ind*3+0];
+	float z_last = ctrs[hand_ind*3+2];
+	float orientation = start_pos[0]>0?-1:1;
 
-	for(int cur_ind = hand_ind;;)
+	// The chain only climbs in z, so it never holds more than k centers
+	for(int cur_ind = hand_ind; chain_length < adj.size();)
 	{
 		float furthest_dist = 0;
 
 		// For each hand index
-		for (int n_ind=0; n_ind<adj.cols; n_ind++)
+		for (int n_ind=0; n_ind<adj.size(); n_ind++)
 		{
-			if (adj.at<float>(cur_ind,n_ind) > 0.5 &&					// Is center a neighbor?
-				ctrs.at<float>(cur_ind,2) < ctrs.at<float>(n_ind,2))	// is z greater?
+			if (adj.connected(cur_ind,n_ind) &&					// Is center a neighbor?
+				ctrs[cur_ind*3+2] < ctrs[n_ind*3+2])			// is z greater?
 			{
-				float dist2mean = -orientation*ctrs.at<float>(n_ind,0);
+				float dist2mean = -orientation*ctrs[n_ind*3+0];
 				
 				if (dist2mean > furthest_dist)
 				{
@@ -155,8 +308,8 @@ bool arm::update_arm_list()
 		}
 		else
 		{
-			float x_cur = ctrs.at<float>(cur_ind,0);
-			float z_cur = ctrs.at<float>(cur_ind,2);
+			float x_cur = ctrs[cur_ind*3+0];
+			float z_cur = ctrs[cur_ind*3+2];
 			float dx_dz = (x_cur-x_last)/(z_cur-z_last);
 
 			// Correct slope depending on if arm is left or right
@@ -172,43 +325,52 @@ bool arm::update_arm_list()
 		}
 
 		// Push to list
-		kmean_ind.push_back(cur_ind);
+		kmean_ind[chain_length++] = cur_ind;
 	}
 
-	return kmean_ind.size()>=3?true:false;	// Atleast 3 joints needed to form arm
+	return chain_length>=3?true:false;	// Atleast 3 joints needed to form arm
 }
 
-void arm::update_elbow_approx(void)
+template<class Config>
+void basic_arm<Config>::update_elbow_approx(void)
 {
 	elbow_approx_ind = -1;
 	float dist_mult_max = 0;
 
-	for (std::list<int>::const_iterator ci = kmean_ind.begin(); ci != kmean_ind.end(); ++ci)
+	const float* ctrs = source->centers.template ptr<float>(0);
+	const float* hand = ctrs + 3*kmean_ind[0];
+	const float* shoulder = ctrs + 3*kmean_ind[chain_length-1];
+
+	for (int i = 0; i < chain_length; i++)
     {
+		const float* center = ctrs + 3*kmean_ind[i];
+
 		float dist_mult = 1;
-		dist_mult *= cv::norm(source->centers.row(*ci), source->centers.row(kmean_ind.front()));
-		dist_mult *= cv::norm(source->centers.row(*ci), source->centers.row(kmean_ind.back()));
+		dist_mult *= distance3(center, hand);
+		dist_mult *= distance3(center, shoulder);
 
 		if (dist_mult > dist_mult_max)
 		{
 			dist_mult_max = dist_mult;
-			elbow_approx_ind = *ci;
+			elbow_approx_ind = kmean_ind[i];
 		}
 	}
 }
 
-int arm::find_closest_center_hand(void)
+template<class Config>
+int basic_arm<Config>::find_closest_center_hand(void)
 {
 	int closest_ind = -1;
 	float closest_dist = FLT_MAX;
+	const float* ctrs = source->centers.template ptr<float>(0);
 
 	// For each row in the kmeans
-	for (int r_c=0; r_c<source->centers.rows; r_c++)
+	for (int r_c=0; r_c<source->num_clusters(); r_c++)
 	{
 		// Make sure the new point has a greater Z
-		if (start_pos.at<float>(0,2) <= source->centers.at<float>(0,2))
+		if (start_pos[2] <= ctrs[2])
 		{
-			float deltaDist = cv::norm(source->centers.row(r_c), start_pos);
+			float deltaDist = distance3(ctrs + 3*r_c, start_pos);
 
 			if (deltaDist < closest_dist && deltaDist < max_dist_to_start)
 			{
@@ -221,7 +383,8 @@ int arm::find_closest_center_hand(void)
 	return closest_ind;
 }
 
-bool arm::update_joints(float smoothing_factor)
+template<class Config>
+bool basic_arm<Config>::update_joints(float smoothing_factor)
 {
 	tracking_step++;
 
@@ -236,15 +399,16 @@ bool arm::update_joints(float smoothing_factor)
 	update_elbow_approx();
 	last_tracked_step = tracking_step;
 
-	cv::Mat next_hand_loc =  source->centers.row(kmean_ind.front());
-	cv::Mat next_elbow_loc =  source->centers.row(elbow_approx_ind);
-	cv::Mat next_shoulder_loc = source->centers.row(kmean_ind.back());
+	const float* ctrs = source->centers.template ptr<float>(0);
+	const float* next_hand_loc = ctrs + 3*kmean_ind[0];
+	const float* next_elbow_loc = ctrs + 3*elbow_approx_ind;
+	const float* next_shoulder_loc = ctrs + 3*kmean_ind[chain_length-1];
 
 	if (!is_tracking)
 	{
-		next_hand_loc.copyTo(hand_loc);
-		next_elbow_loc.copyTo(elbow_loc);
-		next_shoulder_loc.copyTo(shoulder_loc);
+		std::copy(next_hand_loc, next_hand_loc+3, hand_loc);
+		std::copy(next_elbow_loc, next_elbow_loc+3, elbow_loc);
+		std::copy(next_shoulder_loc, next_shoulder_loc+3, shoulder_loc);
 	}
 	else
 	{
@@ -256,26 +420,55 @@ bool arm::update_joints(float smoothing_factor)
 	return true;
 }
 
-void arm::lerp(cv::Mat target, cv::Mat& current, float t)
+template<class Config>
+void basic_arm<Config>::lerp(const float* target, float* current, float t)
 {
-	current = current+(current-target)*-t;
+	for (int i = 0; i < 3; i++)
+	{
+		current[i] += (target[i]-current[i])*t;
+	}
 }
 
-float arm::get_bend_angle()
+template<class Config>
+float basic_arm<Config>::get_bend_angle()
 {
-	cv::Mat u_arm_vec = hand_loc-elbow_loc;
-	cv::Mat f_arm_vec = elbow_loc-shoulder_loc;
+	float u_arm_vec[3];
+	float f_arm_vec[3];
+	float cos_angle = 0;
 
-	float cos_angle = f_arm_vec.dot(u_arm_vec);
-	cos_angle /= (cv::norm(f_arm_vec) * cv::norm(u_arm_vec));
+	for (int i = 0; i < 3; i++)
+	{
+		u_arm_vec[i] = hand_loc[i]-elbow_loc[i];
+		f_arm_vec[i] = elbow_loc[i]-shoulder_loc[i];
+		cos_angle += f_arm_vec[i]*u_arm_vec[i];
+	}
+
+	float zero[3] = {0, 0, 0};
+	cos_angle /= (distance3(f_arm_vec, zero) * distance3(u_arm_vec, zero));
 
 	return acos(cos_angle)*180/M_PI;
 }
 
-arm::arm(tracker& source, cv::Mat start_pos, float max_dist_to_start, float dxdz_threshold)
+template<class Config>
+basic_arm<Config>::basic_arm(basic_tracker<Config>& source, cv::Mat start_pos, float max_dist_to_start, float dxdz_threshold)
 {
-	arm::max_dist_to_start = max_dist_to_start;
-	arm::start_pos = start_pos;
-	arm::source = &source;
-	arm::dxdz_threshold = dxdz_threshold;
-}
\ No newline at end of file
+	basic_arm::max_dist_to_start = max_dist_to_start;
+	basic_arm::source = &source;
+	basic_arm::dxdz_threshold = dxdz_threshold;
+
+	for (int i = 0; i < 3; i++)
+	{
+		basic_arm::start_pos[i] = start_pos.at<float>(0, i);
+		hand_loc[i] = 0;
+		elbow_loc[i] = 0;
+		shoulder_loc[i] = 0;
+	}
+
+	config_storage<int, Config::k>::size(kmean_ind, source.num_clusters(), -1);
+}
+
+// The configurations pose and the tools are built with
+template class basic_tracker<compiled_tracker_config>;
+template class basic_tracker<runtime_tracker_config>;
+template class basic_arm<compiled_tracker_config>;
+template class basic_arm<runtime_tracker_config>;
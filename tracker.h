@@ -6,6 +6,12 @@
  * several degrees-of-freedom from the model. These serve as the start point to
  * building the skeleton model of the user. kmeans is used to cluster groups
  * of input points.
+ *
+ * The tracker and the arms are templated on a tracker_config (see
+ * trackerConfig.h). The compiled configuration fixes k, so the centers,
+ * the adjacency and the joint chain live in fixed-size arrays. The
+ * runtime configuration takes k from the constructor. Both are
+ * instantiated in tracker.cpp.
  */
 
 #ifndef TRACKER_H
@@ -13,9 +19,17 @@
 
 #include "opencv2/core/core.hpp"
 #include "pointCloud.h"
-#include <list>
+#include "kmeans3d.h"
+#include "workerPool.h"
+#include "adjacencyGraph.h"
+#include "trackerConfig.h"
+#include <vector>
+
+struct depth_frame;
+class superpixel_engine;
 
-class tracker
+template<class Config>
+class basic_tracker
 {
     public:
         /**
@@ -24,13 +38,25 @@ class tracker
          *
          * @param   source    the point cloud to refer to.
          */
-        void update_point_cloud(pointCloud source);
+        void update_point_cloud(const pointCloud& source);
+
+        /**
+         * Sizes the per-frame buffers for the largest cloud that will be tracked,
+         * so tracking does not allocate once it is running.
+         *
+         * @param   max_points  the most points a cloud will have
+         * @param   attempts    the most start configurations cluster() will be given
+         * @param   view_rows   the rows of the views passed to cluster_superpixels, added up
+         * @param   view_cols   the columns of those views, added up
+         */
+        void reserve(int max_points, int attempts, int view_rows, int view_cols);
 
         /**
          * Uses K-means clustering with the given number of iterations and clusters
-         * to determine how the point cloud is connected. kmeans++ is used to set
-         * the initial mean centers. Updates the internal cluster. The value for k
-         * set in the constructor is used.
+         * to determine how the point cloud is connected. The first start configuration
+         * is warm-started from the previous frame's centers. kmeans++ is used to set
+         * the initial mean centers of the others, which run in parallel. Updates the
+         * internal cluster. The value for k set in the constructor is used.
          *
          * @param   n           the number of start configuations to run k-means with
          * @param   max_iter    the maximum number of iterations per start configuration
@@ -40,43 +66,105 @@ class tracker
         bool cluster(int n, int max_iter, double epsilon);
 
         /**
-         * Connects the cluster means to form a mesh for analysis. Updates the internal
-         * connectivity adjacency matrix.
+         * Connects the cluster means to form a mesh for analysis. Two means are
+         * connected when the points between them are dense, measured as the sum of
+         * 1/|distance to the other mean - distance to the home mean| over the points
+         * of both clusters, normalized by the cluster sizes. The point-to-center
+         * distances are computed in blocks with SIMD, and each worker thread
+         * accumulates its share of the points into a private k x k tile before the
+         * tiles are reduced. Updates adj_graph and adj_kmeans.
          *
          * @param   threshold   the threshold, over which two groups are considered connected
          */
         void connect_means(float threshold);       
 
+        /**
+         * Clusters the depth images the cloud was built from into k superpixels, in place
+         * of cluster() on the cloud (see superpixels.h). Superpixels that border each other
+         * on the same surface are connected, so connect_means() is not needed. Updates the
+         * centers, cluster_ind, adj_graph and adj_kmeans.
+         *
+         * @param   views       the segmented frames of every camera
+         * @param   max_iter    the number of SLIC iterations
+         * @param   compactness see superpixel_engine::cluster
+         * @param   max_step    the largest depth step within a surface (meters)
+         * @return  whether or not there were at least k foreground pixels
+         */
+        bool cluster_superpixels(const std::vector<depth_frame>& views, int max_iter, float compactness, float max_step);
+
+        /**
+         * Sets the calibration cluster_superpixels() transforms the centers of a view by.
+         * See superpixel_engine::set_calibration.
+         */
+        void set_view_calibration(int view, const float rotation[9], const float translation[3]);
+
+        /**
+         * @return  the number of clusters, a constant when k is fixed by the configuration
+         */
+        int num_clusters(void) const
+        {
+            return Config::k > 0 ? Config::k : k;
+        }
+
         /**
          * Initializes the tracker. Memory is allocated when at this point to improve performance.
          *
-         * @param   k   the number of clusters used for k-means
+         * @param   k   the number of clusters used for k-means. Ignored unless the configuration
+         *              takes k at runtime.
          */
-        tracker(int k);
+        basic_tracker(int k = Config::k);
+
+        ~basic_tracker(void);
 
-        cv::Mat cluster_ind;    // The clusters for each point in the pointcloud
-        cv::Mat centers;        // Centers of the clusters from k-means
-        cv::Mat adj_kmeans;     // The adjacency matrix describing the connectivity of the means
+        cv::Mat cluster_ind;    // The clusters for each point in the pointcloud. After cluster_superpixels(),
+                                // for each foreground pixel in the order of the cloud before downsampling.
+        cv::Mat centers;        // Centers of the clusters from k-means (k x 3, a view of center_storage)
+        cv::Mat adj_kmeans;     // The adjacency matrix describing the connectivity of the means (0/1, a view of adj_storage)
+        adjacency_graph<Config::k> adj_graph;  // The same connectivity as a bitset graph
         cv::Mat source_cloud;   // A reference to the original transformed pointcloud
 
     private:
         int k;                  // Number of clusters in the simulation
+        bool has_centers;       // Whether or not centers holds the result of a previous frame
+        worker_pool workers;    // Runs the k-means start configurations in parallel
+        kmeans_engine* engine;  // K-means specialized for k
+        superpixel_engine* superpixels; // SLIC on the depth images
+
+        typename config_storage<float, 3*Config::k>::type center_storage;
+        typename config_storage<float, Config::k*Config::k>::type adj_storage;
+
+        // Scratch for connect_means, sized once in the constructor
+        int k_padded;                       // k rounded up to a multiple of four
+        typename config_storage<float, 3*Config::k_padded>::type center_soa;  // Centers as x, y and z arrays of k_padded
+        std::vector<float> connect_tiles;   // Per-thread k x k_padded weight sums
+        std::vector<int> connect_counts;    // Per-thread points per cluster
+        std::vector<float> connect_dist;    // Per-thread block of point-to-center distances
+
+        /**
+         * @return  k rounded up to a multiple of four, a constant when k is fixed
+         */
+        int padded_clusters(void) const
+        {
+            return Config::k > 0 ? Config::k_padded : k_padded;
+        }
 };
 
-class arm
+template<class Config>
+class basic_arm
 {
     public:
         // Contains the kmeans indices in the arm mesh from hand (at the front)
-        // to shoulder (at the back)        
-        std::list<int> kmean_ind;
+        // to shoulder (at the back). Only the first chain_length are valid.
+        typename config_storage<int, Config::k>::type kmean_ind;
+        int chain_length = 0;
         int elbow_kmean_ind;
-        tracker* source;
-        cv::Mat start_pos;
+        basic_tracker<Config>* source;
+        float start_pos[3];
         int elbow_approx_ind;   // The point in the point cloud closest to the elbow
 
-        cv::Mat hand_loc;
-        cv::Mat elbow_loc;
-        cv::Mat shoulder_loc;
+        float hand_loc[3];
+        float elbow_loc[3];
+        float shoulder_loc[3];
 
         /**
          * Calculates the shoulder location from the given hand location. The kmeans
@@ -99,9 +187,9 @@ class arm
         /**
          * Interpolates between two vectors to provide smoothing.
          * current = current + (target-current)*t
-         * current is updated with the next interpolation step.
+         * current is updated in place with the next interpolation step.
          */
-        void lerp(cv::Mat target, cv::Mat& current, float t);
+        void lerp(const float* target, float* current, float t);
 
         /**
          * Updates the location of the joints based on the current kmeans cloud.
@@ -121,7 +209,7 @@ class arm
          * @param   max_dist_to_start   the maximum distance to the start position the start node can be
          * @param   dxdz_threshold      terminate the search when dx/dz > threshold
          */
-        arm(tracker& source, cv::Mat start_pos, float max_dist_to_start, float dxdz_threshold);
+        basic_arm(basic_tracker<Config>& source, cv::Mat start_pos, float max_dist_to_start, float dxdz_threshold);
     
     private:
         float max_dist_to_start;                        // the maximum distance to the start position the start node can be
@@ -140,4 +228,7 @@ class arm
         int find_closest_center_hand();
 };
 
+typedef basic_tracker<runtime_tracker_config> tracker;
+typedef basic_arm<runtime_tracker_config> arm;
+
 #endif
\ No newline at end of file
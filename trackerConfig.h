@@ -0,0 +1,77 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Compile-time configuration of the tracker. The structural parameters,
+ * the number of k-means clusters and the neighborhood radius of the
+ * background filter, are template arguments, so the tracker and the arms
+ * keep their centers, adjacency and joint chain in fixed-size arrays and
+ * the compiler can unroll the loops over the clusters. A value of 0 selects
+ * the runtime fallback, which takes the value from the constructor (or the
+ * call) instead, for experimenting without recompiling.
+ *
+ * The parameters that do not change the shape of the data, such as the
+ * iteration count and the thresholds, stay runtime values (see pipeline_config).
+ */
+
+#ifndef TRACKERCONFIG_H
+#define TRACKERCONFIG_H
+
+#include <array>
+#include <vector>
+
+/**
+ * @tparam  K           the number of k-means clusters. 0 takes it at runtime.
+ * @tparam  MANHATTAN   the neighborhood radius of the background filter (see
+ *                      depth_cam::filter_background). 0 takes it at runtime.
+ */
+template<int K, int MANHATTAN>
+struct tracker_config
+{
+    static const int k = K;
+    static const int k_padded = (K+3)/4*4;      // k rounded up to a multiple of the SSE width
+    static const int manhattan = MANHATTAN;
+};
+
+// Definitions for when the values are bound to references
+template<int K, int MANHATTAN> const int tracker_config<K, MANHATTAN>::k;
+template<int K, int MANHATTAN> const int tracker_config<K, MANHATTAN>::k_padded;
+template<int K, int MANHATTAN> const int tracker_config<K, MANHATTAN>::manhattan;
+
+/**
+ * The configuration pose is built with. Changing a value means recompiling.
+ */
+typedef tracker_config<30, 4> compiled_tracker_config;
+
+/**
+ * Takes every value at runtime. Used when the values differ from the compiled ones.
+ */
+typedef tracker_config<0, 0> runtime_tracker_config;
+
+/**
+ * Storage for N values of T. A std::array when N is known at compile time
+ * and a std::vector, sized by size(), when N is 0.
+ */
+template<class T, int N>
+struct config_storage
+{
+    typedef std::array<T, N> type;
+
+    static void size(type& storage, int n, const T& value)
+    {
+        (void)n;
+        storage.fill(value);
+    }
+};
+
+template<class T>
+struct config_storage<T, 0>
+{
+    typedef std::vector<T> type;
+
+    static void size(type& storage, int n, const T& value)
+    {
+        storage.assign(n, value);
+    }
+};
+
+#endif
@@ -0,0 +1,389 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in trackingParams.h.
+ */
+
+#define POINT_CLOUD_SCALING_CALIB 0.2f
+#define POINT_CLOUD_SCALING_TRACKING 0.16f
+#define PREFILTER_DEPTH_MAX_DIST 0.05f
+#define BACKGROUND_LEARN_FRAMES 60  // Two seconds at 30 fps
+#define BACKGROUND_MIN_GAP 0.1f     // Meters in front of the learned background
+#define BACKGROUND_SIGMA 3.0f
+#define VOXEL_LEAF_SIZE 0.015f
+#define KMEANS_ATTEMPTS 2
+#define KMEANS_ITERATIONS 10
+#define KMEANS_EPSILON 0.002f
+#define KMEANS_CONNECT_THRESHOLD 0.25f
+#define SUPERPIXEL_ITERATIONS 0     // k-means until the superpixels have been tuned on recordings
+#define SUPERPIXEL_COMPACTNESS 0.05f // Meters, about one grid step at the tracking scale
+#define LEFT_ARM_START_POS {0.2f, 0.0f, -0.05f}
+#define RIGHT_ARM_START_POS {-0.2f, 0.0f, -0.05f}
+#define HAND_MAX_DIST_TO_START 0.2f
+#define SHOULDER_DXDZ_THRESHOLD 1.2f
+#define JOINT_SMOOTHING 1.f//0.11f
+#define FIT_ITERATIONS 0            // k-means every frame until the fit has been tuned on recordings
+#define FIT_RADIUS 0.045f           // Meters, about the radius of a forearm
+#define FIT_GATE 0.03f
+#define FIT_MAX_RESIDUAL 0.015f
+#define FIT_MIN_POINTS 30
+#define REFINE_RADIUS 0.1f          // Meters, a hand and the end of the forearm
+#define REFINE_MIN_POINTS 30
+#define PREDICTOR_MEMORY 0.5f
+#define PREDICTOR_MAX_HORIZON 0.15f // Seconds: the latency, the pipeline and a frame interval
+#define PREDICTOR_LATENCY 0.0f      // Seconds from exposure to arrival. Measure for the camera.
+#define ROI_MARGIN 0.15f            // Meters the user can move between frames
+#define ROI_REFRESH_FRAMES 30       // Process a whole frame once a second at 30 fps
+#define QUALITY_DEADLINE 0.0f       // Seconds of work per frame, e.g. 0.016. 0 keeps the settings fixed.
+#define QUALITY_MIN_SCALING 0.75f   // The cheapest rung of the default ladder scales by this much less
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <opencv2/core/core.hpp>
+#include "trackingParams.h"
+#include "framePipeline.h"
+#include "trackerConfig.h"
+
+/**
+ * A scalar parameter and its name in the parameter files. Exactly one of
+ * the members is set.
+ */
+struct param_field
+{
+    const char* name;
+    float tracking_params::* real;
+    int tracking_params::* integer;
+};
+
+static const param_field scalar_fields[] = {
+    {"point_cloud_scaling_calib", &tracking_params::point_cloud_scaling_calib, nullptr},
+    {"point_cloud_scaling_tracking", &tracking_params::point_cloud_scaling_tracking, nullptr},
+    {"prefilter_depth_max_dist", &tracking_params::prefilter_depth_max_dist, nullptr},
+    {"prefilter_manhattan_dist", nullptr, &tracking_params::prefilter_manhattan_dist},
+    {"background_learn_frames", nullptr, &tracking_params::background_learn_frames},
+    {"background_min_gap", &tracking_params::background_min_gap, nullptr},
+    {"background_sigma", &tracking_params::background_sigma, nullptr},
+    {"voxel_leaf_size", &tracking_params::voxel_leaf_size, nullptr},
+    {"kmeans_k", nullptr, &tracking_params::kmeans_k},
+    {"kmeans_attempts", nullptr, &tracking_params::kmeans_attempts},
+    {"kmeans_iterations", nullptr, &tracking_params::kmeans_iterations},
+    {"kmeans_epsilon", &tracking_params::kmeans_epsilon, nullptr},
+    {"kmeans_connect_threshold", &tracking_params::kmeans_connect_threshold, nullptr},
+    {"superpixel_iterations", nullptr, &tracking_params::superpixel_iterations},
+    {"superpixel_compactness", &tracking_params::superpixel_compactness, nullptr},
+    {"hand_max_dist_to_start", &tracking_params::hand_max_dist_to_start, nullptr},
+    {"shoulder_dxdz_threshold", &tracking_params::shoulder_dxdz_threshold, nullptr},
+    {"joint_smoothing", &tracking_params::joint_smoothing, nullptr},
+    {"fit_iterations", nullptr, &tracking_params::fit_iterations},
+    {"fit_radius", &tracking_params::fit_radius, nullptr},
+    {"fit_gate", &tracking_params::fit_gate, nullptr},
+    {"fit_max_residual", &tracking_params::fit_max_residual, nullptr},
+    {"fit_min_points", nullptr, &tracking_params::fit_min_points},
+    {"refine_radius", &tracking_params::refine_radius, nullptr},
+    {"refine_min_points", nullptr, &tracking_params::refine_min_points},
+    {"predictor_memory", &tracking_params::predictor_memory, nullptr},
+    {"predictor_max_horizon", &tracking_params::predictor_max_horizon, nullptr},
+    {"predictor_latency", &tracking_params::predictor_latency, nullptr},
+    {"roi_margin", &tracking_params::roi_margin, nullptr},
+    {"roi_refresh_frames", nullptr, &tracking_params::roi_refresh_frames},
+    {"quality_deadline", &tracking_params::quality_deadline, nullptr},
+};
+
+static const int n_scalar_fields = sizeof(scalar_fields)/sizeof(scalar_fields[0]);
+
+/**
+ * @return  the field of that name or nullptr if there is none
+ */
+static const param_field* find_field(const char* name)
+{
+    for (int i = 0; i < n_scalar_fields; i++)
+    {
+        if (strcmp(scalar_fields[i].name, name) == 0)
+        {
+            return &scalar_fields[i];
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * Reads a 3-vector if the node is a sequence of three values.
+ */
+static void read_position(const cv::FileNode& node, float pos[3])
+{
+    if (!node.isSeq() || node.size() != 3)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        pos[i] = (float)node[i];
+    }
+}
+
+static void write_position(cv::FileStorage& file, const char* name, const float pos[3])
+{
+    file << name << "[" << pos[0] << pos[1] << pos[2] << "]";
+}
+
+/**
+ * Reads the quality ladder if the node is a sequence of rungs. Settings a rung
+ * leaves out are taken from the parameters.
+ */
+static void read_ladder(const cv::FileNode& node, tracking_params& params)
+{
+    if (!node.isSeq())
+    {
+        return;
+    }
+
+    params.quality_ladder.clear();
+
+    for (int i = 0; i < (int)node.size(); i++)
+    {
+        cv::FileNode rung = node[i];
+        quality_rung r = {params.point_cloud_scaling_tracking, params.prefilter_manhattan_dist,
+                          params.kmeans_attempts, params.kmeans_iterations};
+
+        if (!rung["point_cloud_scaling_tracking"].empty())
+        {
+            r.scale_factor = (float)rung["point_cloud_scaling_tracking"];
+        }
+
+        if (!rung["prefilter_manhattan_dist"].empty())
+        {
+            r.filter_manhattan = (int)rung["prefilter_manhattan_dist"];
+        }
+
+        if (!rung["kmeans_attempts"].empty())
+        {
+            r.kmeans_attempts = (int)rung["kmeans_attempts"];
+        }
+
+        if (!rung["kmeans_iterations"].empty())
+        {
+            r.kmeans_iterations = (int)rung["kmeans_iterations"];
+        }
+
+        params.quality_ladder.push_back(r);
+    }
+}
+
+tracking_params::tracking_params(void)
+{
+    float left_start[3] = LEFT_ARM_START_POS;
+    float right_start[3] = RIGHT_ARM_START_POS;
+
+    point_cloud_scaling_calib = POINT_CLOUD_SCALING_CALIB;
+    point_cloud_scaling_tracking = POINT_CLOUD_SCALING_TRACKING;
+    prefilter_depth_max_dist = PREFILTER_DEPTH_MAX_DIST;
+    prefilter_manhattan_dist = compiled_tracker_config::manhattan;
+    background_learn_frames = BACKGROUND_LEARN_FRAMES;
+    background_min_gap = BACKGROUND_MIN_GAP;
+    background_sigma = BACKGROUND_SIGMA;
+    voxel_leaf_size = VOXEL_LEAF_SIZE;
+    kmeans_k = compiled_tracker_config::k;
+    kmeans_attempts = KMEANS_ATTEMPTS;
+    kmeans_iterations = KMEANS_ITERATIONS;
+    kmeans_epsilon = KMEANS_EPSILON;
+    kmeans_connect_threshold = KMEANS_CONNECT_THRESHOLD;
+    superpixel_iterations = SUPERPIXEL_ITERATIONS;
+    superpixel_compactness = SUPERPIXEL_COMPACTNESS;
+    memcpy(left_arm_start_pos, left_start, sizeof(left_start));
+    memcpy(right_arm_start_pos, right_start, sizeof(right_start));
+    hand_max_dist_to_start = HAND_MAX_DIST_TO_START;
+    shoulder_dxdz_threshold = SHOULDER_DXDZ_THRESHOLD;
+    joint_smoothing = JOINT_SMOOTHING;
+    fit_iterations = FIT_ITERATIONS;
+    fit_radius = FIT_RADIUS;
+    fit_gate = FIT_GATE;
+    fit_max_residual = FIT_MAX_RESIDUAL;
+    fit_min_points = FIT_MIN_POINTS;
+    refine_radius = REFINE_RADIUS;
+    refine_min_points = REFINE_MIN_POINTS;
+    predictor_memory = PREDICTOR_MEMORY;
+    predictor_max_horizon = PREDICTOR_MAX_HORIZON;
+    predictor_latency = PREDICTOR_LATENCY;
+    roi_margin = ROI_MARGIN;
+    roi_refresh_frames = ROI_REFRESH_FRAMES;
+    quality_deadline = QUALITY_DEADLINE;
+}
+
+bool tracking_params::load(const char* filename)
+{
+    cv::FileStorage params_file(filename, cv::FileStorage::READ);
+
+    if (!params_file.isOpened())
+    {
+        printf("Could not read the parameters from %s\n", filename);
+        return false;
+    }
+
+    for (int i = 0; i < n_scalar_fields; i++)
+    {
+        cv::FileNode node = params_file[scalar_fields[i].name];
+
+        if (node.empty())
+        {
+            continue;   // Keep the current value
+        }
+
+        if (scalar_fields[i].real)
+        {
+            this->*scalar_fields[i].real = (float)node;
+        }
+        else
+        {
+            this->*scalar_fields[i].integer = (int)node;
+        }
+    }
+
+    read_position(params_file["left_arm_start_pos"], left_arm_start_pos);
+    read_position(params_file["right_arm_start_pos"], right_arm_start_pos);
+    read_ladder(params_file["quality_ladder"], *this);
+
+    params_file.release();
+    return true;
+}
+
+void tracking_params::save(const char* filename) const
+{
+    cv::FileStorage params_file(filename, cv::FileStorage::WRITE);
+
+    for (int i = 0; i < n_scalar_fields; i++)
+    {
+        if (scalar_fields[i].real)
+        {
+            params_file << scalar_fields[i].name << this->*scalar_fields[i].real;
+        }
+        else
+        {
+            params_file << scalar_fields[i].name << this->*scalar_fields[i].integer;
+        }
+    }
+
+    write_position(params_file, "left_arm_start_pos", left_arm_start_pos);
+    write_position(params_file, "right_arm_start_pos", right_arm_start_pos);
+
+    if (!quality_ladder.empty())
+    {
+        params_file << "quality_ladder" << "[";
+
+        for (const quality_rung& r : quality_ladder)
+        {
+            params_file << "{" << "point_cloud_scaling_tracking" << r.scale_factor
+                        << "prefilter_manhattan_dist" << r.filter_manhattan
+                        << "kmeans_attempts" << r.kmeans_attempts
+                        << "kmeans_iterations" << r.kmeans_iterations << "}";
+        }
+
+        params_file << "]";
+    }
+
+    params_file.release();
+}
+
+bool tracking_params::set(const char* name, double value)
+{
+    const param_field* field = find_field(name);
+
+    if (field == nullptr)
+    {
+        return false;
+    }
+
+    if (field->real)
+    {
+        this->*field->real = (float)value;
+    }
+    else
+    {
+        this->*field->integer = (int)lround(value);
+    }
+
+    return true;
+}
+
+double tracking_params::get(const char* name) const
+{
+    const param_field* field = find_field(name);
+
+    if (field == nullptr)
+    {
+        return 0;
+    }
+
+    return field->real ? this->*field->real : this->*field->integer;
+}
+
+int tracking_params::scalar_count(void)
+{
+    return n_scalar_fields;
+}
+
+const char* tracking_params::scalar_name(int i)
+{
+    return scalar_fields[i].name;
+}
+
+std::vector<quality_rung> tracking_params::ladder(void) const
+{
+    if (!quality_ladder.empty())
+    {
+        return quality_ladder;
+    }
+
+    // Each rung gives up one of the settings the default tune grid sweeps, cheapest last
+    quality_rung r = {point_cloud_scaling_tracking, prefilter_manhattan_dist, kmeans_attempts, kmeans_iterations};
+    std::vector<quality_rung> rungs(1, r);
+
+    r.kmeans_attempts = 1;
+    rungs.push_back(r);
+    r.kmeans_iterations = std::max(kmeans_iterations/2, 1);
+    rungs.push_back(r);
+    r.scale_factor = point_cloud_scaling_tracking*QUALITY_MIN_SCALING;
+    rungs.push_back(r);
+
+    // Settings that were already as cheap as they go leave duplicates
+    std::vector<quality_rung> ladder;
+
+    for (const quality_rung& rung : rungs)
+    {
+        if (ladder.empty() || memcmp(&ladder.back(), &rung, sizeof(rung)) != 0)
+        {
+            ladder.push_back(rung);
+        }
+    }
+
+    return ladder;
+}
+
+void tracking_params::apply(pipeline_config& config) const
+{
+    config.filter_max_dist = prefilter_depth_max_dist;
+    config.filter_manhattan = prefilter_manhattan_dist;
+    config.kmeans_attempts = kmeans_attempts;
+    config.kmeans_iterations = kmeans_iterations;
+    config.kmeans_epsilon = kmeans_epsilon;
+    config.connect_threshold = kmeans_connect_threshold;
+    config.superpixel_iterations = superpixel_iterations;
+    config.superpixel_compactness = superpixel_compactness;
+    config.background_learn_frames = background_learn_frames;
+    config.background_min_gap = background_min_gap;
+    config.background_sigma = background_sigma;
+    config.voxel_leaf_size = voxel_leaf_size;
+    config.joint_smoothing = joint_smoothing;
+    config.fit_iterations = fit_iterations;
+    config.fit_radius = fit_radius;
+    config.fit_gate = fit_gate;
+    config.fit_max_residual = fit_max_residual;
+    config.fit_min_points = fit_min_points;
+    config.refine_radius = refine_radius;
+    config.refine_min_points = refine_min_points;
+    config.roi_margin = roi_margin;
+    config.roi_refresh_frames = roi_refresh_frames;
+}
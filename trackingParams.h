@@ -0,0 +1,122 @@
+/**
+ * Author: Adam Mooers
+ *
+ * The tunable parameters of the tracker, loaded at runtime so they can be
+ * changed without rebuilding. Parameter files are read and written with
+ * cv::FileStorage (XML or YAML, chosen by the extension) and list any subset
+ * of the parameters by name. The ones that are missing keep their defaults.
+ *
+ *   %YAML:1.0
+ *   point_cloud_scaling_tracking: 0.16
+ *   kmeans_iterations: 10
+ *   left_arm_start_pos: [ 0.2, 0.0, -0.05 ]
+ *   quality_ladder:
+ *      - { point_cloud_scaling_tracking: 0.2, kmeans_attempts: 2 }
+ *      - { point_cloud_scaling_tracking: 0.16, kmeans_attempts: 1 }
+ */
+
+#ifndef TRACKINGPARAMS_H
+#define TRACKINGPARAMS_H
+
+#include <vector>
+#include "qualityController.h"
+
+struct pipeline_config;
+
+struct tracking_params
+{
+    float point_cloud_scaling_calib;    // Scale factor of the depth image in calibration mode
+    float point_cloud_scaling_tracking; // Scale factor of the depth image in tracking mode
+    float prefilter_depth_max_dist;     // See depth_cam::filter_background (meters)
+    int prefilter_manhattan_dist;       // The compiled radius is faster (see trackerConfig.h)
+    int background_learn_frames;        // See depth_cam::learn_background. 0 disables the background model.
+    float background_min_gap;
+    float background_sigma;
+    float voxel_leaf_size;              // Downsampling grid size for the cloud. 0 disables it.
+    int kmeans_k;                       // The compiled k is faster (see trackerConfig.h)
+    int kmeans_attempts;                // See tracker::cluster
+    int kmeans_iterations;
+    float kmeans_epsilon;
+    float kmeans_connect_threshold;     // See tracker::connect_means
+    int superpixel_iterations;          // See tracker::cluster_superpixels. 0 runs k-means.
+    float superpixel_compactness;
+    float left_arm_start_pos[3];        // See arm::arm
+    float right_arm_start_pos[3];
+    float hand_max_dist_to_start;
+    float shoulder_dxdz_threshold;
+    float joint_smoothing;              // See arm::update_joints. Not used with the predictor.
+    int fit_iterations;                 // See fitted_arms. 0 runs k-means on every frame.
+    float fit_radius;                   // See arm_fitter (meters)
+    float fit_gate;
+    float fit_max_residual;
+    int fit_min_points;
+    float refine_radius;                // See joint_refiner (meters). 0 disables the refinement.
+    int refine_min_points;
+    float predictor_memory;             // See joint_predictor. Negative disables the predictor.
+    float predictor_max_horizon;
+    float predictor_latency;
+    float roi_margin;                   // See tracking_window. 0 processes whole frames.
+    int roi_refresh_frames;
+    float quality_deadline;             // See quality_controller (seconds). 0 keeps the settings fixed.
+    std::vector<quality_rung> quality_ladder; // The rungs, best quality first. Empty derives them (see ladder).
+
+    /**
+     * Overwrites the parameters that are given in the file.
+     *
+     * @param   filename    an XML or YAML file written by cv::FileStorage
+     * @return  false if the file could not be read
+     */
+    bool load(const char* filename);
+
+    /**
+     * Writes every parameter, so the file can be loaded with load().
+     *
+     * @param   filename    the file to write (*.xml or *.yml)
+     */
+    void save(const char* filename) const;
+
+    /**
+     * Sets a scalar parameter by its name in the parameter files. Integer
+     * parameters are rounded.
+     *
+     * @return  false if there is no scalar parameter of that name
+     */
+    bool set(const char* name, double value);
+
+    /**
+     * @return  the value of the scalar parameter of that name, or 0 if there is none
+     */
+    double get(const char* name) const;
+
+    /**
+     * @return  the number of scalar parameters
+     */
+    static int scalar_count(void);
+
+    /**
+     * @param   i   the index of the scalar parameter, below scalar_count()
+     * @return  its name in the parameter files
+     */
+    static const char* scalar_name(int i);
+
+    /**
+     * @return  the quality ladder: quality_ladder if one was given, otherwise the
+     *          parameters followed by rungs with one k-means attempt, half the
+     *          k-means iterations and a smaller scale factor in turn
+     */
+    std::vector<quality_rung> ladder(void) const;
+
+    /**
+     * Fills in the stage parameters of the pipeline.
+     *
+     * @param   config  the configuration to update
+     */
+    void apply(pipeline_config& config) const;
+
+    /**
+     * Initializes every parameter to its default.
+     */
+    tracking_params(void);
+};
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in trackingWindow.h.
+ */
+
+#include "trackingWindow.h"
+#include <cstring>
+
+/**
+ * Appends a point to the buffer.
+ */
+static float* append_point(float* out, const float p[3])
+{
+    memcpy(out, p, 3*sizeof(float));
+    return out+3;
+}
+
+template<class Config>
+void tracking_window<Config>::update(camera_rig& rig, const basic_tracker<Config>& trk, bool clustered,
+                                     const basic_arm<Config>& left, bool left_tracked,
+                                     const basic_arm<Config>& right, bool right_tracked)
+{
+    if (!enabled())
+    {
+        return;
+    }
+
+    frames++;
+
+    // Look at the whole frame when the user is lost, and now and then anyway
+    if (!(left_tracked || right_tracked) || (refresh_frames > 0 && frames >= refresh_frames))
+    {
+        rig.clear_roi();
+        frames = 0;
+        return;
+    }
+
+    float* out = points.data();
+
+    // Fitted frames keep only the arms in view (see armFitter.h)
+    for (int i = 0; clustered && i < trk.centers.rows; i++)
+    {
+        out = append_point(out, trk.centers.template ptr<float>(i));
+    }
+
+    // The arm search starts from here, so a lost hand can be found again
+    out = append_point(out, left.start_pos);
+    out = append_point(out, right.start_pos);
+
+    if (left_tracked)
+    {
+        out = append_point(out, left.hand_loc);
+        out = append_point(out, left.elbow_loc);
+        out = append_point(out, left.shoulder_loc);
+    }
+
+    if (right_tracked)
+    {
+        out = append_point(out, right.hand_loc);
+        out = append_point(out, right.elbow_loc);
+        out = append_point(out, right.shoulder_loc);
+    }
+
+    rig.update_roi(points.data(), (int)(out-points.data())/3, margin);
+}
+
+template<class Config>
+tracking_window<Config>::tracking_window(float margin, int refresh_frames, int k)
+    : margin(margin), refresh_frames(refresh_frames), points(3*(k+8))
+{
+}
+
+template class tracking_window<compiled_tracker_config>;
+template class tracking_window<runtime_tracker_config>;
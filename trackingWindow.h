@@ -0,0 +1,72 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Keeps the image processing of every camera to a window around the user.
+ * The user sits in a stable region in front of the wheelchair, so most of
+ * each depth image is background that segmentation and deprojection would
+ * otherwise walk every frame. After each tracked frame, the k-means centers,
+ * the tracked joints and the start positions of both arms (so a lost hand
+ * can be found again where the arm search begins) are projected into every
+ * camera, and the box around them, grown by a motion margin, becomes the
+ * window of the next frames (see depth_cam::update_roi).
+ *
+ * Whole frames are processed when nothing is tracked and every few frames
+ * anyway, so a user who moves out of the window is picked up again.
+ */
+
+#ifndef TRACKINGWINDOW_H
+#define TRACKINGWINDOW_H
+
+#include <vector>
+#include "cameraRig.h"
+#include "tracker.h"
+
+/**
+ * @tparam  Config  the tracker configuration (see trackerConfig.h)
+ */
+template<class Config>
+class tracking_window
+{
+    public:
+        /**
+         * Moves the window of the rig to the result of a frame. Call once per
+         * frame from the thread that tracks.
+         *
+         * @param   rig             the cameras to restrict
+         * @param   trk             the tracker after the frame
+         * @param   clustered       whether or not k-means ran on the frame. Otherwise only the
+         *                          arms are kept in view.
+         * @param   left            the left arm after the frame
+         * @param   left_tracked    whether or not the left arm was tracked
+         * @param   right           the right arm after the frame
+         * @param   right_tracked   whether or not the right arm was tracked
+         */
+        void update(camera_rig& rig, const basic_tracker<Config>& trk, bool clustered,
+                    const basic_arm<Config>& left, bool left_tracked,
+                    const basic_arm<Config>& right, bool right_tracked);
+
+        /**
+         * @return  whether or not the window is in use (the margin is positive)
+         */
+        bool enabled(void) const
+        {
+            return margin > 0;
+        }
+
+        /**
+         * @param   margin          how far the user can move between frames (meters). 0 always
+         *                          processes whole frames.
+         * @param   refresh_frames  every refresh_frames-th frame is processed whole. 0 never
+         *                          refreshes while the arms are tracked.
+         * @param   k               the number of clusters of the tracker
+         */
+        tracking_window(float margin, int refresh_frames, int k);
+
+    private:
+        float margin;
+        int refresh_frames;
+        int frames = 0;             // Frames since the last whole frame
+        std::vector<float> points;  // The points to keep in view, sized for k centers and the arms
+};
+
+#endif
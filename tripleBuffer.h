@@ -0,0 +1,89 @@
+/**
+ * Author: Adam Mooers
+ *
+ * A wait-free triple buffer for handing the latest value from one producer
+ * thread to one consumer thread. The producer always has a buffer to write
+ * into and the consumer always has a complete buffer to read, so neither
+ * side ever waits on the other. Values the consumer did not get to in time
+ * are simply overwritten.
+ */
+
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+template<class T>
+class triple_buffer
+{
+    public:
+        /**
+         * @return  the buffer to fill with the next value. Producer only.
+         */
+        T& write_buffer(void)
+        {
+            return buffers[write_ind];
+        }
+
+        /**
+         * Makes the filled write buffer the latest value. Producer only.
+         */
+        void publish(void)
+        {
+            // Swap the write buffer with the middle one and flag it as new
+            int prev = middle.exchange(write_ind | fresh_bit, std::memory_order_acq_rel);
+            write_ind = prev & index_mask;
+        }
+
+        /**
+         * Picks up the latest published value, if there is a new one. Consumer only.
+         *
+         * @return  whether or not read_buffer changed
+         */
+        bool update(void)
+        {
+            if ((middle.load(std::memory_order_relaxed) & fresh_bit) == 0)
+            {
+                return false;
+            }
+
+            int prev = middle.exchange(read_ind, std::memory_order_acq_rel);
+            read_ind = prev & index_mask;
+
+            return true;
+        }
+
+        /**
+         * @return  the most recent value picked up by update. Consumer only.
+         */
+        const T& read_buffer(void) const
+        {
+            return buffers[read_ind];
+        }
+
+        /**
+         * Calls fn on each of the three buffers, e.g. to size them up front. Only
+         * safe while neither the producer nor the consumer is using them.
+         */
+        template<class F>
+        void for_each(F fn)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                fn(buffers[i]);
+            }
+        }
+
+        triple_buffer(void) : write_ind(0), read_ind(1), middle(2) {}
+
+    private:
+        static const int index_mask = 3;
+        static const int fresh_bit = 4;     // Set in middle when it holds an unread value
+
+        T buffers[3];
+        int write_ind;                      // Owned by the producer
+        int read_ind;                       // Owned by the consumer
+        std::atomic<int> middle;            // The buffer in transit between the two
+};
+
+#endif
@@ -0,0 +1,554 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Tunes the tracking parameters offline. Recordings made with pose --record
+ * are replayed through the tracker once for every configuration of a
+ * parameter grid, or a random sample of it, and each configuration is scored
+ * on how long a frame takes next to how stable the joints are:
+ *
+ *   latency    the time from a captured frame to its joints (segmentation and
+ *              tracking, frames run one after another on this thread)
+ *   tracked    the fraction of arm-frames in which the arm was tracked
+ *   loss_rate  how often a tracked arm was lost, per arm-frame
+ *   jitter     the RMS second difference of the joint positions across three
+ *              tracked frames (mm), i.e. how much the joints shake
+ *   window     the mean fraction of each image inside the tracking window
+ *              (see trackingWindow.h), i.e. the share of the pixel work done
+ *
+ * Each configuration is printed as one JSON line. At the end the fastest
+ * configuration (by mean latency) that meets the accuracy bar is printed and,
+ * with --out, saved as a parameter file for pose --params.
+ *
+ * The grid file lists values for any of the scalar parameters (see
+ * trackingParams.h). Parameters that are not listed keep their base values.
+ *
+ *   %YAML:1.0
+ *   point_cloud_scaling_tracking: [ 0.12, 0.16, 0.2 ]
+ *   kmeans_iterations: [ 5, 10 ]
+ */
+
+#define TUNE_WARMUP_FRAMES 10               // Frames left out of the latency of each configuration
+#define TUNE_SEED 1                         // Random search is repeatable
+#define TUNE_MAX_LOSS_RATE 0.02             // Default accuracy bar
+#define TUNE_MAX_JITTER_MM 15.0
+#define TUNE_MIN_TRACKED 0.5
+#define RIG_SYNC_TOLERANCE_MS 20.0
+#define CALIBRATION_FILE "calibration.xml"  // Camera i > 0 defaults to calibration_i.xml
+#define MAX_CAMERAS 4
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "cameraRig.h"
+#include "depthCamManager.h"
+#include "depthRecording.h"
+#include "voxelGrid.h"
+#include "tracker.h"
+#include "trackerConfig.h"
+#include "trackingParams.h"
+#include "trackingWindow.h"
+#include "armFitter.h"
+#include "jointRefiner.h"
+#include "framePipeline.h"
+
+std::vector<const char*> replay_paths;  // The recording of each camera
+std::vector<std::string> calib_paths;   // The calibration file of each camera
+const char* grid_path = nullptr;        // The values to sweep. A built-in grid is used if not set.
+const char* out_path = nullptr;         // Where to save the best parameters
+int samples = 0;                        // Random configurations to try. 0 tries the whole grid.
+double max_loss_rate = TUNE_MAX_LOSS_RATE;
+double max_jitter_mm = TUNE_MAX_JITTER_MM;
+double min_tracked = TUNE_MIN_TRACKED;
+tracking_params base;                   // The values of the parameters that are not swept
+
+/**
+ * The values swept for one parameter.
+ */
+struct grid_axis
+{
+    const char* name;
+    std::vector<double> values;
+};
+
+/**
+ * How one configuration did.
+ */
+struct tune_result
+{
+    int frames = 0;
+    double mean_ns = 0;
+    double p50_ns = 0;
+    double p99_ns = 0;
+    double tracked = 0;
+    double loss_rate = 0;
+    double jitter_mm = 0;
+    double window = 0;
+};
+
+/**
+ * Parses the user input. Handles errors such as incorrect argument count, etc.
+ */
+void parse_input(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--replay") == 0 && i+1 < argc && replay_paths.size() < MAX_CAMERAS)
+        {
+            replay_paths.push_back(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--calibration") == 0 && i+1 < argc)
+        {
+            calib_paths.push_back(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--params") == 0 && i+1 < argc)
+        {
+            if (!base.load(argv[++i]))
+            {
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--grid") == 0 && i+1 < argc)
+        {
+            grid_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i+1 < argc)
+        {
+            samples = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--max-loss") == 0 && i+1 < argc)
+        {
+            max_loss_rate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-jitter") == 0 && i+1 < argc)
+        {
+            max_jitter_mm = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--min-tracked") == 0 && i+1 < argc)
+        {
+            min_tracked = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i+1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else
+        {
+            replay_paths.clear();
+            break;
+        }
+    }
+
+    if (replay_paths.empty())
+    {
+        printf("Correct Usage: %s --replay file... [--calibration file]... [--params file] [--grid file] [--samples n] "
+               "[--max-loss rate] [--max-jitter mm] [--min-tracked fraction] [--out file]\n", argv[0]);
+        exit(0);
+    }
+
+    // Cameras without a --calibration file get a default one, as in pose
+    for (int i = (int)calib_paths.size(); i < (int)replay_paths.size(); i++)
+    {
+        calib_paths.push_back(i == 0 ? std::string(CALIBRATION_FILE) : "calibration_" + std::to_string(i) + ".xml");
+    }
+}
+
+/**
+ * Reads the grid file, or builds the default grid over the parameters that
+ * trade the most time for accuracy.
+ *
+ * @param   grid    the axes to fill
+ * @return  false if the grid file could not be read
+ */
+bool load_grid(std::vector<grid_axis>& grid)
+{
+    if (grid_path == nullptr)
+    {
+        grid.push_back({"point_cloud_scaling_tracking", {0.12, 0.16, 0.2}});
+        grid.push_back({"kmeans_attempts", {1, 2}});
+        grid.push_back({"kmeans_iterations", {5, 10}});
+        grid.push_back({"kmeans_connect_threshold", {0.15, 0.25, 0.35}});
+        grid.push_back({"joint_smoothing", {0.5, 1}});
+        grid.push_back({"roi_margin", {0, 0.15}});
+        grid.push_back({"background_learn_frames", {0, 60}});
+        grid.push_back({"fit_iterations", {0, 3}});
+        grid.push_back({"superpixel_iterations", {0, 4}});
+        grid.push_back({"refine_radius", {0, 0.1}});
+        return true;
+    }
+
+    cv::FileStorage grid_file(grid_path, cv::FileStorage::READ);
+
+    if (!grid_file.isOpened())
+    {
+        printf("Could not read the grid from %s\n", grid_path);
+        return false;
+    }
+
+    for (int i = 0; i < tracking_params::scalar_count(); i++)
+    {
+        const char* name = tracking_params::scalar_name(i);
+        cv::FileNode node = grid_file[name];
+
+        if (node.empty())
+        {
+            continue;
+        }
+
+        grid_axis axis = {name, {}};
+
+        if (node.isSeq())
+        {
+            for (int j = 0; j < (int)node.size(); j++)
+            {
+                axis.values.push_back((double)node[j]);
+            }
+        }
+        else
+        {
+            axis.values.push_back((double)node);
+        }
+
+        grid.push_back(axis);
+    }
+
+    grid_file.release();
+    return true;
+}
+
+/**
+ * Lists the configurations to try: every point of the grid, or a random
+ * sample of them if --samples was given.
+ */
+std::vector<tracking_params> make_configurations(const std::vector<grid_axis>& grid)
+{
+    std::vector<tracking_params> configs;
+    size_t total = 1;
+
+    for (const grid_axis& axis : grid)
+    {
+        total *= std::max((size_t)1, axis.values.size());
+    }
+
+    std::mt19937 rng(TUNE_SEED);
+    size_t count = samples > 0 ? (size_t)samples : total;
+
+    for (size_t n = 0; n < count; n++)
+    {
+        tracking_params params = base;
+        size_t index = n;
+
+        for (const grid_axis& axis : grid)
+        {
+            if (axis.values.empty())
+            {
+                continue;
+            }
+
+            // Walk the grid in order, or pick each value at random
+            size_t j = samples > 0 ? rng() % axis.values.size() : index % axis.values.size();
+            index /= axis.values.size();
+            params.set(axis.name, axis.values[j]);
+        }
+
+        configs.push_back(params);
+    }
+
+    return configs;
+}
+
+/**
+ * Follows one arm across frames for the stability measures.
+ */
+struct arm_stats
+{
+    bool was_tracked = false;
+    int run = 0;                // Consecutive tracked frames so far, up to 3
+    float joints[2][9] = {};    // The joints of the last two tracked frames, newest first
+    int tracked_frames = 0;
+    int losses = 0;
+    double jitter_sq = 0;       // Sum of squared second differences (m^2)
+    int jitter_samples = 0;
+
+    /**
+     * Adds a frame.
+     *
+     * @param   a       the arm after the frame
+     * @param   tracked whether or not it was tracked
+     */
+    template<class Config>
+    void add(const basic_arm<Config>& a, bool tracked)
+    {
+        if (!tracked)
+        {
+            losses += was_tracked;
+            was_tracked = false;
+            run = 0;
+            return;
+        }
+
+        float cur[9];
+        memcpy(cur, a.hand_loc, sizeof(a.hand_loc));
+        memcpy(cur+3, a.elbow_loc, sizeof(a.elbow_loc));
+        memcpy(cur+6, a.shoulder_loc, sizeof(a.shoulder_loc));
+
+        run = std::min(run+1, 3);
+
+        if (run == 3)
+        {
+            for (int i = 0; i < 9; i++)
+            {
+                double d2 = cur[i] - 2*joints[0][i] + joints[1][i];
+                jitter_sq += d2*d2;
+            }
+
+            jitter_samples += 3;
+        }
+
+        memcpy(joints[1], joints[0], sizeof(joints[0]));
+        memcpy(joints[0], cur, sizeof(cur));
+        tracked_frames++;
+        was_tracked = true;
+    }
+};
+
+/**
+ * Replays the recordings through the tracker with the given parameters.
+ *
+ * @tparam  Config  the tracker configuration (see trackerConfig.h)
+ * @param   params  the parameters to run with
+ * @param   result  filled with the measurements
+ * @return  false if the recordings could not be opened
+ */
+template<class Config>
+bool evaluate(const tracking_params& params, tune_result& result)
+{
+    camera_rig rig(params.point_cloud_scaling_tracking, RIG_SYNC_TOLERANCE_MS);
+
+    for (const char* replay_path : replay_paths)
+    {
+        // As fast as possible, and only once through
+        recording_source* recording = new recording_source(false, false);
+
+        if (!recording->open(replay_path))
+        {
+            delete recording;
+            return false;
+        }
+
+        rig.add_camera(recording);
+    }
+
+    rig.start_stream();
+
+    for (int i = 0; i < rig.size(); i++)
+    {
+        rig.camera(i).cloud.load_calibration_matrix(calib_paths[i].c_str());
+    }
+
+    basic_tracker<Config> trk(params.kmeans_k);
+    basic_arm<Config> left(trk, cv::Mat(1, 3, CV_32FC1, (void*)params.left_arm_start_pos),
+                           params.hand_max_dist_to_start, params.shoulder_dxdz_threshold);
+    basic_arm<Config> right(trk, cv::Mat(1, 3, CV_32FC1, (void*)params.right_arm_start_pos),
+                            params.hand_max_dist_to_start, params.shoulder_dxdz_threshold);
+    voxel_grid voxels(params.voxel_leaf_size > 0 ? params.voxel_leaf_size : 1);
+    tracking_window<Config> window(params.roi_margin, params.roi_refresh_frames, trk.num_clusters());
+    fitted_arms<Config> arms(params.fit_iterations, params.fit_radius, params.fit_gate, params.fit_max_residual,
+                             params.fit_min_points);
+    joint_refiner refiner(params.refine_radius, params.refine_min_points);
+    pipeline_config config;
+    params.apply(config);
+
+    for (int i = 0; i < rig.size(); i++)
+    {
+        float rotation[9], translation[3];
+        rig.camera(i).cloud.get_calibration(rotation, translation);
+        trk.set_view_calibration(i, rotation, translation);
+    }
+
+    rig.learn_background(params.background_learn_frames, params.background_min_gap, params.background_sigma);
+    rig.keep_full_depth(refiner.enabled());
+    rig.reserve();
+    int max_points = rig.max_points();
+    int view_rows, view_cols;
+
+    if (max_points > 0 && rig.scaled_frame_size(view_rows, view_cols))
+    {
+        voxels.reserve(max_points);
+        trk.reserve(max_points, params.kmeans_attempts, view_rows, view_cols);
+        arms.reserve(max_points);
+    }
+
+    std::vector<depth_frame> views;
+    pointCloud cloud;
+    std::vector<double> ns;
+    arm_stats stats[2];
+
+    for (int frame = 0; rig.capture(views); frame++)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        rig.filter_background(views, params.prefilter_depth_max_dist, params.prefilter_manhattan_dist);
+        rig.to_cloud(views, cloud);
+
+        if (params.voxel_leaf_size > 0)
+        {
+            cloud.voxel_downsample(voxels);
+        }
+
+        trk.update_point_cloud(cloud);
+        bool left_tracked, right_tracked;
+        bool clustered = arms.track(trk, views, left, right, config, left_tracked, right_tracked);
+
+        if (left_tracked)
+        {
+            refiner.refine(rig, views, left.hand_loc, left.elbow_loc);
+        }
+
+        if (right_tracked)
+        {
+            refiner.refine(rig, views, right.hand_loc, right.elbow_loc);
+        }
+
+        window.update(rig, trk, clustered, left, left_tracked, right, right_tracked);
+
+        auto end = std::chrono::steady_clock::now();
+
+        if (frame >= TUNE_WARMUP_FRAMES)
+        {
+            ns.push_back(std::chrono::duration<double, std::nano>(end-start).count());
+        }
+
+        for (const depth_frame& view : views)
+        {
+            result.window += (double)view.roi.area()/(view.depth.rows*view.depth.cols)/views.size();
+        }
+
+        stats[0].add(left, left_tracked);
+        stats[1].add(right, right_tracked);
+        result.frames++;
+    }
+
+    if (result.frames > 0)
+    {
+        result.window /= result.frames;
+    }
+
+    if (ns.empty())
+    {
+        return true;    // Too short to time. Reported with zero latency.
+    }
+
+    std::sort(ns.begin(), ns.end());
+
+    for (double t : ns)
+    {
+        result.mean_ns += t;
+    }
+
+    result.mean_ns /= ns.size();
+    result.p50_ns = ns[ns.size()/2];
+    result.p99_ns = ns[std::min(ns.size()-1, (size_t)(0.99*ns.size()))];
+
+    double arm_frames = 2.0*result.frames;
+    double jitter_sq = stats[0].jitter_sq + stats[1].jitter_sq;
+    int jitter_samples = stats[0].jitter_samples + stats[1].jitter_samples;
+
+    result.tracked = (stats[0].tracked_frames + stats[1].tracked_frames)/arm_frames;
+    result.loss_rate = (stats[0].losses + stats[1].losses)/arm_frames;
+    result.jitter_mm = jitter_samples ? 1000*sqrt(jitter_sq/jitter_samples) : 0;
+
+    return true;
+}
+
+/**
+ * @return  whether the configuration meets the accuracy bar
+ */
+bool meets_bar(const tune_result& r)
+{
+    return r.frames > 0 && r.tracked >= min_tracked && r.loss_rate <= max_loss_rate && r.jitter_mm <= max_jitter_mm;
+}
+
+/**
+ * Prints a configuration and how it did as a JSON line.
+ */
+void report(const tracking_params& params, const tune_result& r, const char* config_name)
+{
+    printf("{\"config\":\"%s\",\"params\":{", config_name);
+
+    for (int i = 0; i < tracking_params::scalar_count(); i++)
+    {
+        const char* name = tracking_params::scalar_name(i);
+        printf("%s\"%s\":%g", i ? "," : "", name, params.get(name));
+    }
+
+    printf("},\"frames\":%d,\"mean_ns\":%.0f,\"p50_ns\":%.0f,\"p99_ns\":%.0f,"
+           "\"tracked\":%.4f,\"loss_rate\":%.4f,\"jitter_mm\":%.3f,\"window\":%.3f,\"meets_bar\":%s}\n",
+           r.frames, r.mean_ns, r.p50_ns, r.p99_ns, r.tracked, r.loss_rate, r.jitter_mm, r.window,
+           meets_bar(r) ? "true" : "false");
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[])
+{
+    parse_input(argc, argv);
+
+    std::vector<grid_axis> grid;
+
+    if (!load_grid(grid))
+    {
+        return 1;
+    }
+
+    std::vector<tracking_params> configs = make_configurations(grid);
+    int best = -1;
+    tune_result best_result;
+
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        const tracking_params& params = configs[i];
+        tune_result result;
+        bool compiled = params.kmeans_k == compiled_tracker_config::k;
+
+        // The compiled configuration is what pose would run with this k
+        bool opened = compiled ? evaluate<compiled_tracker_config>(params, result)
+                               : evaluate<runtime_tracker_config>(params, result);
+
+        if (!opened)
+        {
+            return 1;
+        }
+
+        report(params, result, compiled ? "compiled" : "runtime");
+
+        if (meets_bar(result) && (best < 0 || result.mean_ns < best_result.mean_ns))
+        {
+            best = (int)i;
+            best_result = result;
+        }
+    }
+
+    if (best < 0)
+    {
+        printf("No configuration met the bar (tracked >= %g, loss rate <= %g, jitter <= %g mm)\n",
+               min_tracked, max_loss_rate, max_jitter_mm);
+        return 1;
+    }
+
+    printf("Fastest configuration that meets the bar (%.0f ns per frame):\n", best_result.mean_ns);
+    report(configs[best], best_result, configs[best].kmeans_k == compiled_tracker_config::k ? "compiled" : "runtime");
+
+    if (out_path)
+    {
+        printf("Saving the parameters to %s...\n", out_path);
+        configs[best].save(out_path);
+    }
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in viewRenderer.h.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+#define ARM_LOCKED_ANGLE_THESHOLD_D 23
+#define CLOUD_POINT_SIZE 4
+#define CENTER_POINT_SIZE 12
+#define MESH_LINE_WIDTH 3
+#define JOINT_POINT_SIZE_LOCKED 35
+#define JOINT_POINT_SIZE 25
+#define FENCE_TIMEOUT_NS 1000000000ull
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <algorithm>
+#include <cstring>
+#include "viewRenderer.h"
+
+#define BUFFER_STORAGE_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+void view_renderer::init(void)
+{
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    persistent = extensions && strstr(extensions, "GL_ARB_buffer_storage");
+}
+
+void view_renderer::draw(const view_snapshot& snapshot, bool calibration, int viewport_w, int viewport_h)
+{
+    // Level of detail: about one point per point-sized cell of the viewport
+    size_t n_cloud = snapshot.cloud.size()/3;
+    size_t max_cloud = std::max(1, viewport_w*viewport_h/(CLOUD_POINT_SIZE*CLOUD_POINT_SIZE));
+    size_t stride = (n_cloud+max_cloud-1)/max_cloud;
+    size_t n_cloud_drawn = stride ? (n_cloud+stride-1)/stride : 0;
+
+    size_t k = snapshot.clustered ? snapshot.centers.size()/3 : 0;
+    size_t n_edges = 0;
+
+    if (k*k != snapshot.adj.size())
+    {
+        k = 0;
+    }
+
+    for (size_t r = 0; r < k; r++)
+    {
+        for (size_t c = r+1; c < k; c++)
+        {
+            n_edges += snapshot.adj[r*k+c];
+        }
+    }
+
+    size_t n_vertices = n_cloud_drawn + k + 2*n_edges + 6;
+    reserve(n_vertices);
+    wait_for_segment(segment);
+
+    size_t base = segment*segment_vertices;
+    vertex* out = persistent ? mapped+base : staging.data();
+    vertex* v = out;
+
+    // The top view maps x->x, -z->y. Calibration shows the camera's x-y plane.
+    for (size_t i = 0; i < n_cloud; i += stride)
+    {
+        const float* p = &snapshot.cloud[3*i];
+        v->x = p[0];
+        v->y = calibration ? p[1] : -p[2];
+        v++;
+    }
+
+    for (size_t c = 0; c < k; c++)
+    {
+        v->x = snapshot.centers[3*c];
+        v->y = -snapshot.centers[3*c+2];
+        v++;
+    }
+
+    for (size_t r = 0; r < k; r++)
+    {
+        for (size_t c = r+1; c < k; c++)
+        {
+            if (snapshot.adj[r*k+c])
+            {
+                v[0].x = snapshot.centers[3*r];
+                v[0].y = -snapshot.centers[3*r+2];
+                v[1].x = snapshot.centers[3*c];
+                v[1].y = -snapshot.centers[3*c+2];
+                v += 2;
+            }
+        }
+    }
+
+    const arm_snapshot* arms[2] = {&snapshot.left_arm, &snapshot.right_arm};
+
+    for (int a = 0; a < 2; a++)
+    {
+        const float* joints[3] = {arms[a]->hand, arms[a]->elbow, arms[a]->shoulder};
+
+        for (int j = 0; j < 3; j++)
+        {
+            v->x = joints[j][0];
+            v->y = -joints[j][2];
+            v++;
+        }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    if (!persistent)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, base*sizeof(vertex), n_vertices*sizeof(vertex), out);
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(vertex), (const void*)(base*sizeof(vertex)));
+
+    GLint first = 0;
+
+    glColor3ub(0, 0, 0);
+    glPointSize(CLOUD_POINT_SIZE);
+    glDrawArrays(GL_POINTS, first, n_cloud_drawn);
+    first += n_cloud_drawn;
+
+    glColor3ub(255, 0, 0);
+    glPointSize(CENTER_POINT_SIZE);
+    glDrawArrays(GL_POINTS, first, k);
+    first += k;
+
+    glLineWidth(MESH_LINE_WIDTH);
+    glDrawArrays(GL_LINES, first, 2*n_edges);
+    first += 2*n_edges;
+
+    for (int a = 0; a < 2; a++)
+    {
+        if (arms[a]->tracked)
+        {
+            if (arms[a]->bend_angle < ARM_LOCKED_ANGLE_THESHOLD_D)
+            {
+                glPointSize(JOINT_POINT_SIZE_LOCKED);
+                glColor3ub(255, 0, 0);
+            }
+            else
+            {
+                glPointSize(JOINT_POINT_SIZE);
+                glColor3ub(0, 0, 255);
+            }
+
+            glDrawArrays(GL_POINTS, first, 3);
+        }
+
+        first += 3;
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The segment can be reused once the GPU has executed these draws
+    fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    segment = (segment+1) % n_segments;
+}
+
+void view_renderer::release(void)
+{
+    for (int seg = 0; seg < n_segments; seg++)
+    {
+        wait_for_segment(seg);
+    }
+
+    if (buffer != 0)
+    {
+        if (persistent)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        glDeleteBuffers(1, &buffer);
+    }
+
+    buffer = 0;
+    mapped = nullptr;
+    segment_vertices = 0;
+}
+
+void view_renderer::reserve(size_t vertices)
+{
+    if (vertices <= segment_vertices)
+    {
+        return;
+    }
+
+    // Storage is immutable with ARB_buffer_storage, so grow by recreating the buffer
+    size_t grown = std::max(vertices, 2*segment_vertices);
+    release();
+
+    segment_vertices = grown;
+    segment = 0;
+    size_t bytes = n_segments*segment_vertices*sizeof(vertex);
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    if (persistent)
+    {
+        glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, BUFFER_STORAGE_FLAGS);
+        mapped = (vertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, BUFFER_STORAGE_FLAGS);
+
+        if (mapped == nullptr)
+        {
+            // Fall back to uploads for good. The immutable buffer has to be replaced.
+            persistent = false;
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        }
+    }
+
+    if (!persistent)
+    {
+        glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        staging.resize(segment_vertices);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void view_renderer::wait_for_segment(int seg)
+{
+    if (fences[seg] == nullptr)
+    {
+        return;
+    }
+
+    glClientWaitSync(fences[seg], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+    glDeleteSync(fences[seg]);
+    fences[seg] = nullptr;
+}
+
+view_renderer::view_renderer(void)
+{
+    buffer = 0;
+    persistent = false;
+    mapped = nullptr;
+    segment_vertices = 0;
+    segment = 0;
+
+    for (int seg = 0; seg < n_segments; seg++)
+    {
+        fences[seg] = nullptr;
+    }
+}
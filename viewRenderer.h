@@ -0,0 +1,81 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Draws view snapshots with vertex buffers instead of immediate mode. Each
+ * frame the cloud, centers, mesh edges and joints are written straight into
+ * a persistently mapped buffer and drawn with one call per primitive group.
+ * The buffer is split into three segments used in turn, with a fence per
+ * segment, so the CPU never writes vertices the GPU is still reading.
+ * Without ARB_buffer_storage the same segments are filled with
+ * glBufferSubData instead.
+ *
+ * Large clouds are decimated to about one point per point-sized cell of
+ * the viewport, since more points cannot be told apart on screen.
+ *
+ * All functions must be called on the thread that owns the GL context.
+ */
+
+#ifndef VIEWRENDERER_H
+#define VIEWRENDERER_H
+
+#include <vector>
+#include <stddef.h>
+#include "poseView.h"
+
+// Opaque handles from GL/gl.h, so users of the renderer do not need the GL headers
+typedef struct __GLsync* GLsync;
+
+class view_renderer
+{
+    public:
+        /**
+         * Sets up the vertex buffers. Needs a current GL context.
+         */
+        void init(void);
+
+        /**
+         * Draws the given snapshot. Coordinates are mapped x->x, -z->y for the top
+         * view or x->x, y->y when calibrating.
+         *
+         * @param   snapshot        the frame to draw
+         * @param   calibration     whether or not to draw the camera's x-y plane
+         * @param   viewport_w      the width of the viewport in pixels, used for the level of detail
+         * @param   viewport_h      the height of the viewport in pixels
+         */
+        void draw(const view_snapshot& snapshot, bool calibration, int viewport_w, int viewport_h);
+
+        /**
+         * Frees the vertex buffers. Needs the same context as init.
+         */
+        void release(void);
+
+        view_renderer(void);
+
+    private:
+        struct vertex
+        {
+            float x, y;
+        };
+
+        static const int n_segments = 3;
+
+        unsigned int buffer;                // GL buffer name, 0 if not created
+        bool persistent;                    // Whether or not ARB_buffer_storage is available
+        vertex* mapped;                     // Persistent mapping of the whole buffer
+        std::vector<vertex> staging;        // Written instead of mapped without ARB_buffer_storage
+        size_t segment_vertices;            // Capacity of one segment
+        int segment;                        // The segment written next
+        GLsync fences[n_segments];          // Signalled once the GPU is done with each segment
+
+        /**
+         * Grows the segments to hold at least the given number of vertices.
+         */
+        void reserve(size_t vertices);
+
+        /**
+         * Waits until the GPU has finished with the given segment.
+         */
+        void wait_for_segment(int seg);
+};
+
+#endif
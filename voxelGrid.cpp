@@ -0,0 +1,123 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in voxelGrid.h.
+ */
+
+#include "voxelGrid.h"
+#include <math.h>
+
+// Each voxel coordinate is packed into 21 bits of the key
+#define VOXEL_COORD_BITS 21
+#define VOXEL_COORD_OFFSET (1 << (VOXEL_COORD_BITS-1))
+#define VOXEL_COORD_MASK ((1 << VOXEL_COORD_BITS)-1)
+
+int voxel_grid::filter(float* points, int n)
+{
+    resize_table(n);
+
+    // A new generation invalidates every voxel from the last call
+    if (++generation == 0)
+    {
+        for (size_t i = 0; i < table.size(); i++)
+        {
+            table[i].generation = 0;
+        }
+
+        generation = 1;
+    }
+
+    occupied.clear();
+    const size_t mask = table.size()-1;
+
+    for (int i = 0; i < n; i++)
+    {
+        const float* p = points+3*i;
+
+        uint64_t vx = ((int)floorf(p[0]*inv_leaf_size) + VOXEL_COORD_OFFSET) & VOXEL_COORD_MASK;
+        uint64_t vy = ((int)floorf(p[1]*inv_leaf_size) + VOXEL_COORD_OFFSET) & VOXEL_COORD_MASK;
+        uint64_t vz = ((int)floorf(p[2]*inv_leaf_size) + VOXEL_COORD_OFFSET) & VOXEL_COORD_MASK;
+        uint64_t key = vx | (vy << VOXEL_COORD_BITS) | (vz << 2*VOXEL_COORD_BITS);
+
+        // Fibonacci hashing, then linear probing
+        size_t slot = (key*0x9E3779B97F4A7C15ull) >> hash_shift;
+
+        while (table[slot].generation == generation && table[slot].key != key)
+        {
+            slot = (slot+1) & mask;
+        }
+
+        voxel& v = table[slot];
+
+        if (v.generation != generation)
+        {
+            v.key = key;
+            v.generation = generation;
+            v.count = 0;
+            v.sum[0] = v.sum[1] = v.sum[2] = 0;
+            occupied.push_back((int)slot);
+        }
+
+        v.count++;
+        v.sum[0] += p[0];
+        v.sum[1] += p[1];
+        v.sum[2] += p[2];
+    }
+
+    // Every point has been read, so the centroids can overwrite the input
+    const int n_voxels = (int)occupied.size();
+
+    for (int i = 0; i < n_voxels; i++)
+    {
+        const voxel& v = table[occupied[i]];
+        float inv_count = 1.0f/v.count;
+
+        points[3*i] = v.sum[0]*inv_count;
+        points[3*i+1] = v.sum[1]*inv_count;
+        points[3*i+2] = v.sum[2]*inv_count;
+    }
+
+    return n_voxels;
+}
+
+void voxel_grid::reserve(int max_points)
+{
+    resize_table(max_points);
+    occupied.reserve(max_points);
+}
+
+void voxel_grid::set_leaf_size(float leaf_size)
+{
+    voxel_grid::leaf_size = leaf_size;
+    inv_leaf_size = 1.0f/leaf_size;
+}
+
+void voxel_grid::resize_table(int n)
+{
+    size_t size = 64;
+    int bits = 6;
+
+    while (size < 2*(size_t)n)
+    {
+        size *= 2;
+        bits++;
+    }
+
+    // Only ever grows, so steady-state frames do not allocate
+    if (size <= table.size())
+    {
+        return;
+    }
+
+    voxel empty = {};
+    table.assign(size, empty);
+    hash_shift = 64-bits;
+    generation = 0;
+}
+
+voxel_grid::voxel_grid(float leaf_size)
+{
+    set_leaf_size(leaf_size);
+    generation = 0;
+    hash_shift = 64;
+}
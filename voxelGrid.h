@@ -0,0 +1,76 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Downsamples a point cloud onto a regular 3D grid. Every occupied voxel
+ * is replaced by the centroid of the points that fell into it. Sampling
+ * the depth image uniformly oversamples near surfaces compared to far
+ * ones; the grid normalizes the density so later stages see a bounded
+ * number of points regardless of how close the user is to the camera.
+ *
+ * Voxels are found through an open-addressing hash table keyed on the
+ * voxel coordinates. The table is kept between frames and invalidated
+ * with a generation counter instead of being cleared.
+ */
+
+#ifndef VOXELGRID_H
+#define VOXELGRID_H
+
+#include <stdint.h>
+#include <vector>
+
+class voxel_grid
+{
+    public:
+        /**
+         * Replaces the points with one centroid per occupied voxel, in place.
+         * Centroids are written in the order their voxels were first seen.
+         *
+         * @param   points      the points (x,y,z interleaved)
+         * @param   n           the number of points
+         * @return  the number of points after downsampling
+         */
+        int filter(float* points, int n);
+
+        /**
+         * Preallocates the tables for the given number of input points.
+         */
+        void reserve(int max_points);
+
+        /**
+         * @param   leaf_size   the edge length of a voxel, in the units of the cloud
+         */
+        void set_leaf_size(float leaf_size);
+
+        float get_leaf_size(void) const
+        {
+            return leaf_size;
+        }
+
+        /**
+         * @param   leaf_size   the edge length of a voxel, in the units of the cloud
+         */
+        voxel_grid(float leaf_size);
+
+    private:
+        struct voxel
+        {
+            uint64_t key;           // Packed voxel coordinates
+            uint32_t generation;    // The filter call the voxel belongs to
+            uint32_t count;         // Points in the voxel
+            float sum[3];           // Sum of the points in the voxel
+        };
+
+        float leaf_size;
+        float inv_leaf_size;
+        uint32_t generation;            // Incremented per call, so stale voxels never need clearing
+        int hash_shift;                 // 64 - log2(table size)
+        std::vector<voxel> table;       // Open-addressing hash table, a power of two in size
+        std::vector<int> occupied;      // Table indices in the order they were first used
+
+        /**
+         * Grows the table so it stays at most half full for n points.
+         */
+        void resize_table(int n);
+};
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * Author: Adam Mooers
+ *
+ * Implements the library found in workerPool.h.
+ */
+
+#include "workerPool.h"
+#include "allocCheck.h"
+
+int worker_pool::size(void) const
+{
+    return (int)threads.size()+1;
+}
+
+void worker_pool::dispatch(int n_tasks, task_fn fn, void* ctx)
+{
+    if (n_tasks <= 0)
+    {
+        return;
+    }
+
+    // Nothing to share, so skip the hand-off
+    if (threads.empty() || n_tasks == 1)
+    {
+        for (int i = 0; i < n_tasks; i++)
+        {
+            fn(ctx, i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(run_mutex);
+
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        cur_fn = fn;
+        cur_ctx = ctx;
+        cur_n_tasks = n_tasks;
+        cur_alloc_check = ALLOC_CHECK_CURRENT();
+        next_task.store(0);
+        busy_workers = (int)threads.size();
+        generation++;
+    }
+
+    work_ready.notify_all();
+
+    drain();
+
+    // Wait for the workers to finish their last tasks
+    std::unique_lock<std::mutex> lock(state_mutex);
+    work_done.wait(lock, [this]{ return busy_workers == 0; });
+}
+
+void worker_pool::drain(void)
+{
+    for (int i = next_task.fetch_add(1); i < cur_n_tasks; i = next_task.fetch_add(1))
+    {
+        cur_fn(cur_ctx, i);
+    }
+}
+
+void worker_pool::worker_loop(void)
+{
+    unsigned long seen_generation = 0;
+    const char* alloc_check = nullptr;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(state_mutex);
+            work_ready.wait(lock, [&]{ return stopping || generation != seen_generation; });
+
+            if (stopping)
+            {
+                return;
+            }
+
+            seen_generation = generation;
+            alloc_check = cur_alloc_check;
+        }
+
+        // Tasks are held to the same allocation rules as the thread that dispatched them
+        ALLOC_CHECK_THREAD(alloc_check);
+        drain();
+        ALLOC_CHECK_THREAD(nullptr);
+
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            busy_workers--;
+        }
+
+        work_done.notify_one();
+    }
+}
+
+worker_pool::worker_pool(int n_threads)
+{
+    if (n_threads <= 0)
+    {
+        n_threads = (int)std::thread::hardware_concurrency();
+    }
+
+    next_task.store(0);
+
+    // The calling thread is the first worker
+    for (int i = 1; i < n_threads; i++)
+    {
+        threads.push_back(std::thread(&worker_pool::worker_loop, this));
+    }
+}
+
+worker_pool::~worker_pool(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stopping = true;
+    }
+
+    work_ready.notify_all();
+
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+}
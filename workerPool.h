@@ -0,0 +1,82 @@
+/**
+ * Author: Adam Mooers
+ *
+ * A small persistent thread pool for splitting per-frame work across cores.
+ * Threads are created once, so dispatching work does not allocate or spawn
+ * threads on the hot path.
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class worker_pool
+{
+    public:
+        /**
+         * Runs task(i) for every i in [0, n_tasks) and blocks until all of them
+         * have finished. The calling thread also executes tasks. Calls from
+         * different threads are serialized.
+         *
+         * @param   n_tasks     the number of tasks to run
+         * @param   task        a callable taking the task index
+         */
+        template<class F>
+        void run(int n_tasks, F& task)
+        {
+            dispatch(n_tasks, &invoke<F>, &task);
+        }
+
+        /**
+         * @return  the number of threads that execute tasks, including the caller
+         */
+        int size(void) const;
+
+        /**
+         * @param   n_threads   the total number of threads to use, including the caller.
+         *                      Zero selects the number of hardware threads.
+         */
+        worker_pool(int n_threads = 0);
+
+        ~worker_pool(void);
+
+    private:
+        typedef void (*task_fn)(void*, int);
+
+        std::vector<std::thread> threads;
+        std::mutex run_mutex;               // Serializes concurrent callers of run
+        std::mutex state_mutex;             // Guards the fields below
+        std::condition_variable work_ready;
+        std::condition_variable work_done;
+        unsigned long generation = 0;       // Incremented for every dispatched job
+        bool stopping = false;
+        int busy_workers = 0;               // Workers still executing the current job
+
+        task_fn cur_fn = nullptr;           // The current job
+        void* cur_ctx = nullptr;
+        int cur_n_tasks = 0;
+        const char* cur_alloc_check = nullptr; // The allocation check the job was dispatched under
+        std::atomic<int> next_task;         // Next unclaimed task index
+
+        template<class F>
+        static void invoke(void* ctx, int i)
+        {
+            (*(F*)ctx)(i);
+        }
+
+        void dispatch(int n_tasks, task_fn fn, void* ctx);
+
+        /**
+         * Claims and runs tasks of the current job until none are left.
+         */
+        void drain(void);
+
+        void worker_loop(void);
+};
+
+#endif